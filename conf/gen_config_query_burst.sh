@@ -0,0 +1,79 @@
+#!/bin/sh
+#
+# generate a user-level click config that bursts route queries
+#
+# Node A runs the SR2QuerierMulti and queries DSTS destinations nobody
+# has a route to, GAP msecs apart. Its queries go straight to the
+# SR2MetricFloodMulti of node B, a neighbour of A, which re-floods
+# them. Once the floods are done the config prints query_stats of A
+# and flood_stats of B and stops. Run it with AGGREGATE 0 and with
+# aggregation on and compare the packets sent by A and re-flooded by B:
+#
+#   sh gen_config_query_burst.sh 0 300 0 > burst.click && click burst.click
+#   sh gen_config_query_burst.sh 20 300 0 > burst.click && click burst.click
+#
+# No devices are needed. A run takes DSTS times GAP msecs plus two
+# seconds.
+
+# AGGREGATE window of the querier in msecs, 0 for off
+AGGREGATE=${1:-0}
+# destinations to query
+DSTS=${2:-300}
+# msecs between two destinations, 0 for all at once
+GAP=${3:-0}
+
+A_IP="6.0.0.1"
+B_IP="6.0.0.2"
+
+echo "a_it :: AvailableInterfaces(DEFAULT 257 ath4 00:00:00:00:00:01 2 4 11 22);
+a_lt :: SR2LinkTableMulti(IP $A_IP);
+a_arp :: ARPTableMulti();
+
+b_it :: AvailableInterfaces(DEFAULT 257 ath4 00:00:00:00:00:02 2 4 11 22);
+b_lt :: SR2LinkTableMulti(IP $B_IP);
+b_arp :: ARPTableMulti();
+
+fwd :: SR2ForwarderMulti(ETHTYPE 0x0643,
+			 IP $A_IP,
+			 IT a_it,
+			 LT a_lt,
+			 ARP a_arp);
+
+querier :: SR2QuerierMulti(ETHTYPE 0x0644,
+			   IP $A_IP,
+			   IT a_it,
+			   FWD fwd,
+			   LT a_lt,
+			   AGGREGATE $AGGREGATE);
+
+flood :: SR2MetricFloodMulti(ETHTYPE 0x0644,
+			     IP $B_IP,
+			     IT b_it,
+			     LT b_lt,
+			     ARP b_arp,
+			     JITTER 10);
+
+Idle -> querier;
+querier [0] -> Discard;
+querier [1] -> SR2SetChecksumMulti -> SR2CheckHeaderMulti -> flood;
+flood [0] -> refloods :: Counter -> Discard;
+flood [1] -> Discard;
+
+Script(write b_lt.update_link $A_IP 257 $B_IP 257 100 1 0,
+       write b_lt.update_link $B_IP 257 $A_IP 257 100 1 0,"
+
+# destinations 7.0.1.1 to 7.0.1.250, then 7.0.2.1 on
+i=0
+while [ $i -lt $DSTS ]; do
+	echo "       write querier.query 7.0.$(($i / 250 + 1)).$(($i % 250 + 1)),"
+	if [ $GAP -gt 0 ]; then
+		echo "       wait $(($GAP / 1000)).$(printf %03d $(($GAP % 1000))),"
+	fi
+	i=$(($i + 1))
+done
+
+echo "       wait 2,
+       print querier.query_stats,
+       print flood.flood_stats,
+       print refloods.count,
+       stop);"
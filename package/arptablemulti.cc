@@ -148,9 +148,9 @@ ARPTableMulti::run_timer(Timer *timer)
 {
     // Expire any old entries, and make sure there's room for at least one
     // packet.
-    _lock.acquire_write();
+    _lock.acquire();
     slim();
-    _lock.release_write();
+    _lock.release();
     if (_expire_jiffies)
 	timer->schedule_after_sec(_expire_jiffies / CLICK_HZ + 1);
 }
@@ -158,12 +158,12 @@ ARPTableMulti::run_timer(Timer *timer)
 ARPTableMulti::ARPEntryMulti *
 ARPTableMulti::ensure(NodeAddress node)
 {
-    _lock.acquire_write();
+    _lock.acquire();
     Table::iterator it = _table.find(node);
     if (!it) {
 	void *x = _alloc.allocate();
 	if (!x) {
-	    _lock.release_write();
+	    _lock.release();
 	    return 0;
 	}
 
@@ -207,7 +207,7 @@ ARPTableMulti::insert(NodeAddress node, const EtherAddress &eth, Packet **head)
     }
 
     _table.balance();
-    _lock.release_write();
+    _lock.release();
     return 0;
 }
 
@@ -215,7 +215,7 @@ void
 ARPTableMulti::change_if(NodeAddress node, uint16_t new_iface)
 {
 
-	  _lock.acquire_write();
+	  _lock.acquire();
     Table::iterator it = _table.find(node);
 
 		NodeAddress node_new = NodeAddress(node._ipaddr,new_iface);
@@ -235,7 +235,7 @@ ARPTableMulti::change_if(NodeAddress node, uint16_t new_iface)
 			
 		}
 		
-		_lock.release_write();
+		_lock.release();
 	
 }
 
@@ -248,7 +248,7 @@ ARPTableMulti::append_query(NodeAddress node, Packet *p)
 
     click_jiffies_t now = click_jiffies();
     if (ae->unicast(now, _expire_jiffies)) {
-	_lock.release_write();
+	_lock.release();
 	return -EAGAIN;
     }
 
@@ -271,14 +271,14 @@ ARPTableMulti::append_query(NodeAddress node, Packet *p)
 	r = 0;
 
     _table.balance();
-    _lock.release_write();
+    _lock.release();
     return r;
 }
 
 NodeAddress
 ARPTableMulti::reverse_lookup(const EtherAddress &eth)
 {
-    _lock.acquire_read();
+    _lock.acquire();
 
     NodeAddress node;
     for (Table::iterator it = _table.begin(); it; ++it){
@@ -288,7 +288,7 @@ ARPTableMulti::reverse_lookup(const EtherAddress &eth)
 			}
 		}
 
-    _lock.release_read();
+    _lock.release();
     return node;
 }
 
@@ -296,7 +296,7 @@ EtherAddress
 ARPTableMulti::lookup_def_eth(const EtherAddress &eth)
 {
     
-    _lock.acquire_read();
+    _lock.acquire();
 
     bool found = false;
     NodeAddress node;
@@ -319,7 +319,7 @@ ARPTableMulti::lookup_def_eth(const EtherAddress &eth)
 	    }
 		}
 
-    _lock.release_read();
+    _lock.release();
     
     if (!found){
       eth_out = EtherAddress::make_broadcast();
@@ -332,7 +332,7 @@ EtherAddress
 ARPTableMulti::lookup_def(NodeAddress node)
 {
     
-    _lock.acquire_read();
+    _lock.acquire();
 
     bool found = false;
     EtherAddress eth_out;
@@ -347,7 +347,7 @@ ARPTableMulti::lookup_def(NodeAddress node)
 	    }
 		}
 
-    _lock.release_read();
+    _lock.release();
     
     if (!found){
       eth_out = EtherAddress::make_broadcast();
@@ -161,7 +161,7 @@ class ARPTableMulti : public Element { public:
 
   private:
 
-    ReadWriteLock _lock;
+    Spinlock _lock;
 
     typedef HashContainer<ARPEntryMulti> Table;
     Table _table;
@@ -184,7 +184,7 @@ class ARPTableMulti : public Element { public:
 inline int
 ARPTableMulti::lookup(NodeAddress node, EtherAddress *eth, click_jiffies_t poll_jiffies)
 {
-    _lock.acquire_read();
+    _lock.acquire();
     int r = -1;
     if (Table::iterator it = _table.find(node)) {
 	click_jiffies_t now = click_jiffies();
@@ -199,7 +199,7 @@ ARPTableMulti::lookup(NodeAddress node, EtherAddress *eth, click_jiffies_t poll_
 		r = 0;
 	}
     }
-    _lock.release_read();
+    _lock.release();
     return r;
 }
 
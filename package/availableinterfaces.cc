@@ -90,7 +90,9 @@ AvailableInterfaces::parse_and_insert(String s, ErrorHandler *errh)
 	  li._available = true;
 	  li._rates = if_rates;
 		li._iface_name = iface_name;
+	  _lock.acquire();
 	  _default_ifaces.insert(iface, li);
+	  _lock.release();
 
 				
 	  return 0;
@@ -127,7 +129,9 @@ AvailableInterfaces::parse_and_insert(String s, ErrorHandler *errh)
 	DstInfo d = DstInfo(e_to);
 	d._rates = rates;
 	d._eth = e_to;
+	_lock.acquire();
 	_rtable.insert(epair, d);
+	_lock.release();
 	return 0;
 	
   }
@@ -171,8 +175,10 @@ AvailableInterfaces::take_state(Element *e, ErrorHandler *)
 {
   AvailableInterfaces *q = (AvailableInterfaces *)e->cast("AvailableInterfaces");
   if (!q) return;
+  _lock.acquire();
   _rtable = q->_rtable;
   _default_ifaces = _default_ifaces;
+  _lock.release();
 
 }
 
@@ -184,20 +190,21 @@ AvailableInterfaces::lookup(EtherPair epair)
     return Vector<int>();
   }
 
+  Vector<int> rates;
+  _lock.acquire();
   DstInfo *dst = _rtable.findp(epair);
   if (dst) {
-    return dst->_rates;
-  }
-
-  if (_default_ifaces.size()) {
+    rates = dst->_rates;
+  } else if (_default_ifaces.size()) {
 	int iface = lookup_id(epair._eth_from);
 	LocalIfInfo *ifinfo = _default_ifaces.findp(iface);
     if (ifinfo) {
-    	return ifinfo->_rates;
+    	rates = ifinfo->_rates;
   	}
   }
+  _lock.release();
 
-  return Vector<int>();
+  return rates;
 }
 
 EtherAddress
@@ -208,7 +215,9 @@ AvailableInterfaces::lookup_if(int iface)
     return EtherAddress();
   }
 
+  _lock.acquire();
   LocalIfInfo ifinfo = *(_default_ifaces.findp(iface));
+  _lock.release();
   EtherAddress eth = ifinfo._eth;
 
   return eth;
@@ -220,12 +229,14 @@ AvailableInterfaces::lookup_def()
     EtherAddress eth;
     LocalIfInfo ifinfo;
 
+    _lock.acquire();
     for (IIter it = _default_ifaces.begin(); it.live(); it++){
 		  ifinfo = it.value();
   		if (ifinfo._iface>=256 && ifinfo._iface<=511){
             eth = ifinfo._eth;
   		}
 	  }
+    _lock.release();
     
     return eth;
 	
@@ -235,15 +246,18 @@ int
 AvailableInterfaces::lookup_def_id()
 {
     LocalIfInfo ifinfo;
+    int iface = 0;
 
-    for (IIter it = _default_ifaces.begin(); it.live(); it++){
+    _lock.acquire();
+    for (IIter it = _default_ifaces.begin(); it.live() && !iface; it++){
 		  ifinfo = it.value();
   		if (ifinfo._iface>=256 && ifinfo._iface<=511){
-            return ifinfo._iface;
+            iface = ifinfo._iface;
   		}
 	  }
+    _lock.release();
     
-    return 0;
+    return iface;
 	
 }
 
@@ -254,12 +268,14 @@ AvailableInterfaces::lookup_id(EtherAddress eth)
 	uint16_t if_id = 0;
 	LocalIfInfo ifinfo;
 	
+	_lock.acquire();
 	for (IIter it = _default_ifaces.begin(); it.live(); it++){
 		ifinfo = it.value();
 		if (ifinfo._eth==eth){
 			if_id = it.key();
 		}
 	}
+	_lock.release();
 	
 	return if_id;
 	
@@ -272,12 +288,14 @@ AvailableInterfaces::check_if_local(EtherAddress eth)
 	bool is_local_if = false;
 	LocalIfInfo ifinfo;
 	
+	_lock.acquire();
 	for (IIter it = _default_ifaces.begin(); it.live(); it++){
 		ifinfo = it.value();
 		if (ifinfo._eth==eth){
 			is_local_if = true;
 		}
 	}
+	_lock.release();
 	
 	return is_local_if;
 	
@@ -290,12 +308,14 @@ AvailableInterfaces::check_if_present(int iface)
 	bool present = false;
 	LocalIfInfo ifinfo;
 	
+	_lock.acquire();
 	for (IIter it = _default_ifaces.begin(); it.live(); it++){
 		ifinfo = it.value();
 		if (ifinfo._iface==iface){
 			present = true;
 		}
 	}
+	_lock.release();
 	
 	return present;
 	
@@ -305,21 +325,21 @@ bool
 AvailableInterfaces::check_if_available(int iface)
 {
 	
+	_lock.acquire();
 	LocalIfInfo *ifinfo = _default_ifaces.findp(iface);
-	return ifinfo->_available;
+	bool available = ifinfo->_available;
+	_lock.release();
+	return available;
 	
 }
 
 bool
 AvailableInterfaces::check_remote_available(EtherAddress eth)
 {
-  ChangingChannel *ccinfo = _wtable.findp(eth);
-  
-  if (!ccinfo){
-    return true;
-  } else {
-    return false;
-  }
+  _lock.acquire();
+  bool available = !_wtable.findp(eth);
+  _lock.release();
+  return available;
   
 }
 
@@ -327,7 +347,9 @@ String
 AvailableInterfaces::get_if_name(int iface)
 {
 	
+  _lock.acquire();
   LocalIfInfo ifinfo = *(_default_ifaces.findp(iface));
+  _lock.release();
   String iface_name = ifinfo._iface_name;
 	
 	return iface_name;
@@ -338,8 +360,10 @@ void
 AvailableInterfaces::set_available(int iface)
 {
   
+    _lock.acquire();
     LocalIfInfo *ifinfo = _default_ifaces.findp(iface);
     ifinfo->set_available();
+    _lock.release();
 	
 }
 
@@ -347,8 +371,10 @@ void
 AvailableInterfaces::set_unavailable(int iface)
 {
   
+	_lock.acquire();
 	LocalIfInfo *ifinfo = _default_ifaces.findp(iface);
     ifinfo->set_unavailable();
+	_lock.release();
 	
 }
 
@@ -357,6 +383,7 @@ AvailableInterfaces::clean_wtable(){
   
   WarnTable new_table;
   Timestamp now = Timestamp::now();
+  _lock.acquire();
   for(WIter iter = _wtable.begin(); iter.live(); iter++) {
     ChangingChannel cchannel = iter.value();
     Timestamp expire = cchannel._last_update + Timestamp::make_msec(10000);  
@@ -369,6 +396,7 @@ AvailableInterfaces::clean_wtable(){
     ChangingChannel cchannel = iter.value();
     _wtable.insert(iter.key(), cchannel);
   }
+  _lock.release();
   
   _timer.schedule_at(Timestamp::now() + Timestamp::make_msec(30000));
   
@@ -378,6 +406,7 @@ void
 AvailableInterfaces::set_remote_unavailable(EtherAddress eth, bool status, ChangingChannel cchannel)
 {
   
+  _lock.acquire();
   ChangingChannel *ccinfo = _wtable.findp(eth);
   
   if (status){
@@ -392,13 +421,10 @@ AvailableInterfaces::set_remote_unavailable(EtherAddress eth, bool status, Chang
       ccinfo->_last_update = Timestamp::now();
     }
     
-  } else {
-    if (!ccinfo){
-      return;
-    } else {
-      _wtable.remove(eth);
-    }
+  } else if (ccinfo) {
+    _wtable.remove(eth);
   }
+  _lock.release();
   
 }
 
@@ -406,9 +432,11 @@ void
 AvailableInterfaces::set_channel_change(int old_iface, int new_iface)
 {
   
+  _lock.acquire();
   LocalIfInfo *ifinfo = _default_ifaces.findp(old_iface);
   
   ifinfo->_switch_to=new_iface;
+  _lock.release();
   
 }
 
@@ -416,9 +444,11 @@ int
 AvailableInterfaces::check_channel_change(int iface)
 {
   
+  _lock.acquire();
   LocalIfInfo *ifinfo = _default_ifaces.findp(iface);
   
   int switch_to = ifinfo->_switch_to;
+  _lock.release();
   
   return switch_to;
   
@@ -428,6 +458,7 @@ void
 AvailableInterfaces::change_if(int old_iface, int new_iface)
 {
   
+  _lock.acquire();
   LocalIfInfo *ifinfo = _default_ifaces.findp(old_iface);
   
   LocalIfInfo li = LocalIfInfo();
@@ -442,6 +473,7 @@ AvailableInterfaces::change_if(int old_iface, int new_iface)
   
   _default_ifaces.remove(old_iface);
   _default_ifaces.insert(new_iface, li);
+  _lock.release();
 	
 }
 
@@ -451,12 +483,14 @@ AvailableInterfaces::get_local_rates(int iface)
 	LocalIfInfo ifinfo;
 	Vector<int> rates;
 	
+	_lock.acquire();
 	for (IIter it = _default_ifaces.begin(); it.live(); it++){
 		ifinfo = it.value();
 		if (ifinfo._iface==iface){
 			rates=ifinfo._rates;
 		}
 	}
+	_lock.release();
 	
 	return rates;
 }
@@ -467,10 +501,12 @@ AvailableInterfaces::get_if_list()
 	LocalIfInfo ifinfo;
 	
 	HashMap<EtherAddress,AvailableInterfaces::LocalIfInfo> if_list;
+	_lock.acquire();
 	for (IIter it = _default_ifaces.begin(); it.live(); it++){
 		ifinfo = it.value();
 		if_list.insert(ifinfo._eth,ifinfo);
 	}
+	_lock.release();
 	return if_list;
 }
 
@@ -486,6 +522,7 @@ AvailableInterfaces::insert(EtherPair epair, Vector<int> rates)
     }
     return -1;
   }
+  _lock.acquire();
   DstInfo *dst = _rtable.findp(epair);
   if (!dst) {
     _rtable.insert(epair, DstInfo(epair._eth_to));
@@ -508,10 +545,18 @@ AvailableInterfaces::insert(EtherPair epair, Vector<int> rates)
   } else {
     dst->_rates = rates;
   }
+  _lock.release();
   return 0;
 }
 
 
+void
+AvailableInterfaces::remove(EtherPair epair)
+{
+  _lock.acquire();
+  _rtable.erase(epair);
+  _lock.release();
+}
 
 
 
@@ -529,6 +574,7 @@ AvailableInterfaces_read_param(Element *e, void *thunk)
 	AvailableInterfaces::DstInfo dstinfo;
 	EtherPair ethp;
     StringAccum sa;
+    td->_lock.acquire();
     if (td->_rtable.size()) {
 			for (AvailableInterfaces::RIter it = td->_rtable.begin(); it.live(); it++){
 				ethp = it.key();
@@ -541,11 +587,13 @@ AvailableInterfaces_read_param(Element *e, void *thunk)
 			}
 
     }
+    td->_lock.release();
     return sa.take_string();
   }
   case H_INTERFACES: {
 	AvailableInterfaces::LocalIfInfo ifinfo;
     StringAccum sa;
+    td->_lock.acquire();
     if (td->_default_ifaces.size()) {
 			for (AvailableInterfaces::IIter it = td->_default_ifaces.begin(); it.live(); it++){
 				sa << "INTERFACE ";
@@ -558,6 +606,7 @@ AvailableInterfaces_read_param(Element *e, void *thunk)
 			}
       
     }
+    td->_lock.release();
     return sa.take_string();
   }
   default:
@@ -584,7 +633,7 @@ AvailableInterfaces_write_param(const String &in_s, Element *e, void *vparam,
     EtherPair e;
     if (!cp_ethernet_address(s, &e._eth_from) && !cp_ethernet_address(s, &e._eth_to))
       return errh->error("remove parameter must be ethernet pair");
-    f->_rtable.erase(e);
+    f->remove(e);
     break;
   }
 
@@ -611,4 +660,5 @@ AvailableInterfaces::add_handlers()
 
 CLICK_ENDDECLS
 EXPORT_ELEMENT(AvailableInterfaces)
+ELEMENT_MT_SAFE(AvailableInterfaces)
 
@@ -6,6 +6,7 @@
 #include <click/bighashmap.hh>
 #include <click/glue.hh>
 #include <click/timer.hh>
+#include <click/sync.hh>
 CLICK_DECLS
 
 /*
@@ -30,6 +31,12 @@ Removes an ethernet address from the database.
 =h rates read-only
 Shows the entries in the database.
 
+=n
+
+The tables are guarded by a Spinlock, so elements running on
+different threads, such as the SR2ETTStatMulti of each radio, can share
+one AvailableInterfaces.
+
 =a BeaconScanner
  */
 
@@ -119,6 +126,7 @@ class AvailableInterfaces : public Element { public:
   Vector<int> get_local_rates(int);
 
   int insert(EtherPair, Vector<int>);
+  void remove(EtherPair);
 
   EtherAddress _bcast;
   bool _debug;
@@ -201,6 +209,8 @@ class AvailableInterfaces : public Element { public:
   
   WarnTable _wtable;
 
+  Spinlock _lock;
+
 private:
 };
 
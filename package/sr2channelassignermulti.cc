@@ -29,6 +29,7 @@
 #include "sr2nodemulti.hh"
 #include "sr2channelassignermulti.hh"
 #include "sr2channelselectormulti.hh"
+#include "sr2conflictgraphmulti.hh"
 CLICK_DECLS
 
 SR2ChannelAssignerMulti::SR2ChannelAssignerMulti()
@@ -37,13 +38,29 @@ SR2ChannelAssignerMulti::SR2ChannelAssignerMulti()
      _link_table(0),
      _if_table(0),
      _arp_table(0),
-     _timer(this)
+     _timer(this),
+     _solve_timer(this),
+     _solver(0),
+     _rounds(0),
+     _algorithm(SR2ChannelSolverMulti::GREEDY),
+     _budget(50),
+     _threads(1),
+     _max_snapshots(4),
+     _next_snapshot(0),
+     _greedy_objective(0),
+     _objective(0),
+     _incremental(false),
+     _threshold(10),
+     _max_switches(0),
+     _total_switched(0),
+     _total_avoided(0)
 {
 
 }
 
 SR2ChannelAssignerMulti::~SR2ChannelAssignerMulti()
 {
+  delete _solver;
 }
 
 int
@@ -51,6 +68,7 @@ SR2ChannelAssignerMulti::configure (Vector<String> &conf, ErrorHandler *errh)
 {
   int ret;
 	_debug = false;
+  String algorithm = "greedy";
   ret = cp_va_kparse(conf, this, errh,
 		     "ETHTYPE", 0, cpUnsignedShort, &_et,
 		     "IP", 0, cpIPAddress, &_ip,
@@ -62,6 +80,13 @@ SR2ChannelAssignerMulti::configure (Vector<String> &conf, ErrorHandler *errh)
 		     "JITTER", 0, cpUnsigned, &_jitter,
          "VERSION", 0, cpInteger, &_version,
 		     "DEBUG", 0, cpBool, &_debug,
+		     "ALGORITHM", 0, cpWord, &algorithm,
+		     "BUDGET", 0, cpUnsigned, &_budget,
+		     "THREADS", 0, cpUnsigned, &_threads,
+		     "SNAPSHOTS", 0, cpUnsigned, &_max_snapshots,
+		     "INCREMENTAL", 0, cpBool, &_incremental,
+		     "THRESHOLD", 0, cpUnsigned, &_threshold,
+		     "MAX_SWITCHES", 0, cpUnsigned, &_max_switches,
 		     cpEnd);
 
   if (!_et) 
@@ -84,6 +109,18 @@ SR2ChannelAssignerMulti::configure (Vector<String> &conf, ErrorHandler *errh)
     return errh->error("ARPTable element is not an ARPtableMulti");
   if (_ch_sel && _ch_sel->cast("SR2ChannelSelectorMulti") == 0) 
     return errh->error("SR2ChannelSelectorMulti element is not a SR2ChannelSelectorMulti");
+  _algorithm = SR2ChannelSolverMulti::NALGORITHMS;
+  for (int a = 0; a < SR2ChannelSolverMulti::NALGORITHMS; a++) {
+    if (algorithm == SR2ChannelSolverMulti::algorithm_name(a)) {
+      _algorithm = a;
+    }
+  }
+  if (_algorithm == SR2ChannelSolverMulti::NALGORITHMS)
+    return errh->error("ALGORITHM must be one of greedy, tabu or annealing");
+  if (_threshold > 100)
+    return errh->error("THRESHOLD must be between 0 and 100");
+  if (_threads < 1)
+    return errh->error("THREADS must be at least 1");
 
   return ret;
 }
@@ -93,110 +130,417 @@ SR2ChannelAssignerMulti::initialize (ErrorHandler *)
 {
   _timer.initialize (this);
   _timer.schedule_now ();
+  _solve_timer.initialize (this);
 
   return 0;
 }
 
 void
-SR2ChannelAssignerMulti::run_timer (Timer *)
+SR2ChannelAssignerMulti::run_timer (Timer *t)
 {
-  start_assignment();
+  if (t == &_solve_timer) {
+    run_solver();
+    return;
+  }
+  // a round still searching keeps its tables until it is done
+  if (!_solver)
+    start_assignment();
   unsigned max_jitter = _period / 10;
   unsigned j = click_random(0, 2 * max_jitter);
   Timestamp delay = Timestamp::make_msec(_period + j - max_jitter);
   _timer.schedule_at(Timestamp::now() + delay);
 }
 
-static int
-delay_sorter(const void *va, const void *vb, void *) {
+/*
+ * Builds the conflict graph from the scan info table: one link per pair
+ * of radios that hear each other, carrying the channel load seen by 
+ * both ends.
+ */
+void
+SR2ChannelAssignerMulti::build_graph(const NTable &ntable, SR2ConflictGraphMulti &g)
+{
+	g.clear();
+	for(NIter iter = ntable.begin(); iter.live(); iter++){
+		const SR2ScanInfo &scinfo1 = iter.value();
+		NodeAddress node1 = iter.key();
+		for(HashMap<NodeAddress,int>::const_iterator iter_n = scinfo1._neighbors_table.begin(); iter_n.live(); iter_n++ ){
+			NodeAddress node2 = iter_n.key();
+			if (g.find_link(node1, node2) >= 0) {
+				continue;
+			}
+			const SR2ScanInfo *scinfo2 = ntable.findp(node2);
+			if (!scinfo2) {
+				continue;
+			}
+			// insert link
+			SR2ConflictGraphMulti::Link &link = g.add_link(node1, node2);
+			link._delay = iter_n.value();
+			link._hop_from = scinfo1._cas_hops;
+			link._hop_to = scinfo2->_cas_hops;
+			link._hop_count = ((link._hop_from*100)+(link._hop_to*100))/2;
+			for (HashMap<int,int>::const_iterator iter_c= scinfo1._channel_table.begin(); iter_c.live(); iter_c++) {
+				link.update_channel(iter_c.key(), iter_c.value());
+			}
+			for (HashMap<int,int>::const_iterator iter_c= scinfo2->_channel_table.begin(); iter_c.live(); iter_c++) {
+				link.update_channel(iter_c.key(), iter_c.value());
+			}
+		}
+	}
+	g.build_heap();
+}
 
-		NodeDelay *a = (NodeDelay *)va, *b = (NodeDelay *)vb;
+void
+SR2ChannelAssignerMulti::assign_channel(CHTable &chtable, NodeAddress node, int channel){
+	
+	if (channel == (node._iface % 256)) {
+		return;
+	}
+	int new_iface = (node._iface / 256) * 256 + channel;
+	int * val = chtable.findp(node);
+	
+	if (!val){
+		chtable.insert(node,new_iface);
+	} else {
+		*val = new_iface;
+	}
+	
+}
 
-		if (a->_delay == b->_delay){
-			return 0;
-		} else {
-			return (a->_delay < b->_delay) ? -1 : 1;
+/*
+ * Visits the links closest to the gateway first, ties broken by delay.
+ * Each visited link takes its least loaded channel other than the 
+ * default one, and so do its two radios and every radio they still 
+ * share a link with. All links of the two radios are then removed.
+ */
+void
+SR2ChannelAssignerMulti::assign_channels(SR2ConflictGraphMulti &g, CHTable &chtable, int default_channel)
+{
+	Vector<int> others;
+	Vector<int> marked(g.nodes(), -1);
+
+	for (int l = g.next_link(); l >= 0; l = g.next_link()) {
+		SR2ConflictGraphMulti::Link &link = g.link(l);
+
+		int channel = link.best_channel(default_channel);
+
+		assign_channel(chtable, link._from, channel);
+		assign_channel(chtable, link._to, channel);
+
+		others.clear();
+		g.remove_node_links(link._a, others);
+		g.remove_node_links(link._b, others);
+		for (int i = 0; i < others.size(); i++) {
+			int n = others[i];
+			if (n == link._a || n == link._b || marked[n] == l) {
+				continue;
+			}
+			marked[n] = l;
+			assign_channel(chtable, g.node(n), channel);
 		}
+	}
+}
+
+/*
+ * Scores the greedy assignment in chtable and, unless algorithm is
+ * greedy, replaces it with the result of budget msec of local search.
+ * Returns the final objective, the greedy one goes to *greedy.
+ */
+int64_t
+SR2ChannelAssignerMulti::refine_channels(SR2ConflictGraphMulti &g, CHTable &chtable, int default_channel,
+					 int algorithm, unsigned budget, int64_t *greedy)
+{
+	SR2ChannelSolverMulti solver(g, default_channel);
+	seed_solver(solver, g, chtable);
+	*greedy = solver.objective();
+	if (algorithm == SR2ChannelSolverMulti::GREEDY) {
+		return *greedy;
+	}
+
+	solver.run(algorithm, Timestamp::make_msec(budget), _threads);
+	take_channels(solver, g, chtable);
+	return solver.objective();
+}
 
+/* starts the solver from the channels in chtable */
+void
+SR2ChannelAssignerMulti::seed_solver(SR2ChannelSolverMulti &solver, const SR2ConflictGraphMulti &g, const CHTable &chtable)
+{
+	for (int n = 0; n < g.nodes(); n++) {
+		const int *iface = chtable.findp(g.node(n));
+		if (iface) {
+			solver.set_channel(n, *iface % 256);
+		}
+	}
 }
 
-Vector<NodeDelay>
-SR2ChannelAssignerMulti::smallest_hop_count()
+/* replaces chtable with the channels the solver found */
+void
+SR2ChannelAssignerMulti::take_channels(const SR2ChannelSolverMulti &solver, const SR2ConflictGraphMulti &g, CHTable &chtable)
 {
-	Vector<NodeDelay> nodelist;
-	uint32_t min_hop = ~0;
-	for (MCGIter iter = _mcgraph.begin(); iter.live(); iter++) {
-		NodePair nodep = iter.key();
-		MCGLeaf leaf = iter.value();
-		if (leaf._hop_count <= min_hop){
-			if (leaf._hop_count < min_hop) {
-				nodelist.clear();
-				min_hop = leaf._hop_count;
+	const Vector<uint32_t> &channels = solver.channels();
+	for (int n = 0; n < g.nodes(); n++) {
+		NodeAddress node = g.node(n);
+		if (channels[n] == (uint32_t) (node._iface % 256)) {
+			chtable.remove(node);
+		} else {
+			assign_channel(chtable, node, channels[n]);
+		}
+	}
+}
+
+/*
+ * Marks the radios that can reach one of ours, over links whose two
+ * radios share a channel and between radios of the same node.
+ */
+void
+SR2ChannelAssignerMulti::reachable(const SR2ConflictGraphMulti &g, const Vector<uint32_t> &channels, Vector<int> &reach)
+{
+	HashMap<IPAddress, int> ids;
+	Vector< Vector<int> > radios;
+	for (int n = 0; n < g.nodes(); n++) {
+		IPAddress ip = g.node(n)._ipaddr;
+		int *id = ids.findp(ip);
+		if (!id) {
+			ids.insert(ip, radios.size());
+			radios.push_back(Vector<int>());
+			id = ids.findp(ip);
+		}
+		radios[*id].push_back(n);
+	}
+
+	reach.clear();
+	reach.resize(g.nodes(), 0);
+	Vector<int> queue;
+	int *mine = ids.findp(_ip);
+	if (!mine) {
+		return;
+	}
+	for (int i = 0; i < radios[*mine].size(); i++) {
+		reach[radios[*mine][i]] = 1;
+		queue.push_back(radios[*mine][i]);
+	}
+	for (int q = 0; q < queue.size(); q++) {
+		int n = queue[q];
+		const Vector<int> &same = radios[*ids.findp(g.node(n)._ipaddr)];
+		for (int i = 0; i < same.size(); i++) {
+			if (!reach[same[i]]) {
+				reach[same[i]] = 1;
+				queue.push_back(same[i]);
+			}
+		}
+		const Vector<int> &inc = g.incident(n);
+		for (int x = 0; x < inc.size(); x++) {
+			const SR2ConflictGraphMulti::Link &link = g.link(inc[x]);
+			int m = (link._a == n) ? link._b : link._a;
+			if (!reach[m] && channels[link._a] == channels[link._b]) {
+				reach[m] = 1;
+				queue.push_back(m);
 			}
-			nodelist.push_back(NodeDelay(nodep,leaf._delay));
 		}
 	}
-	return nodelist;
 }
 
-Vector<NodeAddress>
-SR2ChannelAssignerMulti::remove_neighbor_link(NodeAddress node)
+/*
+ * Incremental mode: trims chtable down to the changes worth making.
+ */
+void
+SR2ChannelAssignerMulti::select_changes(SR2ConflictGraphMulti &g, CHTable &chtable, int default_channel)
 {
-	
-	Vector<NodePair> remove_link;
-	Vector<NodeAddress> change_channel;
-	
-	for (MCGIter iter = _mcgraph.begin(); iter.live(); iter++) {
-		NodePair nodep = iter.key();
-		MCGLeaf leaf = iter.value();
-		if (nodep._from == node){
-			remove_link.push_back(nodep);
-			change_channel.push_back(nodep._to);
+	SR2ChannelSolverMulti solver(g, default_channel);
+	_incr = IncrementalStats();
+	_incr._before = solver.objective();
+
+	// Radios to retune, one group per link that changes channel
+	const Vector<uint32_t> &current = solver.channels();
+	Vector<uint32_t> target(g.nodes(), 0);
+	for (int n = 0; n < g.nodes(); n++) {
+		const int *iface = chtable.findp(g.node(n));
+		target[n] = iface ? *iface % 256 : current[n];
+	}
+	Vector< Vector<int> > groups;
+	Vector<int> linked(g.nodes(), 0);
+	for (int l = 0; l < g.links(); l++) {
+		const SR2ConflictGraphMulti::Link &link = g.link(l);
+		if (!link._live) {
+			continue;
+		}
+		Vector<int> members;
+		if (target[link._a] != current[link._a]) {
+			members.push_back(link._a);
+		}
+		if (target[link._b] != current[link._b]) {
+			members.push_back(link._b);
+		}
+		if (members.size()) {
+			linked[link._a] = linked[link._b] = 1;
+			groups.push_back(members);
+		}
+	}
+	// reason a radio was turned down, radios on no link go alone
+	enum { WANTED = 1, SWITCHED, OVER_LIMIT, WOULD_CUT };
+	Vector<int> state(g.nodes(), 0);
+	for (int n = 0; n < g.nodes(); n++) {
+		if (target[n] != current[n]) {
+			state[n] = WANTED;
+			_incr._wanted++;
+			if (!linked[n]) {
+				groups.push_back(Vector<int>(1, n));
+			}
+		}
+	}
+
+	Vector<int> reach;
+	reachable(g, current, reach);
+
+	Vector<int> done(groups.size(), 0);
+	Vector<int> members;
+	Vector<uint32_t> channels;
+	for (;;) {
+		int best = -1;
+		int64_t best_delta = 0;
+		for (int x = 0; x < groups.size(); x++) {
+			if (done[x]) {
+				continue;
+			}
+			// radios already switched through another link drop out
+			members.clear();
+			channels.clear();
+			for (int i = 0; i < groups[x].size(); i++) {
+				int n = groups[x][i];
+				if (current[n] != target[n]) {
+					members.push_back(n);
+					channels.push_back(target[n]);
+				}
+			}
+			if (!members.size()) {
+				done[x] = 1;
+				continue;
+			}
+			int64_t before;
+			int64_t delta = solver.group_delta(members, channels, &before);
+			if (delta >= 0 || -delta * 100 < (int64_t) _threshold * before) {
+				continue;
+			}
+			if (best < 0 || delta < best_delta) {
+				best = x;
+				best_delta = delta;
+			}
+		}
+		if (best < 0) {
+			break;
+		}
+		done[best] = 1;
+
+		members.clear();
+		for (int i = 0; i < groups[best].size(); i++) {
+			int n = groups[best][i];
+			if (current[n] != target[n]) {
+				members.push_back(n);
+			}
+		}
+		if (_max_switches && _incr._switched + members.size() > _max_switches) {
+			for (int i = 0; i < members.size(); i++) {
+				state[members[i]] = OVER_LIMIT;
+			}
+			continue;
+		}
+		Vector<uint32_t> old;
+		for (int i = 0; i < members.size(); i++) {
+			old.push_back(current[members[i]]);
+			solver.set_channel(members[i], target[members[i]]);
+		}
+		Vector<int> after;
+		reachable(g, current, after);
+		bool cut = false;
+		for (int n = 0; n < g.nodes() && !cut; n++) {
+			cut = (reach[n] && !after[n]);
+		}
+		if (cut) {
+			for (int i = 0; i < members.size(); i++) {
+				solver.set_channel(members[i], old[i]);
+				state[members[i]] = WOULD_CUT;
+			}
+			continue;
 		}
-		if (nodep._to == node){
-			remove_link.push_back(nodep);
-			change_channel.push_back(nodep._from);
+		_incr._switched += members.size();
+		_incr._delta += best_delta;
+		for (int i = 0; i < members.size(); i++) {
+			state[members[i]] = SWITCHED;
 		}
 	}
 
-	for (int i=0; i< remove_link.size(); i++){
-		NodePair nodep = remove_link[i];
-		_mcgraph.erase(nodep);
+	Vector<int> accepted;
+	for (int n = 0; n < g.nodes(); n++) {
+		if (state[n] == SWITCHED) {
+			accepted.push_back(n);
+		} else if (state[n] == OVER_LIMIT) {
+			_incr._over_limit++;
+		} else if (state[n] == WOULD_CUT) {
+			_incr._would_cut++;
+		} else if (state[n] == WANTED) {
+			_incr._below_threshold++;
+		}
 	}
 
-	return change_channel;
+	chtable.clear();
+	for (int i = 0; i < accepted.size(); i++) {
+		assign_channel(chtable, g.node(accepted[i]), target[accepted[i]]);
+	}
+	_total_switched += _incr._switched;
+	_total_avoided += _incr._wanted - _incr._switched;
+}
 
+static int
+pending_switch_sorter(const void *va, const void *vb, void *)
+{
+	typedef SR2ChannelAssignerMulti::PendingSwitch PendingSwitch;
+	const PendingSwitch *a = (const PendingSwitch *) va;
+	const PendingSwitch *b = (const PendingSwitch *) vb;
+	return b->_hops - a->_hops;
 }
 
+/*
+ * Sends the assignments farthest from us first, so that no radio is
+ * retuned while the ones behind it still wait for their assignment.
+ */
 void
-SR2ChannelAssignerMulti::assign_channel(NodeAddress node, int new_iface){
-	
-	int * val = _chtable.findp(node);
-	
-	if (!val){
-		_chtable.insert(node,new_iface);
-	} else {
-		*val = new_iface;
+SR2ChannelAssignerMulti::send_assignments(const NTable &ntable, const CHTable &chtable)
+{
+	Vector<PendingSwitch> pending;
+	for (CHIter iter = chtable.begin(); iter.live(); iter++){
+		PendingSwitch ps;
+		const SR2ScanInfo *scinfo = ntable.findp(iter.key());
+		ps._hops = scinfo ? scinfo->_cas_hops : 0;
+		ps._ch_ass = SR2ChannelAssignment(iter.key(),iter.value());
+		pending.push_back(ps);
+	}
+	if (pending.size()) {
+		click_qsort(pending.begin(), pending.size(), sizeof(PendingSwitch), pending_switch_sorter, 0);
 	}
-	
-}
 
-Vector<NodeDelay>
-SR2ChannelAssignerMulti::get_link_from_node(NodeAddress node){
-	
-	Vector<NodeDelay> links;
-	
-	for (MCGIter iter = _mcgraph.begin(); iter.live(); iter++){
-		NodePair nodep = iter.key();
-		MCGLeaf leaf = iter.value();
-		if ((nodep._from == node) || (nodep._to == node)){
-			NodeDelay noded = NodeDelay(nodep,leaf._delay);
-			links.push_back(noded);
+	/* one batch per node, in the order of its first radio */
+	HashMap<IPAddress, int> batch_ids;
+	Vector< Vector<SR2ChannelAssignment> > batches;
+	for (int x = 0; x < pending.size(); x++){
+		IPAddress ip = pending[x]._ch_ass._node._ipaddr;
+		int *id = batch_ids.findp(ip);
+		if (!id) {
+			batch_ids.insert(ip, batches.size());
+			batches.push_back(Vector<SR2ChannelAssignment>());
+			id = batch_ids.findp(ip);
+		}
+		batches[*id].push_back(pending[x]._ch_ass);
+	}
+
+	for (int x = 0; x < batches.size(); x++){
+		if (batches[x][0]._node._ipaddr == _ip){
+			for (int y = 0; y < batches[x].size(); y++){
+				_ch_sel->switch_channel(false, batches[x][y]);
+			}
+		} else {
+			send (batches[x]);
 		}
 	}
-	
-	return links;
-	
 }
 
 void
@@ -211,221 +555,225 @@ SR2ChannelAssignerMulti::start_assignment()
 	}
 	
 	// Copying ScanInfo  Table into a temporary table to work on
-	NTable ntable_temp;
-	ntable_temp.clear();
+	_round_ntable.clear();
 	
 	_busy = true;
 	
 	for(NIter iter = _ntable.begin(); iter.live(); iter++){
-		ntable_temp.insert(iter.key(),iter.value());
+		_round_ntable.insert(iter.key(),iter.value());
 	}
+	_ntable.clear();
 	
-	// Clean MCG and channel assignment tables
-	_mcgraph.clear();
+	// Clean channel assignment table
 	_chtable.clear();
 	
 	// Creating MCG
-	for(NIter iter = ntable_temp.begin(); iter.live(); iter++){
-		SR2ScanInfo scinfo1 = iter.value();
-		for(HashMap<NodeAddress,int>::const_iterator iter_n = scinfo1._neighbors_table.begin(); iter_n.live(); iter_n++ ){
-			NodeAddress node1 = iter.key();
-			NodeAddress node2 = iter_n.key();
-			NodePair nodep1 = NodePair(node1,node2);
-			NodePair nodep2 = NodePair(node2,node1);
-			MCGLeaf * leafnfo1 = _mcgraph.findp(nodep1);
-			MCGLeaf * leafnfo2 = _mcgraph.findp(nodep2);
-			if ((!leafnfo1) && (!leafnfo2)){
-				SR2ScanInfo * scinfo2 = ntable_temp.findp(iter_n.key());
-				if (scinfo2){
-					// insert link
-					MCGLeaf leaf;
-					leaf._nodep = nodep1;
-					leaf._delay = iter_n.value();
-					leaf._hop_from = scinfo1._cas_hops;
-					leaf._hop_to = scinfo2->_cas_hops;
-					leaf._hop_count = ((leaf._hop_from*100)+(leaf._hop_to*100))/2;
-					for (HashMap<int,int>::const_iterator iter_c= scinfo1._channel_table.begin(); iter_c.live(); iter_c++) {
-						int channel = iter_c.key();
-						int traffic = iter_c.value();
-						leaf.update_channel(channel, traffic);
-					}
-					for (HashMap<int,int>::const_iterator iter_c= scinfo2->_channel_table.begin(); iter_c.live(); iter_c++) {
-						int channel = iter_c.key();
-						int traffic = iter_c.value();
-						leaf.update_channel(channel, traffic);
-					}
-					for (HashMap<NodeAddress,int>::const_iterator iter_i= scinfo1._neighbors_table.begin(); iter_i.live(); iter_i++) {
-						NodeAddress interfering_node = iter_i.key();
-						int interfering_node_metric = iter_i.value();
-						leaf.update_interfering(NodePair(node1,interfering_node),interfering_node_metric);
-					}
-					for (HashMap<NodeAddress,int>::const_iterator iter_i= scinfo2->_neighbors_table.begin(); iter_i.live(); iter_i++) {
-						NodeAddress interfering_node = iter_i.key();
-						int interfering_node_metric = iter_i.value();
-						leaf.update_interfering(NodePair(node2,interfering_node),interfering_node_metric);
-					}		
-					
-					_mcgraph.insert(nodep1,leaf);
-				}
-
-			}
-		}
-	}
+	Timestamp start = Timestamp::now();
+	build_graph(_round_ntable, _mcgraph);
 
 	_busy = false;
 	
 	// Running through the graph
-	
-	while (_mcgraph.size() != 0) {
-		
-		// Find the nodes with the smallest hop
-		Vector<NodeDelay> smallest_hop = smallest_hop_count();
-		
-		for (int i=0; i<smallest_hop.size(); i++){
-			NodeDelay noded = smallest_hop[i];
-		}
-		
-		// Sort this list by increasing delay values
-		click_qsort(smallest_hop.begin(), smallest_hop.size(), sizeof(NodeDelay), delay_sorter);
-		
-		for (int i=0; i<smallest_hop.size(); i++){
-			NodeDelay noded = smallest_hop[i];
-		}
-		
-		// Visiting each vertex in smallest_hop
-		while (smallest_hop.size() != 0){
-	
-			NodeDelay noded = smallest_hop[0];
-			smallest_hop.pop_front();
-			MCGLeaf *leaf = _mcgraph.findp(noded._nodep);
-
-			if (leaf) {
-			
-				int default_channel = (_if_table->lookup_def_id()) % 256;
-				int channel = leaf->best_channel();
-			
-				while (channel == default_channel){
-					channel = leaf->best_channel();
-					if (leaf->_channels.size() == 0){
-						channel = 1;
-						break;
-					}
-				}
-			
-				NodeAddress node_a = leaf->_nodep._from;
-				NodeAddress node_b = leaf->_nodep._to;
-			
-				HashMap<NodeAddress,int> neighbor_radios;
-			
-				if (channel != (node_a._iface % 256)){
-					int if_id_a = (node_a._iface / 256);
-					int new_if_a = if_id_a * 256 + channel;
-					assign_channel(node_a,new_if_a);
-				}
-
-				Vector<NodeAddress> n_radios_a =  remove_neighbor_link(node_a);
-				for (int j=0; j < n_radios_a.size(); j++){
-					NodeAddress node = n_radios_a[j];
-					int* nfo = neighbor_radios.findp(node);
-					if ((!nfo) && (node != node_a) && (node != node_b)) {
-						neighbor_radios.insert(node,0);
-					}
-				}
+	_round_built = Timestamp::now();
+	_round_channel = (_if_table->lookup_def_id()) % 256;
+	assign_channels(_mcgraph, _chtable, _round_channel);
+
+	_rounds++;
+	_last_build = _round_built - start;
+
+	_solver = new SR2ChannelSolverMulti(_mcgraph, _round_channel);
+	seed_solver(*_solver, _mcgraph, _chtable);
+	_greedy_objective = _solver->objective();
+	if (_algorithm == SR2ChannelSolverMulti::GREEDY) {
+		finish_assignment();
+		return;
+	}
+	_solver->start(_algorithm, _threads);
+	_solve_left = Timestamp::make_msec(_budget);
+	_solve_timer.schedule_now();
+}
 
-				if (channel != (node_b._iface % 256)){
-					int if_id_b = (node_b._iface / 256);
-					int new_if_b = if_id_b * 256 + channel;
-					assign_channel(node_b,new_if_b);
-				}
+/*
+ * Searches for one slice of the round's budget, then lets the router
+ * run until the next slice.
+ */
+void
+SR2ChannelAssignerMulti::run_solver()
+{
+	Timestamp slice = Timestamp::make_msec(SLICE);
+	if (_solve_left < slice) {
+		slice = _solve_left;
+	}
+	Timestamp start = Timestamp::now();
+	_solver->step(slice);
+	_solve_left -= Timestamp::now() - start;
+	if (_solve_left > Timestamp()) {
+		_solve_timer.schedule_now();
+		return;
+	}
+	_solver->finish();
+	take_channels(*_solver, _mcgraph, _chtable);
+	finish_assignment();
+}
 
-				Vector<NodeAddress> n_radios_b = remove_neighbor_link(node_b);
-				for (int j=0; j < n_radios_b.size(); j++){
-					NodeAddress node = n_radios_b[j];
-					int* nfo = neighbor_radios.findp(node);
-					if ((!nfo) && (node != node_a) && (node != node_b)){
-						neighbor_radios.insert(node,0);
-					}
-				}
-			
-				for (HashMap<NodeAddress,int>::const_iterator iter = neighbor_radios.begin(); iter.live(); iter++){
-					NodeAddress node_n = iter.key();
-					if (channel != (node_n._iface % 256)){
-						int if_id_n = (node_n._iface / 256);
-						int new_if_n = if_id_n * 256 + channel;
-						assign_channel(node_n,new_if_n);
-					}
-				}
-			
-				neighbor_radios.clear();
-			
-				// Finding farthest side of the link from router
-			
-				NodeAddress farthest = NodeAddress();
-				if (leaf->_hop_from > leaf->_hop_to){
-					farthest = leaf->_nodep._from;
-				} else {
-					farthest = leaf->_nodep._to;
-				}
-			
-				// Creating tail
-				Vector<NodeDelay> tail = get_link_from_node(farthest);
-			
-				for (int i=0; i<tail.size(); i++){
-					NodeDelay noded = tail[i];
-				}
-			
-				// Sort this list by increasing delay values
-				click_qsort(tail.begin(), tail.size(), sizeof(NodeDelay), delay_sorter);
-			
-				for (int i=0; i<tail.size(); i++){
-					NodeDelay noded = tail[i];
-				}
-			
-				// Put tail into smallest_hop
-				for (int i=0; i< tail.size(); i++) {
-					NodeDelay noded = tail[i];
-					bool found = false;
-					for (int j=0; j< smallest_hop.size(); j++) {
-						found = true;
-					}
-					if (!found) {
-						smallest_hop.push_back(noded);
-					}
-				}
-			
-				tail.clear();
+void
+SR2ChannelAssignerMulti::finish_assignment()
+{
+	_objective = _solver->objective();
+	delete _solver;
+	_solver = 0;
+	if (_incremental) {
+		select_changes(_mcgraph, _chtable, _round_channel);
+	}
+	_last_assign = Timestamp::now() - _round_built;
 
-			}
-						
+	if (_max_snapshots > 0) {
+		if (_snapshots.size() < (int) _max_snapshots) {
+			_snapshots.push_back(_round_ntable);
+		} else {
+			_snapshots[_next_snapshot % _snapshots.size()] = _round_ntable;
 		}
-		
-		smallest_hop.clear();
-		
+		_next_snapshot = (_next_snapshot + 1) % _max_snapshots;
 	}
 
-	ntable_temp.clear();
+	send_assignments(_round_ntable, _chtable);
 
-  SR2ChannelAssignment ch_ass;
+	_round_ntable.clear();
+	_chtable.clear();
+  
+}
 
-	for (CHIter iter = _chtable.begin(); iter.live(); iter++){
-		SR2ChannelAssignment ch_ass = SR2ChannelAssignment(iter.key(),iter.value());
-		if (ch_ass._node._ipaddr == _ip){
-			_ch_sel->switch_channel(false, ch_ass);
-		} else {
-			send (ch_ass);
+/*
+ * Times one assignment round on a random mesh of about links links 
+ * among links / 3 radios, without touching the real tables.
+ */
+void
+SR2ChannelAssignerMulti::bench_assignment(int links)
+{
+	NTable ntable;
+	int nnodes = links / 3 + 2;
+	Vector<NodeAddress> nodes;
+	for (int i = 0; i < nnodes; i++) {
+		NodeAddress node = NodeAddress(IPAddress(htonl(0x0a000001 + i)), 256 + click_random(1, 11));
+		SR2ScanInfo scinfo;
+		scinfo._node = node;
+		scinfo._cas_hops = click_random(0, 5);
+		for (int c = 1; c <= 11; c++) {
+			scinfo._channel_table.insert(c, click_random(0, 1000));
 		}
+		nodes.push_back(node);
+		ntable.insert(node, scinfo);
+	}
+	int max_links = nnodes * (nnodes - 1) / 2;
+	if (links > max_links) {
+		links = max_links;
+	}
+	HashMap<NodePair, int> pairs;
+	while (pairs.size() < links) {
+		int a = click_random(0, nnodes - 1);
+		int b = click_random(0, nnodes - 1);
+		if (a == b || pairs.findp(NodePair(nodes[a], nodes[b])) || pairs.findp(NodePair(nodes[b], nodes[a]))) {
+			continue;
+		}
+		pairs.insert(NodePair(nodes[a], nodes[b]), 1);
+		ntable.findp(nodes[a])->_neighbors_table.insert(nodes[b], click_random(1, 1000));
 	}
 
-	_chtable.clear();
-	_ntable.clear();
-  
+	SR2ConflictGraphMulti g;
+	CHTable chtable;
+	Timestamp start = Timestamp::now();
+	build_graph(ntable, g);
+	Timestamp built = Timestamp::now();
+	assign_channels(g, chtable, 0);
+	Timestamp done = Timestamp::now();
+
+	BenchResult r;
+	r._links = g.links();
+	r._nodes = g.nodes();
+	r._assigned = chtable.size();
+	r._build = built - start;
+	r._assign = done - built;
+	_bench.push_back(r);
+}
+
+String
+SR2ChannelAssignerMulti::print_bench()
+{
+	StringAccum sa;
+	for (int x = 0; x < _bench.size(); x++) {
+		const BenchResult &r = _bench[x];
+		sa << "links " << r._links;
+		sa << " radios " << r._nodes;
+		sa << " assigned " << r._assigned;
+		sa << " build " << r._build;
+		sa << " assign " << r._assign << "\n";
+	}
+	return sa.take_string();
+}
+
+String
+SR2ChannelAssignerMulti::print_assign_stats()
+{
+	StringAccum sa;
+	sa << "rounds " << _rounds;
+	sa << " links " << _mcgraph.links();
+	sa << " radios " << _mcgraph.nodes();
+	sa << " build " << _last_build;
+	sa << " assign " << _last_assign;
+	sa << " algorithm " << SR2ChannelSolverMulti::algorithm_name(_algorithm);
+	sa << " greedy_objective " << _greedy_objective;
+	sa << " objective " << _objective << "\n";
+	if (_incremental) {
+		sa << "incremental wanted " << _incr._wanted;
+		sa << " switched " << _incr._switched;
+		sa << " avoided " << (_incr._wanted - _incr._switched);
+		sa << " below_threshold " << _incr._below_threshold;
+		sa << " over_limit " << _incr._over_limit;
+		sa << " would_cut " << _incr._would_cut;
+		sa << " objective_before " << _incr._before;
+		sa << " delta " << _incr._delta;
+		sa << " total_switched " << _total_switched;
+		sa << " total_avoided " << _total_avoided << "\n";
+	}
+	return sa.take_string();
+}
+
+/*
+ * Runs every algorithm on each kept scan table snapshot, oldest first,
+ * for the compare handler to read. This takes up to twice budget msec
+ * per snapshot, so it runs from the write handler only.
+ */
+void
+SR2ChannelAssignerMulti::run_compare(unsigned budget)
+{
+	StringAccum sa;
+	int default_channel = (_if_table->lookup_def_id()) % 256;
+	int n = _snapshots.size();
+	for (int x = 0; x < n; x++) {
+		const NTable &ntable = _snapshots[(_next_snapshot + x) % n];
+		SR2ConflictGraphMulti g;
+		CHTable greedy;
+		build_graph(ntable, g);
+		assign_channels(g, greedy, default_channel);
+		sa << "snapshot " << x;
+		sa << " links " << g.links();
+		sa << " radios " << g.nodes();
+		for (int a = 0; a < SR2ChannelSolverMulti::NALGORITHMS; a++) {
+			CHTable chtable = greedy;
+			int64_t greedy_objective;
+			int64_t objective = refine_channels(g, chtable, default_channel, a, budget, &greedy_objective);
+			sa << " " << SR2ChannelSolverMulti::algorithm_name(a) << " " << objective;
+		}
+		sa << "\n";
+	}
+	_compare = sa.take_string();
 }
 
 void
-SR2ChannelAssignerMulti::send(SR2ChannelAssignment ch_ass)
+SR2ChannelAssignerMulti::send(const Vector<SR2ChannelAssignment> &batch)
 {
   
-  IPAddress dest_ip = ch_ass._node._ipaddr;
+  IPAddress dest_ip = batch[0]._node._ipaddr;
   
 	SR2PathMulti best = _link_table->best_route(dest_ip, true);
 
@@ -433,14 +781,16 @@ SR2ChannelAssignerMulti::send(SR2ChannelAssignment ch_ass)
 		int links = best.size() - 1;
 		int len = sr2packetmulti::len_wo_data(links);
 		if (_debug){
-			click_chatter("%{element} :: Sending Channel Assignment: %s-%d >> %d\n",
-						this,
-						ch_ass._node._ipaddr.unparse().c_str(),
-						ch_ass._node._iface,
-						ch_ass._new_iface);
+			for (int x = 0; x < batch.size(); x++){
+				click_chatter("%{element} :: Sending Channel Assignment: %s-%d >> %d\n",
+							this,
+							batch[x]._node._ipaddr.unparse().c_str(),
+							batch[x]._node._iface,
+							batch[x]._new_iface);
+			}
 		}
     
-    int data_len = sizeof (ch_ass);
+    int data_len = batch.size() * sizeof(SR2ChannelAssignment);
     
 		WritablePacket *p = Packet::make(len + data_len + sizeof(click_ether));
 		if(p == 0)
@@ -460,13 +810,13 @@ SR2ChannelAssignerMulti::send(SR2ChannelAssignment ch_ass)
 			return;
 		}
 		
-    memcpy(p->data()+len+sizeof(click_ether), &ch_ass, data_len);
+    memcpy(p->data()+len+sizeof(click_ether), batch.begin(), data_len);
 		
 		pk->_version = _sr2_version;
 		pk->_type = SR2_PT_CHASSIGN;
 		pk->unset_flag(~0);
 		pk->set_data_len(data_len);
-		pk->set_seq(0);
+		pk->set_seq(_ch_sel->next_seq());
 		pk->set_num_links(links);
 		pk->set_next(next);
 		pk->set_qdst(_ip);
@@ -492,7 +842,7 @@ SR2ChannelAssignerMulti::send(SR2ChannelAssignment ch_ass)
 		memcpy(eh->ether_shost, my_eth.data(), 6);
 		memcpy(eh->ether_dhost, eth_dest.data(), 6);
 
-		output(0).push(p);
+		_ch_sel->send_hop(p);
 	}
 }
 
@@ -648,53 +998,19 @@ SR2ChannelAssignerMulti::push(int, Packet *p_in)
 	return;
 
 }
-/*
-String
-SR2ChannelAssignerMulti::print_cas_stats()
-{
-    StringAccum sa;
-    Timestamp now = Timestamp::now();
-    for(CASIter iter = _castable.begin(); iter.live(); iter++) {
-      CASInfo nfo = iter.value();
-      sa << nfo._ip.unparse().c_str() << " ";
-      sa << "seen " << nfo._seen << " ";
-      sa << "first_update " << now - nfo._first_update << " ";
-      sa << "last_update " << now - nfo._last_update << " ";
-      
-      SR2PathMulti p = _link_table->best_route(nfo._ip, false);
-      int metric = _link_table->get_route_metric(p);
-      sa << "current_metric " << metric << "\n";
-    }
-    
-  return sa.take_string();
-}
-enum { H_IS_CAS, H_CAS_STATS, H_ALLOW, H_ALLOW_ADD, H_ALLOW_DEL, H_ALLOW_CLEAR, H_IGNORE, H_IGNORE_ADD, H_IGNORE_DEL, H_IGNORE_CLEAR};
+enum { H_BENCH, H_ASSIGN_STATS, H_COMPARE };
 
 String
 SR2ChannelAssignerMulti::read_handler(Element *e, void *thunk)
 {
   SR2ChannelAssignerMulti *f = (SR2ChannelAssignerMulti *)e;
   switch ((uintptr_t) thunk) {
-  case H_IS_CAS:
-    return String(f->_is_cas) + "\n";
-  case H_CAS_STATS:
-    return f->print_cas_stats();
-  case H_IGNORE: {
-    StringAccum sa;
-    for (IPIter iter = f->_ignore.begin(); iter.live(); iter++) {
-      IPAddress ip = iter.key();
-      sa << ip << "\n";
-    }
-    return sa.take_string();    
-  }
-  case H_ALLOW: {
-    StringAccum sa;
-    for (IPIter iter = f->_allow.begin(); iter.live(); iter++) {
-      IPAddress ip = iter.key();
-      sa << ip << "\n";
-    }
-    return sa.take_string();    
-  }
+  case H_BENCH:
+    return f->print_bench();
+  case H_ASSIGN_STATS:
+    return f->print_assign_stats();
+  case H_COMPARE:
+    return f->_compare;
   default:
     return String();
   }
@@ -707,51 +1023,30 @@ SR2ChannelAssignerMulti::write_handler(const String &in_s, Element *e, void *vpa
   SR2ChannelAssignerMulti *f = (SR2ChannelAssignerMulti *)e;
   String s = cp_uncomment(in_s);
   switch((intptr_t)vparam) {
-    case H_IS_CAS: {  
-      bool b;
-      if (!cp_bool(s, &b)) 
-        return errh->error("is_cas parameter must be boolean");
-      f->_is_cas = b;
-      break;
-    }
-    case H_IGNORE_ADD: {  
-      IPAddress ip;
-      if (!cp_ip_address(s, &ip)) {
-        return errh->error("ignore_add parameter must be IPAddress");
-      }
-      f->_ignore.insert(ip, ip);
-      break;
-    }
-    case H_IGNORE_DEL: {  
-      IPAddress ip;
-      if (!cp_ip_address(s, &ip)) {
-        return errh->error("ignore_add parameter must be IPAddress");
-      }
-      f->_ignore.remove(ip);
-      break;
-    }
-    case H_IGNORE_CLEAR: {  
-      f->_ignore.clear();
-      break;
-    }
-    case H_ALLOW_ADD: {  
-      IPAddress ip;
-      if (!cp_ip_address(s, &ip)) {
-        return errh->error("ignore_add parameter must be IPAddress");
+    case H_BENCH: {
+      Vector<String> args;
+      cp_spacevec(s, args);
+      if (!args.size()) {
+	args.push_back("100");
+	args.push_back("500");
+	args.push_back("2000");
       }
-      f->_allow.insert(ip, ip);
-      break;
-    }
-    case H_ALLOW_DEL: {  
-      IPAddress ip;
-      if (!cp_ip_address(s, &ip)) {
-        return errh->error("ignore_add parameter must be IPAddress");
+      f->_bench.clear();
+      for (int x = 0; x < args.size(); x++) {
+	int links;
+	if (!cp_integer(args[x], &links) || links < 1) 
+	  return errh->error("bench parameter must be a list of link counts");
+	f->bench_assignment(links);
       }
-      f->_allow.remove(ip);
       break;
     }
-    case H_ALLOW_CLEAR: {  
-      f->_allow.clear();
+    case H_COMPARE: {
+      unsigned budget = f->_budget;
+      if (s && !cp_unsigned(s, &budget))
+	return errh->error("compare parameter must be a budget in msec");
+      if (budget > 1000)
+	return errh->error("compare budget must be at most 1000 msec");
+      f->run_compare(budget);
       break;
     }
   }
@@ -761,20 +1056,14 @@ SR2ChannelAssignerMulti::write_handler(const String &in_s, Element *e, void *vpa
 void
 SR2ChannelAssignerMulti::add_handlers()
 {
-  add_read_handler("is_cas", read_handler, (void *) H_IS_CAS);
-  add_read_handler("cas_stats", read_handler, (void *) H_CAS_STATS);
-  add_read_handler("ignore", read_handler, (void *) H_IGNORE);
-  add_read_handler("allow", read_handler, (void *) H_ALLOW);
-
-  add_write_handler("is_cas", write_handler, (void *) H_IS_CAS);
-  add_write_handler("ignore_add", write_handler, (void *) H_IGNORE_ADD);
-  add_write_handler("ignore_del", write_handler, (void *) H_IGNORE_DEL);
-  add_write_handler("ignore_clear", write_handler, (void *) H_IGNORE_CLEAR);
-  add_write_handler("allow_add", write_handler, (void *) H_ALLOW_ADD);
-  add_write_handler("allow_del", write_handler, (void *) H_ALLOW_DEL);
-  add_write_handler("allow_clear", write_handler, (void *) H_ALLOW_CLEAR);
+  add_read_handler("bench", read_handler, (void *) H_BENCH);
+  add_read_handler("assign_stats", read_handler, (void *) H_ASSIGN_STATS);
+  add_read_handler("compare", read_handler, (void *) H_COMPARE);
+
+  add_write_handler("bench", write_handler, (void *) H_BENCH);
+  add_write_handler("compare", write_handler, (void *) H_COMPARE);
 }
-*/
+
 CLICK_ENDDECLS
 ELEMENT_REQUIRES(SR2LinkTableMulti)
 EXPORT_ELEMENT(SR2ChannelAssignerMulti)
@@ -10,23 +10,16 @@
 #include <click/dequeue.hh>
 #include <elements/wifi/path.hh>
 #include "sr2channelselectormulti.hh"
+#include "sr2conflictgraphmulti.hh"
+#include "sr2channelsolvermulti.hh"
 CLICK_DECLS
 
-class NodeDelay {
-  public:
-    NodePair _nodep;
-    int _delay;
-		NodeDelay() : _nodep(), _delay(0){ }
-		NodeDelay(NodePair nodep, int delay){
-			_nodep = nodep;
-			_delay = delay;
-		}
-	};
-
 /*
  * =c
  * SR2ChannelAssignerMulti(IP, ETH, ETHTYPE, LinkTable element, ARPTable element,  
- *                    [PERIOD timeout], [GW is_gateway])
+ *                    [PERIOD timeout], [GW is_gateway], [ALGORITHM greedy|tabu|annealing],
+ *                    [BUDGET msec], [THREADS n], [SNAPSHOTS n], [INCREMENTAL bool],
+ *                    [THRESHOLD percent], [MAX_SWITCHES n])
  * =s Wifi, Wireless Routing
  * Select a gateway to send a packet to based on TCP connection
  * state and metric to gateway.
@@ -35,6 +28,28 @@ class NodeDelay {
  * Each gateway broadcasts an ad every PERIOD msec.  
  * Non-gateway nodes select the gateway with the best 
  * metric and forward ads.
+ *
+ * ALGORITHM picks how channels are assigned. greedy walks the conflict
+ * graph once; tabu and annealing then refine the greedy assignment by
+ * local search for BUDGET msec (default 50), lowering the total traffic
+ * times conflicts. The search runs in slices of 2 msec from a timer, so
+ * the router forwards in between, and its result goes out once the
+ * budget is spent. tabu scores its candidate moves on THREADS threads
+ * (default 1), which takes a multithreaded user-level build. The last
+ * SNAPSHOTS (default 4) scan tables are kept. Writing "msec" to the
+ * compare handler runs every algorithm on each of them for msec
+ * (default BUDGET, at most 1000) and reading it reports the objectives.
+ *
+ * With INCREMENTAL true, a round only makes the changes worth making.
+ * Each link with a radio to retune forms a group of its one or two
+ * radios that switch together. Groups are taken best first as long as
+ * they lower the interference on the links they touch by THRESHOLD
+ * percent (default 10), fit within MAX_SWITCHES radios per round
+ * (default 0, no limit) and leave every radio that could reach this
+ * node reachable. In both
+ * modes the nodes farthest from this node are told first, each with one
+ * packet holding the channels of all its radios, sent hop by hop with
+ * acks by the CHSEL element.
  */
 
 class SR2ChannelAssignerMulti : public Element {
@@ -50,79 +65,41 @@ class SR2ChannelAssignerMulti : public Element {
   int configure(Vector<String> &conf, ErrorHandler *errh);
 
   /* handler stuff */
-//  void add_handlers();
-//  String print_cas_stats();
+  void add_handlers();
+  String print_bench();
+  String print_assign_stats();
+  void run_compare(unsigned budget);
 
   void push(int, Packet *);
   void run_timer(Timer *);
   
   void start_assignment();
+  void run_solver();
+  void finish_assignment();
     
   typedef HashMap<NodeAddress, SR2ScanInfo> NTable;
   typedef NTable::const_iterator NIter;
 
-	class MCGLeaf {
-	  public:
-	    NodePair _nodep;
-	    uint32_t _hop_count;
-	    uint32_t _hop_from;
-	    uint32_t _hop_to;
-	    uint32_t _delay;
-			uint32_t _traffic;
-			HashMap<uint32_t,uint32_t> _channels;
-	    HashMap<NodePair,uint32_t> _interfering;
-	    MCGLeaf() : _nodep(), _hop_count(0), _delay(0), _traffic(0), _interfering() { }
-			MCGLeaf(NodePair nodep, int hop_count, int delay, int traffic, HashMap<NodePair,int> interfering) {
-	      _nodep = nodep;
-	      _hop_count = hop_count;
-	      _delay = delay;
-				_traffic = traffic;
-				for(HashMap<NodePair,int>::const_iterator iter = interfering.begin(); iter.live(); iter++){
-					_interfering.insert(iter.key(),iter.value());
-				}
-	    }
-			void update_channel(int channel,int traffic) {
-				uint32_t * chan = _channels.findp(channel);
-				if (!chan){
-					_channels.insert(channel,traffic);
-				} else {
-					*chan = *chan + traffic;
-				}
-			}
-			uint32_t best_channel() {
-				uint32_t channel = 0;
-				uint32_t best = ~0;
-				for (HashMap<uint32_t,uint32_t>::const_iterator iter = _channels.begin(); iter.live(); iter++) {
-					if (iter.value() < best) {
-						channel = iter.key();
-						best = iter.value();
-					}
-				}
-				_channels.erase(channel);
-				return channel;
-			}
-			void update_interfering(NodePair nodep,uint32_t metric) {
-				NodePair pair_fw = NodePair(nodep._from,nodep._to);
-				NodePair pair_rev = NodePair(nodep._to,nodep._from);
-				uint32_t * nfo1 = _interfering.findp(pair_fw);
-				uint32_t * nfo2 = _interfering.findp(pair_rev);
-				if (!nfo1 && !nfo2 && !(_nodep == pair_fw) && !(_nodep == pair_rev)) {
-					_interfering.insert(nodep,metric);
-				}
-			}
-	  };
-
-	typedef HashMap<NodePair, MCGLeaf> MCGraph;
-	typedef MCGraph::const_iterator MCGIter;
-	
 	typedef HashMap<NodeAddress,int> CHTable;
 	typedef CHTable::const_iterator CHIter;
 
-	//int delay_sorter(const void *va, const void *vb, void *);
-	Vector<NodeDelay> smallest_hop_count();
-	Vector<NodeAddress> remove_neighbor_link(NodeAddress);
-	void assign_channel(NodeAddress,int);
-	Vector<NodeDelay> get_link_from_node(NodeAddress);
+	class PendingSwitch {
+	  public:
+	    int _hops;
+	    SR2ChannelAssignment _ch_ass;
+	};
+
+	void build_graph(const NTable &, SR2ConflictGraphMulti &);
+	void assign_channels(SR2ConflictGraphMulti &, CHTable &, int default_channel);
+	static void assign_channel(CHTable &, NodeAddress, int channel);
+	void bench_assignment(int links);
+	int64_t refine_channels(SR2ConflictGraphMulti &, CHTable &, int default_channel,
+				int algorithm, unsigned budget, int64_t *greedy);
+	static void seed_solver(SR2ChannelSolverMulti &, const SR2ConflictGraphMulti &, const CHTable &);
+	static void take_channels(const SR2ChannelSolverMulti &, const SR2ConflictGraphMulti &, CHTable &);
+	void select_changes(SR2ConflictGraphMulti &, CHTable &, int default_channel);
+	void reachable(const SR2ConflictGraphMulti &, const Vector<uint32_t> &channels, Vector<int> &reach);
+	void send_assignments(const NTable &, const CHTable &);
 		
   void update_scinfo(SR2ScanInfo*);
 
@@ -147,13 +124,66 @@ private:
 
   Timer _timer;
   NTable _ntable;
-	MCGraph _mcgraph;
+	SR2ConflictGraphMulti _mcgraph;
 	CHTable _chtable;
+
+	/* the round being searched, one SLICE msec per _solve_timer run */
+	enum { SLICE = 2 };
+	Timer _solve_timer;
+	SR2ChannelSolverMulti *_solver;
+	NTable _round_ntable;
+	int _round_channel;
+	Timestamp _round_built;
+	Timestamp _solve_left;
+
+	uint32_t _rounds;
+	Timestamp _last_build;
+	Timestamp _last_assign;
+
+	int _algorithm;
+	unsigned _budget; // msecs
+	unsigned _threads;
+	unsigned _max_snapshots;
+	Vector<NTable> _snapshots;
+	int _next_snapshot;
+	int64_t _greedy_objective;
+	int64_t _objective;
+
+	bool _incremental;
+	unsigned _threshold; // percent
+	unsigned _max_switches;
+
+	class IncrementalStats {
+	  public:
+	    IncrementalStats() : _wanted(0), _switched(0), _below_threshold(0),
+				 _over_limit(0), _would_cut(0), _before(0), _delta(0) { }
+	    uint32_t _wanted;
+	    uint32_t _switched;
+	    uint32_t _below_threshold;
+	    uint32_t _over_limit;
+	    uint32_t _would_cut;
+	    int64_t _before;
+	    int64_t _delta;
+	};
+	IncrementalStats _incr;
+	uint32_t _total_switched;
+	uint32_t _total_avoided;
+
+	class BenchResult {
+	  public:
+	    int _links;
+	    int _nodes;
+	    int _assigned;
+	    Timestamp _build;
+	    Timestamp _assign;
+	};
+	Vector<BenchResult> _bench;
+	String _compare;
   
-	void send(SR2ChannelAssignment);
+	void send(const Vector<SR2ChannelAssignment> &);
 
-//  static int write_handler(const String &, Element *, void *, ErrorHandler *);
-//  static String read_handler(Element *, void *);
+  static int write_handler(const String &, Element *, void *, ErrorHandler *);
+  static String read_handler(Element *, void *);
 
 };
 
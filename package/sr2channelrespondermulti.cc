@@ -37,10 +37,19 @@ CLICK_DECLS
 SR2ChannelResponderMulti::SR2ChannelResponderMulti()
   :  _ip(),
      _et(0),
+     _configured_channels(false),
+     _scan_channels(0),
+     _min_dwell(0),
+     _tolerance(50),
+     _round(0),
+     _scans(0),
+     _dwells(0),
+     _trace_id(0),
      _arp_table(0),
      _link_table(0),
      _if_table(0),
-     _timer(this)
+     _timer(this),
+     _switch_timer(this)
 {
 }
 
@@ -52,6 +61,8 @@ int
 SR2ChannelResponderMulti::configure (Vector<String> &conf, ErrorHandler *errh)
 {
   int ret;
+  int alpha = 25;
+  String channels;
   _debug = false;
   ret = cp_va_kparse(conf, this, errh,
 		     "ETHTYPE", 0, cpUnsigned, &_et,
@@ -66,6 +77,11 @@ SR2ChannelResponderMulti::configure (Vector<String> &conf, ErrorHandler *errh)
          "CHANPERIOD", 0, cpUnsigned, &_chan_period,
 		     "CHSEL", 0, cpElement, &_ch_sel,
 		     "COUNT", 0, cpElement, &_pkcounter,
+		     "ALPHA", 0, cpInteger, &alpha,
+		     "CHANNELS", 0, cpArgument, &channels,
+		     "SCAN_CHANNELS", 0, cpInteger, &_scan_channels,
+		     "MIN_DWELL", 0, cpUnsigned, &_min_dwell,
+		     "TOLERANCE", 0, cpInteger, &_tolerance,
 		     "DEBUG", 0, cpBool, &_debug,
 		     cpEnd);
 
@@ -103,7 +119,27 @@ SR2ChannelResponderMulti::configure (Vector<String> &conf, ErrorHandler *errh)
     return errh->error("SR2LinkTableMulti element is not a SR2LinkTableMulti");
   if (_if_table && _if_table->cast("AvailableInterfaces") == 0) 
     return errh->error("AvailableInterfaces element is not an AvailableInterfaces");
+  if (alpha < 1 || alpha > 100) 
+    return errh->error("ALPHA must be between 1 and 100");
+
+  if (_scan_channels < 0) 
+    return errh->error("SCAN_CHANNELS must not be negative");
+  if (_tolerance < 0) 
+    return errh->error("TOLERANCE must not be negative");
+  if (!_min_dwell || _min_dwell > _chan_period) 
+    _min_dwell = _chan_period / 4 ? _chan_period / 4 : 1;
+
+  Vector<String> args;
+  cp_spacevec(channels, args);
+  for (int x = 0; x < args.size(); x++) {
+    int channel;
+    if (!cp_integer(args[x], &channel) || channel < 1 || channel > 255) 
+      return errh->error("CHANNELS must be a list of channel numbers");
+    _channels.push_back(channel);
+  }
+  _configured_channels = (_channels.size() > 0);
 
+  _util.set_alpha(alpha);
   return ret;
 }
 
@@ -111,10 +147,11 @@ int
 SR2ChannelResponderMulti::initialize (ErrorHandler *)
 {
   _original_channel = 0;
-  _total_channels = 0;
-  _channel = NULL;
+  _version = 1;
   _sniffing = false;
+  _state = S_IDLE;
   _timer.initialize(this);
+  _switch_timer.initialize(this);
   Timestamp delay = Timestamp::make_msec(_period / 10);
 	_timer.schedule_at(Timestamp::now() + delay);
 	return 0;
@@ -124,41 +161,135 @@ void
 SR2ChannelResponderMulti::start_sniff(){
   
   _original_channel = _winfo->_channel;
-	int channels = 0;
-  
-  if (_original_channel <= 11) {
+
+  if (_original_channel <= 14) {
     // 802.11b/g
-		channels = 11;
 		_version = 1;
-		int ch[11] = {1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11};
-		_channel = new int[channels];
-		for(int j=0; j<channels; j++){
-    	_channel[j] = ch[j];
-		}
-    _total_channels = 11;
   }
-  
   if (_original_channel >= 36) {
     //802.11a
-		//channels = 24;
-		channels = 12;
 		_version = 2;
+  }
+
+  if (_configured_channels) {
+    return;
+  }
+
+  _channels.clear();
+  if (_version == 1) {
+		static const int ch[11] = {1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11};
+		for (int j = 0; j < 11; j++) {
+    	_channels.push_back(ch[j]);
+		}
+  } else {
 		//int ch[24] = {36, 40, 44, 48, 52, 56, 58, 60, 100, 104, 108, 112, 116, 120, 124, 128, 132, 136, 140, 149, 153, 157, 161, 165};
-		int ch[12] = {36, 40, 44, 48, 52, 56, 60, 149, 153, 157, 161, 165};
-		_channel = new int[channels];
-		for(int j=0; j<channels; j++){
-    	_channel[j] = ch[j];
+		static const int ch[12] = {36, 40, 44, 48, 52, 56, 60, 149, 153, 157, 161, 165};
+		for (int j = 0; j < 12; j++) {
+    	_channels.push_back(ch[j]);
 		}
-    //_total_channels = 24;
-		_total_channels = 12;
   }
 }
 
+/*
+ * A channel is converged once it has a few samples and the last one
+ * is within TOLERANCE of its EWMA.
+ */
+bool
+SR2ChannelResponderMulti::converged(int channel) const
+{
+  const SR2ChannelUtilMulti::Stats *s = _util.find(channel);
+  if (!s || s->_samples < 3) {
+    return false;
+  }
+  int diff = s->_last - s->ewma();
+  return (diff < 0 ? -diff : diff) <= _tolerance;
+}
+
+unsigned
+SR2ChannelResponderMulti::dwell(int channel) const
+{
+  return converged(channel) ? _min_dwell : _chan_period;
+}
+
+/*
+ * Picks the channels of the next scan. Channels never sampled come
+ * first, then the ones with the highest age (scans since their last
+ * sample) times weight, where unsettled channels weigh four times more
+ * and busy ones up to four times more again.
+ */
+void
+SR2ChannelResponderMulti::plan_scan()
+{
+  Vector<uint32_t> score;
+  for (int x = 0; x < _channels.size(); x++) {
+    int channel = _channels[x];
+    const SR2ChannelUtilMulti::Stats *s = _util.find(channel);
+    uint32_t *last = _scanned_round.findp(channel);
+    if (!s || !last) {
+      score.push_back(0xFFFFFFFFU);
+      continue;
+    }
+    uint32_t age = _round - *last;
+    uint32_t weight = (converged(channel) ? 1 : 4) * (1000 + 3 * s->ewma()) / 1000;
+    score.push_back(age * weight);
+  }
+
+  int n = _channels.size();
+  if (_scan_channels > 0 && _scan_channels < n) {
+    n = _scan_channels;
+  }
+  _plan.clear();
+  Vector<int> taken(_channels.size(), 0);
+  while (_plan.size() < n) {
+    int best = -1;
+    for (int x = 0; x < _channels.size(); x++) {
+      if (!taken[x] && (best < 0 || score[x] > score[best])) {
+	best = x;
+      }
+    }
+    taken[best] = 1;
+    _plan.push_back(_channels[best]);
+  }
+  _plan_index = 0;
+}
+
 void
-SR2ChannelResponderMulti::run_timer(Timer *)
+SR2ChannelResponderMulti::run_timer(Timer *t)
 {
+  if (t == &_switch_timer) {
+    Vector<SR2CommandExecMulti<int>::Job> done;
+    if (_switch_exec.poll(done)) {
+      _switch_timer.schedule_after_msec(SR2CommandExecMulti<int>::POLL);
+    }
+    for (int x = 0; x < done.size(); x++) {
+      switch_done(done[x]);
+    }
+    return;
+  }
+
+  if (_state == S_IDLE) {
+    begin_scan();
+  } else if (_state == S_DWELLING) {
+    // Reading counter: airtime utilisation over the dwell, in permille
+    int channel = _plan[_plan_index];
+    int busy = _pkcounter->read_utilisation();
+    int linkload = _util.update(channel, busy);
+    _ctable.update(channel, linkload);
+    _scanned_round.insert(channel, _round);
+    _dwells++;
+    click_chatter("%{element}: Update channel info, channel %d busy %d ewma %d\n",
+		  this,
+		  channel,
+		  busy,
+		  linkload);
+    _plan_index++;
+    next_channel();
+  }
+}
 
-  int channel_to_switch;
+void
+SR2ChannelResponderMulti::begin_scan()
+{
   int iface = _if_table->lookup_id(_eth);
 	_winfo->_channel = iface % 256;
 	_original_channel = iface % 256;
@@ -166,114 +297,172 @@ SR2ChannelResponderMulti::run_timer(Timer *)
 	ch_ass._node = NodeAddress (_ip, iface);
 	ch_ass._new_iface = 0;
 
-  if (!_sniffing){
-		 
-			for (int i=0; i<3; i++){
-				_ch_sel->send_change_warning(true, true, ch_ass);
-			}
-     _if_table->set_unavailable(iface);
-     _pkcounter->set_discard(true);
-     _sniffing = true;
-     start_sniff();
-     _channel_index = 0;
-     channel_to_switch = _channel[_channel_index];
-   } else {
-     // Reading counter
-     int linkload = _pkcounter->read_busy_time();;
-     _ctable.update(_channel[_channel_index], linkload);
-     click_chatter("%{element}: Update channel info, channel %d value %d\n",
-				      this,
-				      _channel[_channel_index],
-				      linkload);
-     _channel_index++;
-     channel_to_switch = _channel[_channel_index];
-
-     if (_channel_index == _total_channels){
-	
-       int switch_to = _if_table->check_channel_change(iface);
+  start_sniff();
+  if (!_channels.size()) {
+    schedule_scan();
+    return;
+  }
+  _round++;
+  plan_scan();
+
+	_trace_id = _ch_sel->trace_begin(ch_ass._node, 0, true);
+	_ch_sel->send_change_warning(true, true, ch_ass);
+  _ch_sel->trace_mark(_trace_id, SR2SwitchTraceMulti::WARNED);
+  _if_table->set_unavailable(iface);
+  _ch_sel->trace_mark(_trace_id, SR2SwitchTraceMulti::DOWN);
+  _pkcounter->set_discard(true);
+  _sniffing = true;
+  _scan_start = Timestamp::now();
+  next_channel();
+}
 
-       if (switch_to != 0){
-	      _sniffing = false;
-        _pkcounter->set_discard(false);
-        _if_table->set_available(iface);
-				for (int i=0; i<3; i++){
-					_ch_sel->send_change_warning(false, true, ch_ass);
-				}
-				if (_debug){
-		     click_chatter("%{element}: Channel switch occurred during scan, switching now to channel %d\n",
-					      this,
-					      switch_to);
-				}
+void
+SR2ChannelResponderMulti::next_channel()
+{
+  if (_plan_index < _plan.size()) {
+    switch_to(_plan[_plan_index]);
+    return;
+  }
 
-				ch_ass._new_iface = switch_to;
+  int iface = _if_table->lookup_id(_eth);
+  int switch_to_iface = _if_table->check_channel_change(iface);
 
-				_ch_sel->switch_channel(true,ch_ass);
+  if (switch_to_iface != 0) {
+    end_scan(false);
+		if (_debug){
+     click_chatter("%{element}: Channel switch occurred during scan, switching now to channel %d\n",
+		      this,
+		      switch_to_iface);
+		}
 
-				_if_table->set_channel_change(switch_to,0);
+		SR2ChannelAssignment ch_ass;
+		ch_ass._node = NodeAddress (_ip, iface);
+		ch_ass._new_iface = switch_to_iface;
 
-				unsigned max_jitter = _period / 10;
-       	unsigned j = click_random(0, 2 * max_jitter);
-        Timestamp delay = Timestamp::make_msec(_period + j - max_jitter + 100000);
-       	_timer.schedule_at(Timestamp::now() + delay);
+		_ch_sel->switch_channel(true,ch_ass);
 
-				return;
-				
-       } else {
-	
-         channel_to_switch = _original_channel;
+		_if_table->set_channel_change(switch_to_iface,0);
+    return;
+  }
 
-       }
-     }
-   }
+  // Back to the channel we serve data on
+  switch_to(_original_channel);
+}
 
-  StringAccum switchcmd;
+void
+SR2ChannelResponderMulti::switch_to(int channel)
+{
+  _state = S_SWITCHING;
+  _switching_to = (_plan_index < _plan.size()) ? channel : -1;
+  _switch_exec.submit(_chstr, _ch_sel->switch_command(_chstr, channel), channel);
+  if (!_switch_timer.scheduled()) {
+    _switch_timer.schedule_after_msec(SR2CommandExecMulti<int>::POLL);
+  }
+}
 
-  switchcmd << "iwconfig " << _chstr << " channel " << channel_to_switch;
- 
-  int switch_error = system (switchcmd.c_str());
+void
+SR2ChannelResponderMulti::switch_done(const SR2CommandExecMulti<int>::Job &job)
+{
+  if (!job.ok()) {
+    click_chatter("%{element}: channel switching failed using: %s\n",
+		  this,
+		  job._command.c_str());
+  } else if (_debug) {
+    click_chatter("%{element}: Device %s switched on channel %d\n",
+		  this,
+		  _chstr.c_str(),
+		  job._data);
+  }
 
-  if (switch_error){
-      click_chatter("%{element}: channel switching failed using: %s\n",
-		      this,
-		      switchcmd.c_str());
-  } else {
-			if (_debug){
-				click_chatter("%{element}: Device %s switched on channel %d\n",
-						this,
-						_chstr.c_str(),
-						channel_to_switch);
-			}
+  if (_state != S_SWITCHING) {
+    return;
+  }
+  if (_switching_to < 0) {
+    if (!job.ok()) {
+      _ch_sel->trace_fail(_trace_id);
+    }
+    _ch_sel->trace_mark(_trace_id, SR2SwitchTraceMulti::CMD_DONE);
+    end_scan(true);
+    return;
+  }
+  if (!job.ok()) {
+    // whatever we would hear is not on this channel
+    _plan_index++;
+    next_channel();
+    return;
+  }
+  _pkcounter->reset();
+  _state = S_DWELLING;
+  _timer.schedule_after_msec(dwell(_switching_to));
+}
 
-	}
+void
+SR2ChannelResponderMulti::end_scan(bool report)
+{
+  int iface = _if_table->lookup_id(_eth);
+	SR2ChannelAssignment ch_ass;
+	ch_ass._node = NodeAddress (_ip, iface);
+	ch_ass._new_iface = 0;
 
-  _pkcounter->reset();
+  _sniffing = false;
+  _state = S_IDLE;
+  _if_table->set_available(iface);
+  _ch_sel->trace_mark(_trace_id, SR2SwitchTraceMulti::UP);
+  _pkcounter->set_discard(false);
+	_ch_sel->send_change_warning(false, true, ch_ass);
+
+  _scans++;
+  _last_scan = Timestamp::now() - _scan_start;
+  _out_of_service += _last_scan;
+
+  if (report) {
+		if (!_ch_sel->is_cas()) {
+			for (int i=0; i<3; i++) {
+        send_scandata();
+      }
+		} else {
+			send_scandata();
+		}
+  }
 
- 	if (_channel_index == _total_channels){
-        _sniffing = false;
-        _if_table->set_available(iface);
-        _pkcounter->set_discard(false);
-				for (int i=0; i<3; i++){
-					_ch_sel->send_change_warning(false, true, ch_ass);
-				}
-        
-				if (!_ch_sel->is_cas()) {
-					for (int i=0; i<3; i++) {
-	          send_scandata();
-	        }
-				} else {
-					send_scandata();
-				}
-
-        
-        unsigned max_jitter = _period / 10;
-       	unsigned j = click_random(0, 2 * max_jitter);
-        Timestamp delay = Timestamp::make_msec(_period + j - max_jitter + 100000);
-       	_timer.schedule_at(Timestamp::now() + delay);
-   } else {
-         Timestamp delay = Timestamp::make_msec(_chan_period);
-       	_timer.schedule_at(Timestamp::now() + delay);
-   }
+  schedule_scan();
+}
 
+/*
+ * Scans are spread out so that the channel list is covered about once
+ * per (PERIOD + 100 s), however many channels each scan takes.
+ */
+void
+SR2ChannelResponderMulti::schedule_scan()
+{
+  unsigned max_jitter = _period / 10;
+  unsigned j = click_random(0, 2 * max_jitter);
+  uint64_t interval = _period + j - max_jitter + 100000;
+  if (_plan.size() && _plan.size() < _channels.size()) {
+    interval = interval * _plan.size() / _channels.size();
+  }
+  _timer.schedule_after_msec(interval);
+}
+
+String
+SR2ChannelResponderMulti::print_scan_stats()
+{
+  StringAccum sa;
+  sa << "scans " << _scans;
+  sa << " dwells " << _dwells;
+  sa << " channels " << _channels.size();
+  sa << " per_scan " << _plan.size();
+  sa << " last_scan_msec " << _last_scan.msecval();
+  sa << " out_of_service_msec " << _out_of_service.msecval() << "\n";
+  for (int x = 0; x < _channels.size(); x++) {
+    int channel = _channels[x];
+    uint32_t *last = _scanned_round.findp(channel);
+    sa << "channel " << channel;
+    sa << " dwell " << dwell(channel);
+    sa << " converged " << converged(channel);
+    sa << " last_scan " << (last ? (int) *last : -1) << "\n";
+  }
+  return sa.take_string();
 }
 
 void
@@ -396,7 +585,7 @@ SR2ChannelResponderMulti::send_scandata()
  		}
 }
 
-enum {H_DEBUG, H_IP};
+enum {H_DEBUG, H_IP, H_UTILISATION, H_SCAN_STATS};
 
 String
 SR2ChannelResponderMulti::read_handler(Element *e, void *thunk)
@@ -405,6 +594,10 @@ SR2ChannelResponderMulti::read_handler(Element *e, void *thunk)
   switch ((intptr_t)(thunk)) {
   case H_IP:
     return c->_ip.unparse() + "\n";
+  case H_UTILISATION:
+    return c->_util.unparse();
+  case H_SCAN_STATS:
+    return c->print_scan_stats();
   default:
     return "<error>\n";
   }
@@ -424,6 +617,16 @@ SR2ChannelResponderMulti::write_handler(const String &in_s, Element *e, void *vp
       d->_debug = debug;
       break;
     }
+    case H_UTILISATION: {
+      d->_util.clear();
+      d->_scanned_round.clear();
+      break;
+    }
+    case H_SCAN_STATS: {
+      d->_scans = d->_dwells = 0;
+      d->_out_of_service = Timestamp();
+      break;
+    }
   }
   return 0;
 }
@@ -432,7 +635,11 @@ void
 SR2ChannelResponderMulti::add_handlers()
 {
   add_read_handler("ip", read_handler, H_IP);
+  add_read_handler("utilisation", read_handler, H_UTILISATION);
+  add_read_handler("scan_stats", read_handler, H_SCAN_STATS);
   add_write_handler("debug", write_handler, H_DEBUG);
+  add_write_handler("utilisation", write_handler, H_UTILISATION);
+  add_write_handler("scan_stats", write_handler, H_SCAN_STATS);
 }
 
 
@@ -8,14 +8,37 @@
 #include <click/vector.hh>
 #include <click/hashmap.hh>
 #include "sr2channelselectormulti.hh"
+#include "sr2channelutilmulti.hh"
+#include "sr2commandexecmulti.hh"
 CLICK_DECLS
 
 /*
  * =c
  * SR2ChannelResponder(ETHTYPE, IP, ETH, PERIOD, LinkTable element, 
- * ARPTable element, GatewaySelector element)
+ * ARPTable element, GatewaySelector element, [ALPHA percent],
+ * [CHANNELS list], [SCAN_CHANNELS n], [MIN_DWELL msec], [TOLERANCE permille])
  * =s Wifi, Wireless Routing
  * Responds to queries destined for this node.
+ * =d
+ * Channels are rated by their airtime utilisation in permille, as
+ * measured by the COUNT element during each dwell. The scan info
+ * carries an EWMA over scan rounds giving ALPHA percent (default 25) of
+ * weight to the latest round. The utilisation handler shows the last
+ * sample, EWMA, peak and a histogram per channel; writing to it clears
+ * them.
+ *
+ * CHANNELS lists the channels to scan (default all 802.11b/g or 802.11a
+ * channels, by the band of the radio). Each scan visits SCAN_CHANNELS of
+ * them (default 0, all): channels never sampled first, then the ones
+ * longest unsampled, weighted up for busy and unsettled ones. Scans are
+ * spread out so the whole list is still covered about once a period,
+ * with data service in between. A channel whose last sample is within
+ * TOLERANCE permille (default 50) of its EWMA, after three samples, gets
+ * a dwell of MIN_DWELL msec (default CHANPERIOD / 4) instead of
+ * CHANPERIOD. Channel switches run the selector's SWITCH_CMD in the
+ * background. The scan_stats handler reports how long the radio has been
+ * out of service for scans, and each scan is traced in the selector's
+ * switch_trace handler.
  */
 
 class SR2ChannelResponderMulti : public Element {
@@ -35,6 +58,7 @@ class SR2ChannelResponderMulti : public Element {
   void start_sniff();
   void send_scandata();
   void add_handlers();
+  String print_scan_stats();
 
  private:
 
@@ -44,12 +68,29 @@ class SR2ChannelResponderMulti : public Element {
   unsigned int _chan_period;  // msecs
   EtherAddress _eth;
   int _original_channel;
-  int *_channel;
-  int _total_channels;
 	int _version;
-  int _channel_index;
   bool _sniffing;
   bool _debug;
+
+  enum { S_IDLE, S_SWITCHING, S_DWELLING };
+  int _state;
+  Vector<int> _channels;
+  bool _configured_channels;
+  Vector<int> _plan;	// channels of the scan in progress
+  int _plan_index;
+  int _switching_to;	// -1 when going back to _original_channel
+  int _scan_channels;
+  unsigned int _min_dwell; // msecs
+  int _tolerance;	// permille
+  uint32_t _round;
+  HashMap<int, uint32_t> _scanned_round;
+
+  uint32_t _scans;
+  uint32_t _dwells;
+  Timestamp _scan_start;
+  uint32_t _trace_id;
+  Timestamp _last_scan;
+  Timestamp _out_of_service;
   
   String _chstr;
 
@@ -61,7 +102,20 @@ class SR2ChannelResponderMulti : public Element {
   class SR2CounterMulti *_pkcounter;
 
   SR2ChannelInfo _ctable;
+  SR2ChannelUtilMulti _util;
   Timer _timer;
+  SR2CommandExecMulti<int> _switch_exec;
+  Timer _switch_timer;
+
+  bool converged(int channel) const;
+  unsigned dwell(int channel) const;
+  void plan_scan();
+  void begin_scan();
+  void next_channel();
+  void switch_to(int channel);
+  void switch_done(const SR2CommandExecMulti<int>::Job &);
+  void end_scan(bool report);
+  void schedule_scan();
 
   static int write_handler(const String &, Element *, void *, ErrorHandler *);
   static String read_handler(Element *, void *);
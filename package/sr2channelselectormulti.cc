@@ -33,12 +33,21 @@
 CLICK_DECLS
 
 SR2ChannelSelectorMulti::SR2ChannelSelectorMulti()
-  :  _ip(),
+  :  _forward_timer(static_forward_ad_hook, this),
+     _stale(0),
+     _duplicates(0),
+     _ip(),
      _et(0),
      _link_table(0),
      _if_table(0),
      _arp_table(0),
-     _timer(this)
+     _timer(this),
+     _switch_timer(this),
+     _switch_cmd("iwconfig {dev} channel {channel}"),
+     _ack_timer(this),
+     _warn_fresh(10000),
+     _trace_timer(this),
+     _trace_timeout(30000)
 {
   // Pick a starting sequence number that we have not used before.
   _seq = Timestamp::now().usec();
@@ -52,6 +61,12 @@ int
 SR2ChannelSelectorMulti::configure (Vector<String> &conf, ErrorHandler *errh)
 {
   int ret;
+  int seen_capacity = 100;
+  unsigned int seen_expire = 30000;
+  unsigned int switch_timeout = 5000;
+  unsigned int ack_retry = 100;
+  unsigned int ack_retries = 3;
+  int trace = 32;
   _is_cas = false;
 	_debug = false;
   ret = cp_va_kparse(conf, this, errh,
@@ -63,8 +78,17 @@ SR2ChannelSelectorMulti::configure (Vector<String> &conf, ErrorHandler *errh)
 		     "PERIOD", 0, cpUnsigned, &_period,
 		     "JITTER", 0, cpUnsigned, &_jitter,
 		     "EXPIRE", 0, cpUnsigned, &_expire,
+		     "SEEN_CAPACITY", 0, cpInteger, &seen_capacity,
+		     "SEEN_EXPIRE", 0, cpUnsigned, &seen_expire,
 		     "CAS", 0, cpBool, &_is_cas,
 		     "DEBUG", 0, cpBool, &_debug,
+		     "SWITCH_CMD", 0, cpString, &_switch_cmd,
+		     "SWITCH_TIMEOUT", 0, cpUnsigned, &switch_timeout,
+		     "ACK_RETRY", 0, cpUnsigned, &ack_retry,
+		     "ACK_RETRIES", 0, cpUnsigned, &ack_retries,
+		     "WARN_FRESH", 0, cpUnsigned, &_warn_fresh,
+		     "TRACE", 0, cpInteger, &trace,
+		     "TRACE_TIMEOUT", 0, cpUnsigned, &_trace_timeout,
 		     cpEnd);
 
   if (!_et) 
@@ -79,6 +103,20 @@ SR2ChannelSelectorMulti::configure (Vector<String> &conf, ErrorHandler *errh)
     return errh->error("AvailableInterfaces element is not an AvailableInterfaces");
   if (_arp_table && _arp_table->cast("ARPTableMulti") == 0) 
     return errh->error("ARPTable element is not an ARPtableMulti");
+  if (seen_capacity < 1) 
+    return errh->error("SEEN_CAPACITY must be positive");
+  if (!_switch_cmd) 
+    return errh->error("SWITCH_CMD must not be empty");
+  if (!ack_retry) 
+    return errh->error("ACK_RETRY must be positive");
+  if (trace < 1) 
+    return errh->error("TRACE must be positive");
+
+  _seen.configure(seen_capacity, seen_expire);
+  _forwarded.configure(seen_capacity, seen_expire);
+  _switch_exec.set_timeout(switch_timeout);
+  _hop_ack.configure(ack_retry, ack_retries);
+  _trace.set_capacity(trace);
 
   return ret;
 }
@@ -88,13 +126,29 @@ SR2ChannelSelectorMulti::initialize (ErrorHandler *)
 {
   _timer.initialize (this);
   _timer.schedule_now ();
+  _forward_timer.initialize(this);
+  _switch_timer.initialize(this);
+  _ack_timer.initialize(this);
+  _trace_timer.initialize(this);
 
   return 0;
 }
 
 void
-SR2ChannelSelectorMulti::run_timer (Timer *)
+SR2ChannelSelectorMulti::run_timer (Timer *t)
 {
+  if (t == &_switch_timer) {
+    poll_switches();
+    return;
+  }
+  if (t == &_ack_timer) {
+    resend_hops();
+    return;
+  }
+  if (t == &_trace_timer) {
+    poll_trace();
+    return;
+  }
   cleanup();
   if (_is_cas) {
     start_ad();
@@ -188,11 +242,25 @@ void
 SR2ChannelSelectorMulti::forward_ad_hook() 
 {
     Timestamp now = Timestamp::now();
-    for (int x = 0; x < _seen.size(); x++) {
-    	if (_seen[x]._to_send < now && !_seen[x]._forwarded) {
-    	    forward_ad(&_seen[x]);
+    while (!_pending.empty() && !(now < _pending.top()._when)) {
+    	Seen *s = _seen.peek(_pending.top()._src, _pending.top()._seq);
+    	_pending.pop();
+    	if (s && !s->_forwarded) {
+    	    forward_ad(s);
     	}
     }
+    if (!_pending.empty()) {
+    	_forward_timer.schedule_at(_pending.top()._when);
+    }
+}
+
+void
+SR2ChannelSelectorMulti::schedule_forward(Seen *s)
+{
+  _pending.push(s->_cas, s->_seq, s->_to_send);
+  if (!_forward_timer.scheduled() || s->_to_send < _forward_timer.expiry()) {
+    _forward_timer.schedule_at(s->_to_send);
+  }
 }
 
 void
@@ -200,17 +268,16 @@ SR2ChannelSelectorMulti::forward_ad(Seen *s)
 {
 
   s->_forwarded = true;
-  _link_table->dijkstra(false);
   IPAddress src = s->_cas;
-  SR2PathMulti best = _link_table->best_route(src, false);
-  if (!_link_table->valid_route(best)) {
+  SR2RouteHeaderMulti hdr = _link_table->route_header(src);
+  if (!hdr._valid) {
     click_chatter("%{element} :: %s :: invalid route from src %s\n",
 		  this,
 		  __func__,
 		  src.unparse().c_str());
     return;
   }
-  int links = best.size() - 1;
+  int links = hdr.num_links();
 
   int len = sr2packetmulti::len_wo_data(links);
   WritablePacket *p = Packet::make(len + sizeof(click_ether));
@@ -226,13 +293,7 @@ SR2ChannelSelectorMulti::forward_ad(Seen *s)
   pk->set_seq(s->_seq);
   pk->set_num_links(links);
 
-  for(int i=0; i < links; i++) {
-    pk->set_link(i, best[i].get_dep(), best[i+1].get_arr(),
-		  _link_table->get_link_metric(best[i].get_dep(), best[i+1].get_arr()),
-		  _link_table->get_link_metric(best[i+1].get_dep(), best[i].get_arr()),
-		  _link_table->get_link_seq(best[i].get_dep(), best[i+1].get_arr()),
-		  _link_table->get_link_age(best[i].get_dep(), best[i+1].get_arr()));
-  }
+  hdr.write_links(pk);
 
   //EtherAddress my_eth = _if_table->lookup_if(best[links].get_arr()._iface);
 	EtherAddress my_eth = _if_table->lookup_def();
@@ -302,7 +363,7 @@ SR2ChannelSelectorMulti::send_change_warning(bool start, bool scan, SR2ChannelAs
     pk->unset_flag(~0);
     pk->set_data_len(data_len);
     pk->set_qdst(_ip);
-    pk->set_seq(0);
+    pk->set_seq(next_seq());
     pk->set_num_links(0);
     pk->set_link_node(0,_ip);
 		pk->set_link_if(0,_if_table->lookup_def_id());
@@ -316,8 +377,149 @@ SR2ChannelSelectorMulti::send_change_warning(bool start, bool scan, SR2ChannelAs
     memset(eh->ether_dhost, 0xff, 6); 
     memcpy(eh->ether_shost, shost.data(), 6);
 
-    output(0).push(p);
+    send_hop(p);
+
+}
+
+/*
+ * Sends a channel assignment to its next hop, or a change warning to
+ * all neighbours, and keeps it until they have acked it.
+ */
+void
+SR2ChannelSelectorMulti::send_hop(Packet *p)
+{
+  click_ether *eh = (click_ether *) p->data();
+  struct sr2packetmulti *pk = (struct sr2packetmulti *) (eh+1);
+  Vector<IPAddress> waiting;
+  if (pk->_type == SR2_PT_CHNGWARN) {
+    /* only neighbours that still hear our default radio can ack */
+    NodeAddress radio = NodeAddress(_ip, _if_table->lookup_def_id());
+    waiting = _link_table->neighbors_since(radio, Timestamp::now() - Timestamp::make_msec(_warn_fresh));
+  } else {
+    waiting.push_back(pk->get_link_node_b(pk->next()));
+  }
+  output(0).push(_hop_ack.insert(pk->qdst(), pk->seq(), pk->_type, p, waiting));
+
+  Timestamp when;
+  if (_hop_ack.next_due(&when)) {
+    _ack_timer.schedule_at(when);
+  }
+}
+
+void
+SR2ChannelSelectorMulti::resend_hops()
+{
+  Vector<Packet *> due;
+  _hop_ack.due(due);
+  for (int x = 0; x < due.size(); x++) {
+    output(0).push(due[x]);
+  }
+
+  Timestamp when;
+  if (_hop_ack.next_due(&when)) {
+    _ack_timer.schedule_at(when);
+  }
+}
+
+uint32_t
+SR2ChannelSelectorMulti::trace_begin(NodeAddress radio, uint16_t new_iface, bool scan)
+{
+  return _trace.begin(radio, new_iface, scan);
+}
+
+/* once a radio is up again, watch it until it is heard and routed through */
+void
+SR2ChannelSelectorMulti::trace_mark(uint32_t id, int event)
+{
+  _trace.mark(id, event);
+  if (event == SR2SwitchTraceMulti::UP && !_trace_timer.scheduled()) {
+    _trace_timer.schedule_after_msec(SR2SwitchTraceMulti::POLL);
+  }
+}
 
+void
+SR2ChannelSelectorMulti::poll_trace()
+{
+  Timestamp now = Timestamp::now();
+  Timestamp timeout = Timestamp::make_msec(_trace_timeout);
+  for (int x = 0; x < _trace.size(); x++) {
+    SR2SwitchTraceMulti::Timeline &t = _trace.at(x);
+    if (!t._open || !t._at[SR2SwitchTraceMulti::UP]) {
+      continue;
+    }
+    NodeAddress radio = t.radio_after();
+    if (!t._at[SR2SwitchTraceMulti::FIRST_PROBE]) {
+      Timestamp heard = _link_table->last_heard(radio);
+      if (t._at[SR2SwitchTraceMulti::UP] < heard) {
+	t._at[SR2SwitchTraceMulti::FIRST_PROBE] = heard;
+      }
+    }
+    if (t._at[SR2SwitchTraceMulti::FIRST_PROBE] && _link_table->routes_via(radio, t._at[SR2SwitchTraceMulti::UP])) {
+      t._at[SR2SwitchTraceMulti::FIRST_ROUTE] = now;
+      t._open = false;
+    } else if (t._at[SR2SwitchTraceMulti::UP] + timeout < now) {
+      t._open = false;
+    }
+  }
+  if (_trace.waiting()) {
+    _trace_timer.schedule_after_msec(SR2SwitchTraceMulti::POLL);
+  }
+}
+
+/* acks p_in to the hop it came from */
+void
+SR2ChannelSelectorMulti::send_ack(Packet *p_in)
+{
+  click_ether *eh_in = (click_ether *) p_in->data();
+  struct sr2packetmulti *pk_in = (struct sr2packetmulti *) (eh_in+1);
+
+  int len = sr2packetmulti::len_with_data(0, sizeof(uint32_t));
+  WritablePacket *p = Packet::make(len + sizeof(click_ether));
+  if(p == 0)
+    return;
+  click_ether *eh = (click_ether *) p->data();
+  struct sr2packetmulti *pk = (struct sr2packetmulti *) (eh+1);
+  memset(pk, '\0', len);
+  pk->_version = _sr2_version;
+  pk->_type = SR2_PT_CHACK;
+  pk->unset_flag(~0);
+  pk->set_qdst(pk_in->qdst());
+  pk->set_seq(pk_in->seq());
+  pk->set_num_links(0);
+  pk->set_link_node(0,_ip);
+  pk->set_link_if(0,_if_table->lookup_def_id());
+  pk->set_acked_type(pk_in->_type);
+
+  EtherAddress shost = _if_table->lookup_def();
+
+  eh->ether_type = htons(_et);
+  memcpy(eh->ether_dhost, eh_in->ether_shost, 6);
+  memcpy(eh->ether_shost, shost.data(), 6);
+
+  output(0).push(p);
+}
+
+/*
+ * true if seq is newer than last, which it then becomes. A source not
+ * heard from for EXPIRE msec is forgotten, so that it can restart its
+ * sequence numbers. The same seq again is a resend whose ack was lost.
+ */
+bool
+SR2ChannelSelectorMulti::fresh(LastSeq &last, uint32_t seq)
+{
+  Timestamp now = Timestamp::now();
+  if (last._when && now < last._when + Timestamp::make_msec(_expire) &&
+      (int32_t) (seq - last._seq) <= 0) {
+    if (seq == last._seq) {
+      _duplicates++;
+    } else {
+      _stale++;
+    }
+    return false;
+  }
+  last._seq = seq;
+  last._when = now;
+  return true;
 }
 
 void
@@ -431,53 +633,95 @@ SR2ChannelSelectorMulti::switch_channel(bool scheduled, SR2ChannelAssignment ch_
 								ch_ass._new_iface);
 			}
 
+			uint32_t trace = trace_begin(ch_ass._node, ch_ass._new_iface, false);
+
 			// First Change Warning packet: start of channel switch
-			for (int i=0; i<3; i++){
-	    	send_change_warning(true, false, ch_ass);
-			}
+	    send_change_warning(true, false, ch_ass);
+			trace_mark(trace, SR2SwitchTraceMulti::WARNED);
 
 			// Disabling interface
 			_if_table->set_unavailable(ch_ass._node._iface);
+			trace_mark(trace, SR2SwitchTraceMulti::DOWN);
 		
 			// Updating all local tables with new local interface channel
 	    _if_table->change_if(ch_ass._node._iface, ch_ass._new_iface);
 			_link_table->change_if(ch_ass._node, ch_ass._new_iface);
 			//_arp_table->change_if(ch_ass._node, ch_ass._new_iface);
+			trace_mark(trace, SR2SwitchTraceMulti::RENUMBERED);
 		
-			// Physical switch to the new channel
-	    StringAccum switchcmd;
-	    int channel_to_switch = ch_ass._new_iface % 256;
+			// Physical switch to the new channel, finished in finish_switch()
 	    String chstr = _if_table->get_if_name(ch_ass._new_iface);
-	    switchcmd << "iwconfig " << chstr << " channel " << channel_to_switch;
+	    _switch_exec.submit(chstr, switch_command(chstr, ch_ass._new_iface % 256), ch_ass);
+	    if (!_switch_timer.scheduled()) {
+	      _switch_timer.schedule_after_msec(SwitchExec::POLL);
+	    }
 
-	    int switch_error = system (switchcmd.c_str());
+	  }
+  
+	}
 
-	    if (switch_error){
-	        click_chatter("%{element}: Channel switching failed using: %s\n",
-	  		      this,
-	  		      switchcmd.c_str());
-	    } else {
+}
 
-	  			click_chatter("%{element}: Device %s switched on channel %d\n",
-	  					this,
-	  					chstr.c_str(),
-	  					channel_to_switch);
+String
+SR2ChannelSelectorMulti::switch_command(const String &dev, int channel) const
+{
+  StringAccum sa;
+  const char *s = _switch_cmd.data();
+  const char *end = s + _switch_cmd.length();
+  while (s < end) {
+    if (end - s >= 5 && memcmp(s, "{dev}", 5) == 0) {
+      sa << dev;
+      s += 5;
+    } else if (end - s >= 9 && memcmp(s, "{channel}", 9) == 0) {
+      sa << channel;
+      s += 9;
+    } else {
+      sa << *s++;
+    }
+  }
+  return sa.take_string();
+}
 
-	  	}
+void
+SR2ChannelSelectorMulti::poll_switches()
+{
+  Vector<SwitchExec::Job> done;
+  if (_switch_exec.poll(done)) {
+    _switch_timer.schedule_after_msec(SwitchExec::POLL);
+  }
+  for (int x = 0; x < done.size(); x++) {
+    finish_switch(done[x]);
+  }
+}
 
-			// Re-enabling interface
-	    _if_table->set_available(ch_ass._new_iface);
+void
+SR2ChannelSelectorMulti::finish_switch(const SwitchExec::Job &job)
+{
+  const SR2ChannelAssignment &ch_ass = job._data;
+  uint32_t trace = _trace.find(ch_ass._node, ch_ass._new_iface);
 
-			// Second Change Warning packet: end of channel switch
-			for (int i=0; i<3; i++){
-	    	send_change_warning(false, false, ch_ass);
-			}
+  if (!job.ok()) {
+    _trace.fail(trace);
+    click_chatter("%{element}: Channel switching failed using: %s%s\n",
+		  this,
+		  job._command.c_str(),
+		  job._timed_out ? " (timed out)" : "");
+  } else {
+    click_chatter("%{element}: Device %s switched on channel %d in %d msec\n",
+		  this,
+		  job._key.c_str(),
+		  ch_ass._new_iface % 256,
+		  (int) (job._done - job._started).msecval());
+  }
 
+  trace_mark(trace, SR2SwitchTraceMulti::CMD_DONE);
 
-	  }
-  
-	}
+  // Re-enabling interface
+  _if_table->set_available(ch_ass._new_iface);
+  trace_mark(trace, SR2SwitchTraceMulti::UP);
 
+  // Second Change Warning packet: end of channel switch
+  send_change_warning(false, false, ch_ass);
 }
 
 void
@@ -505,7 +749,7 @@ SR2ChannelSelectorMulti::push(int, Packet *p_in)
     p_in->kill();
     return;
   }
-  if (pk->_type != SR2_PT_CHBEACON && pk->_type != SR2_PT_CHSCINFO && pk->_type != SR2_PT_CHASSIGN && pk->_type != SR2_PT_CHNGWARN) {
+  if (pk->_type != SR2_PT_CHBEACON && pk->_type != SR2_PT_CHSCINFO && pk->_type != SR2_PT_CHASSIGN && pk->_type != SR2_PT_CHNGWARN && pk->_type != SR2_PT_CHACK) {
     click_chatter("%{element} :: %s :: back packet type %d",
 		  this,
 		  __func__,
@@ -574,24 +818,17 @@ SR2ChannelSelectorMulti::push(int, Packet *p_in)
   	  return;
     }
 
-    int si = 0;
     uint32_t seq = pk->seq();
-    for(si = 0; si < _seen.size(); si++){
-      if(cas == _seen[si]._cas && seq == _seen[si]._seq){
-        _seen[si]._count++;
-        p_in->kill();
-        return;
-      }
+    Seen *s = _seen.find(cas, seq);
+    if (s) {
+      s->_count++;
+      p_in->kill();
+      return;
     }
 
-    if (si == _seen.size()) {
-      if (_seen.size() == 100) {
-        _seen.pop_front();
-        si--;
-      }
-      _seen.push_back(Seen(cas, seq, 0, 0));
-    }
-    _seen[si]._count++;
+    s = _seen.insert(cas, seq, Seen(cas, seq, 0, 0));
+    s->_count++;
+    s->_when = Timestamp::now();
 
     CASInfo *nfo = _castable.findp(cas);
     if (!nfo) {
@@ -612,11 +849,9 @@ SR2ChannelSelectorMulti::push(int, Packet *p_in)
     /* schedule timer */
     int delay = click_random(1, _jitter);
   
-    _seen[si]._to_send = _seen[si]._when + Timestamp::make_msec(delay);
-    _seen[si]._forwarded = false;
-    Timer *t = new Timer(static_forward_ad_hook, (void *) this);
-    t->initialize(this);
-    t->schedule_after_msec(delay);
+    s->_to_send = s->_when + Timestamp::make_msec(delay);
+    s->_forwarded = false;
+    schedule_forward(s);
 
     p_in->kill();
     return;
@@ -657,27 +892,50 @@ SR2ChannelSelectorMulti::push(int, Packet *p_in)
   	
   }
   
-  if (pk->_type == SR2_PT_CHASSIGN){
+  if (pk->_type == SR2_PT_CHACK){
 
-    SR2ChannelAssignment ch_ass;
-    int data_len = sizeof(SR2ChannelAssignment);
-    int head_len = pk->hlen_wo_data();
+    _hop_ack.ack(pk->qdst(), pk->seq(), pk->acked_type(), pk->get_link_node(0));
+    p_in->kill();
+    return;
 
-    memcpy(&ch_ass, p_in->data()+head_len+sizeof(click_ether), data_len);
+  }
+
+  if (pk->_type == SR2_PT_CHASSIGN){
 
     if (pk->next() == (pk->num_links()-1)){
 			
-			if (ch_ass._node._ipaddr == _ip) {
+			if (pk->get_link_node_b(pk->num_links()-1) == _ip) {
 				/* I am the ultimate consumer of this packet */
-				if (_debug){
-					click_chatter("%{element} :: Received Channel Assignment %s-%d >> %d\n",
-			      			this, 
-									ch_ass._node._ipaddr.unparse().c_str(),
-									ch_ass._node._iface,
-									ch_ass._new_iface);
+				send_ack(p_in);
+
+				LastSeq *last = _last_assign.findp(pk->qdst());
+				if (!last) {
+					_last_assign.insert(pk->qdst(), LastSeq());
+					last = _last_assign.findp(pk->qdst());
+				}
+				if (!fresh(*last, pk->seq())) {
+					p_in->kill();
+					return;
 				}
 
-				switch_channel(false, ch_ass);
+				int count = pk->data_len() / sizeof(SR2ChannelAssignment);
+				for (int i = 0; i < count; i++) {
+					SR2ChannelAssignment ch_ass;
+					memcpy(&ch_ass, pk->data() + i * sizeof(SR2ChannelAssignment), sizeof(SR2ChannelAssignment));
+					if (ch_ass._node._ipaddr != _ip) {
+						continue;
+					}
+					if (_debug){
+						click_chatter("%{element} :: Received Channel Assignment %s-%d >> %d\n",
+				      			this, 
+										ch_ass._node._ipaddr.unparse().c_str(),
+										ch_ass._node._iface,
+										ch_ass._new_iface);
+					}
+
+					switch_channel(false, ch_ass);
+				}
+				p_in->kill();
 	      return;
 			} else {
 				// Packet was sent in broadcast but not for me
@@ -688,15 +946,23 @@ SR2ChannelSelectorMulti::push(int, Packet *p_in)
 
   	}
 
+		send_ack(p_in);
+
+		// A resend whose ack got lost, already on its way
+		if (_forwarded.find(pk->qdst(), pk->seq())) {
+			p_in->kill();
+			return;
+		}
+		_forwarded.insert(pk->qdst(), pk->seq(), 0);
+
    	pk->set_next(pk->next() + 1);
 
-		//EtherAddress eth_dest = _arp_table->lookup_def(NodeAddress(pk->get_link_node_b(pk->next()),pk->get_link_if_b(pk->next())));
 		EtherAddress eth_dest = _arp_table->lookup_def(NodeAddress(pk->get_link_node_b(pk->next()),pk->get_link_if_b(pk->next())));
 		EtherAddress my_eth = _if_table->lookup_def();
 		
 		memcpy(eh->ether_dhost, eth_dest.data(), 6);
   	memcpy(eh->ether_shost, my_eth.data(), 6);
-  	output(0).push(p_in);
+  	send_hop(p_in);
   	return;
 
   }
@@ -709,6 +975,8 @@ SR2ChannelSelectorMulti::push(int, Packet *p_in)
 		    _arp_table->insert(NodeAddress(neighbor,neighborif), EtherAddress(eh->ether_shost));
 		  }
 
+			send_ack(p_in);
+
       SR2ChannelChangeWarning ch_warn;
       int data_len = sizeof(SR2ChannelChangeWarning);
       int head_len = pk->len_wo_data(1);
@@ -717,8 +985,21 @@ SR2ChannelSelectorMulti::push(int, Packet *p_in)
 			SR2ChannelAssignment ch_ass = ch_warn._ch_ass;
 			bool start = ch_warn._start;
 			bool scan = ch_warn._scan;
+
+			// Warnings about the same radio only count in order
+			NodeAddress radio = NodeAddress(ch_ass._node._ipaddr, ch_ass._node._iface / 256);
+			LastSeq *last = _last_warn.findp(radio);
+			if (!last) {
+				_last_warn.insert(radio, LastSeq());
+				last = _last_warn.findp(radio);
+			}
+			if (!fresh(*last, pk->seq())) {
+				p_in->kill();
+				return;
+			}
 			
       handle_change_warning(start, scan, ch_ass);
+			p_in->kill();
   		return;
   		
   	}
@@ -745,7 +1026,15 @@ SR2ChannelSelectorMulti::print_cas_stats()
   return sa.take_string();
 }
 
-enum { H_IS_CAS, H_CAS_STATS, H_ALLOW, H_ALLOW_ADD, H_ALLOW_DEL, H_ALLOW_CLEAR, H_IGNORE, H_IGNORE_ADD, H_IGNORE_DEL, H_IGNORE_CLEAR};
+String
+SR2ChannelSelectorMulti::print_ack_stats()
+{
+  StringAccum sa;
+  sa << "stale " << _stale << " duplicates " << _duplicates << " " << _hop_ack.stats();
+  return sa.take_string();
+}
+
+enum { H_IS_CAS, H_CAS_STATS, H_ALLOW, H_ALLOW_ADD, H_ALLOW_DEL, H_ALLOW_CLEAR, H_IGNORE, H_IGNORE_ADD, H_IGNORE_DEL, H_IGNORE_CLEAR, H_SEEN_STATS, H_SWITCH_STATS, H_SWITCH_CMD, H_ACK_STATS, H_SWITCH_TRACE};
 
 String
 SR2ChannelSelectorMulti::read_handler(Element *e, void *thunk)
@@ -756,6 +1045,16 @@ SR2ChannelSelectorMulti::read_handler(Element *e, void *thunk)
     return String(f->_is_cas) + "\n";
   case H_CAS_STATS:
     return f->print_cas_stats();
+  case H_SEEN_STATS:
+    return f->_seen.stats();
+  case H_SWITCH_STATS:
+    return f->_switch_exec.stats();
+  case H_SWITCH_CMD:
+    return f->_switch_cmd + "\n";
+  case H_ACK_STATS:
+    return f->print_ack_stats();
+  case H_SWITCH_TRACE:
+    return f->_trace.unparse();
   case H_IGNORE: {
     StringAccum sa;
     for (IPIter iter = f->_ignore.begin(); iter.live(); iter++) {
@@ -831,6 +1130,27 @@ SR2ChannelSelectorMulti::write_handler(const String &in_s, Element *e, void *vpa
       f->_allow.clear();
       break;
     }
+    case H_SWITCH_STATS: {  
+      f->_switch_exec.reset_stats();
+      break;
+    }
+    case H_SWITCH_CMD: {  
+      String cmd;
+      if (!cp_string(s, &cmd) || !cmd) 
+        return errh->error("switch_cmd parameter must be a command");
+      f->_switch_cmd = cmd;
+      break;
+    }
+    case H_ACK_STATS: {  
+      f->_hop_ack.reset_stats();
+      f->_stale = 0;
+      f->_duplicates = 0;
+      break;
+    }
+    case H_SWITCH_TRACE: {  
+      f->_trace.clear();
+      break;
+    }
   }
   return 0;
 }
@@ -840,8 +1160,13 @@ SR2ChannelSelectorMulti::add_handlers()
 {
   add_read_handler("is_cas", read_handler, (void *) H_IS_CAS);
   add_read_handler("cas_stats", read_handler, (void *) H_CAS_STATS);
+  add_read_handler("seen_stats", read_handler, (void *) H_SEEN_STATS);
   add_read_handler("ignore", read_handler, (void *) H_IGNORE);
   add_read_handler("allow", read_handler, (void *) H_ALLOW);
+  add_read_handler("switch_stats", read_handler, (void *) H_SWITCH_STATS);
+  add_read_handler("switch_cmd", read_handler, (void *) H_SWITCH_CMD);
+  add_read_handler("ack_stats", read_handler, (void *) H_ACK_STATS);
+  add_read_handler("switch_trace", read_handler, (void *) H_SWITCH_TRACE);
 
   add_write_handler("is_cas", write_handler, (void *) H_IS_CAS);
   add_write_handler("ignore_add", write_handler, (void *) H_IGNORE_ADD);
@@ -850,6 +1175,10 @@ SR2ChannelSelectorMulti::add_handlers()
   add_write_handler("allow_add", write_handler, (void *) H_ALLOW_ADD);
   add_write_handler("allow_del", write_handler, (void *) H_ALLOW_DEL);
   add_write_handler("allow_clear", write_handler, (void *) H_ALLOW_CLEAR);
+  add_write_handler("switch_stats", write_handler, (void *) H_SWITCH_STATS);
+  add_write_handler("switch_cmd", write_handler, (void *) H_SWITCH_CMD);
+  add_write_handler("ack_stats", write_handler, (void *) H_ACK_STATS);
+  add_write_handler("switch_trace", write_handler, (void *) H_SWITCH_TRACE);
 }
 
 CLICK_ENDDECLS
@@ -9,12 +9,19 @@
 #include <click/hashmap.hh>
 #include <click/dequeue.hh>
 #include <elements/wifi/path.hh>
+#include "sr2seencachemulti.hh"
+#include "sr2forwardqueuemulti.hh"
+#include "sr2commandexecmulti.hh"
+#include "sr2hopackmulti.hh"
+#include "sr2switchtracemulti.hh"
 CLICK_DECLS
 
 /*
  * =c
  * SR2ChannelSelectorMulti(IP, ETH, ETHTYPE, LinkTable element, ARPTable element,  
- *                    [PERIOD timeout], [GW is_gateway])
+ *                    [PERIOD timeout], [GW is_gateway], [SWITCH_CMD command],
+ *                    [SWITCH_TIMEOUT msec], [ACK_RETRY msec], [ACK_RETRIES n],
+ *                    [WARN_FRESH msec], [TRACE n], [TRACE_TIMEOUT msec])
  * =s Wifi, Wireless Routing
  * Select a gateway to send a packet to based on TCP connection
  * state and metric to gateway.
@@ -23,6 +30,32 @@ CLICK_DECLS
  * Each gateway broadcasts an ad every PERIOD msec.  
  * Non-gateway nodes select the gateway with the best 
  * metric and forward ads.
+ *
+ * Channel switches run SWITCH_CMD in the background, with {dev} and
+ * {channel} replaced by the device name and the new channel (default
+ * "iwconfig {dev} channel {channel}"). The interface stays unavailable
+ * until the command exits or is killed after SWITCH_TIMEOUT msec
+ * (default 5000); only then is the end of switch warning sent.
+ *
+ * Channel assignments and change warnings carry a sequence number and
+ * are acked hop by hop: every hop keeps the packet and sends it again
+ * each ACK_RETRY msec (default 100) until the next hop, or for a
+ * warning every neighbour, has acked it, at most ACK_RETRIES times
+ * (default 3). A warning only waits for the neighbours whose link from
+ * our default radio was updated in the last WARN_FRESH msec (default
+ * 10000). All assignments for a node travel in one packet. A node
+ * ignores assignments older than the last one it got from the same
+ * assigner, and warnings older than the last one about the same radio;
+ * ack_stats counts these as stale and the resends it already had as
+ * duplicates.
+ *
+ * The switch_trace handler shows the timelines of the last TRACE
+ * (default 32) channel switches and scans of this node, its own and
+ * those of its SR2ChannelResponderMulti elements: warning sent,
+ * interface down, tables renumbered, command done, interface up, first
+ * probe heard on the radio after that, and first route through it once
+ * a probe was heard. A radio not heard from or routed through within
+ * TRACE_TIMEOUT msec (default 30000) after coming up is left at '-'.
  */
 
 class SR2ChannelAssignment {
@@ -114,6 +147,7 @@ class SR2ChannelSelectorMulti : public Element {
   /* handler stuff */
   void add_handlers();
   String print_cas_stats();
+  String print_ack_stats();
 
   void push(int, Packet *);
   void run_timer(Timer *);
@@ -130,6 +164,12 @@ class SR2ChannelSelectorMulti : public Element {
   void send_change_warning(bool, bool, SR2ChannelAssignment);
   void handle_change_warning(bool, bool, SR2ChannelAssignment);
   void switch_channel(bool, SR2ChannelAssignment);
+  String switch_command(const String &dev, int channel) const;
+  void send_hop(Packet *);
+  uint32_t trace_begin(NodeAddress radio, uint16_t new_iface, bool scan);
+  void trace_mark(uint32_t id, int event);
+  void trace_fail(uint32_t id) { _trace.fail(id); }
+  uint32_t next_seq() { return ++_seq; }
   static void static_forward_ad_hook(Timer *, void *e) { 
     ((SR2ChannelSelectorMulti *) e)->forward_ad_hook(); 
   }
@@ -139,7 +179,7 @@ private:
   // List of query sequence #s that we've already seen.
   class Seen {
    public:
-    Seen();
+    Seen() : _seq(0), _count(0), _forwarded(false) { }
     Seen(IPAddress cas, u_long seq, int fwd, int rev) {
 	_cas = cas; 
 	_seq = seq; 
@@ -154,7 +194,10 @@ private:
     bool _forwarded;
   };
   
-  DEQueue<Seen> _seen;
+  SR2SeenCacheMulti<Seen> _seen;
+  SR2SeenCacheMulti<int> _forwarded;
+  SR2ForwardQueueMulti _pending;
+  Timer _forward_timer;
 
   class CASInfo {
   public:
@@ -176,6 +219,18 @@ private:
   IPTable _ignore;
   IPTable _allow;
 
+  class LastSeq {
+  public:
+    LastSeq() : _seq(0) { }
+    uint32_t _seq;
+    Timestamp _when;
+  };
+
+  HashMap<IPAddress, LastSeq> _last_assign;
+  HashMap<NodeAddress, LastSeq> _last_warn;
+  uint32_t _stale;
+  uint32_t _duplicates;
+
 	HashMap<int,SR2ScanInfo> _local_scinfo;
 
   bool _is_cas;
@@ -195,10 +250,30 @@ private:
 
   Timer _timer;
 
+  typedef SR2CommandExecMulti<SR2ChannelAssignment> SwitchExec;
+  SwitchExec _switch_exec;
+  Timer _switch_timer;
+  String _switch_cmd;
+
+  SR2HopAckMulti _hop_ack;
+  Timer _ack_timer;
+  unsigned int _warn_fresh; // msecs
+
+  SR2SwitchTraceMulti _trace;
+  Timer _trace_timer;
+  unsigned int _trace_timeout; // msecs
+
   void start_ad();
+  void poll_switches();
+  void finish_switch(const SwitchExec::Job &);
+  void send_ack(Packet *);
+  void resend_hops();
+  void poll_trace();
+  bool fresh(LastSeq &, uint32_t seq);
   void send(WritablePacket *, EtherAddress);
   void forward_ad(Seen *s);
   void forward_ad_hook();
+  void schedule_forward(Seen *s);
   void cleanup();
 
   static int write_handler(const String &, Element *, void *, ErrorHandler *);
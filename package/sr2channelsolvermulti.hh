@@ -0,0 +1,519 @@
+#ifndef CLICK_SR2CHANNELSOLVERMULTI_HH
+#define CLICK_SR2CHANNELSOLVERMULTI_HH
+#include <click/glue.hh>
+#include <click/vector.hh>
+#include <click/timestamp.hh>
+#include "sr2conflictgraphmulti.hh"
+#if CLICK_USERLEVEL && HAVE_MULTITHREAD
+# include <pthread.h>
+#endif
+CLICK_DECLS
+
+/*
+ * Local search over the channels of the radios of a conflict graph.
+ *
+ * Every radio is on exactly one channel, so a node never uses more
+ * channels than it has radios. A link works when both its radios share
+ * a channel c and then costs its traffic on c (plus one) for itself and
+ * again for every working link on c it conflicts with: links that share
+ * a radio with it, or that have a radio hearing one of its radios. A
+ * link whose radios are on different channels costs more than it could
+ * working, so the search only breaks links when that pays off.
+ *
+ * The search starts from whatever channels set_channel() left, normally
+ * the greedy assignment, and never returns anything worse than that.
+ * Moves retune one radio. A move is evaluated on the links within reach
+ * of that radio only, which keeps each evaluation O(deg * conflicts).
+ *
+ * Tabu scores each sample of 32 moves with up to threads threads, the
+ * caller's included, each thread taking every threads-th move with its
+ * own scratch. The sample is drawn and the move picked by the caller, so
+ * the result does not depend on the thread count. Threads only exist in
+ * multithreaded user-level builds, elsewhere the sample is scored inline.
+ */
+class SR2ChannelSolverMulti {
+  public:
+
+    enum { GREEDY, TABU, ANNEALING, NALGORITHMS };
+
+    static const char *algorithm_name(int algorithm) {
+      switch (algorithm) {
+      case GREEDY: return "greedy";
+      case TABU: return "tabu";
+      case ANNEALING: return "annealing";
+      default: return "unknown";
+      }
+    }
+
+    SR2ChannelSolverMulti(SR2ConflictGraphMulti &g, uint32_t default_channel)
+      : _g(g), _moves(0), _accepted(0), _algorithm(GREEDY), _iter(0) {
+      /* the channels anyone reported, but the default one */
+      Vector<int> seen(256, 0);
+      for (int l = 0; l < _g.links(); l++) {
+	const Vector<SR2ConflictGraphMulti::ChannelLoad> &c = _g.link(l)._channels;
+	for (int x = 0; x < c.size(); x++) {
+	  uint32_t ch = c[x]._channel;
+	  if (ch < 256 && ch != default_channel && !seen[ch]) {
+	    seen[ch] = 1;
+	    _channels.push_back(ch);
+	  }
+	}
+      }
+
+      /* links in conflict with each link, both ways */
+      Vector<int> stamp(_g.links(), -1);
+      Vector<int> near;
+      _conflicts.resize(_g.links());
+      _broken.resize(_g.links());
+      for (int l = 0; l < _g.links(); l++) {
+	const SR2ConflictGraphMulti::Link &link = _g.link(l);
+	near.clear();
+	near.push_back(link._a);
+	near.push_back(link._b);
+	for (int e = 0; e < 2; e++) {
+	  const Vector<int> &inc = _g.incident(e ? link._b : link._a);
+	  for (int x = 0; x < inc.size(); x++) {
+	    const SR2ConflictGraphMulti::Link &m = _g.link(inc[x]);
+	    near.push_back(m._a);
+	    near.push_back(m._b);
+	  }
+	}
+	stamp[l] = l;
+	for (int x = 0; x < near.size(); x++) {
+	  const Vector<int> &inc = _g.incident(near[x]);
+	  for (int y = 0; y < inc.size(); y++) {
+	    if (stamp[inc[y]] != l) {
+	      stamp[inc[y]] = l;
+	      _conflicts[l].push_back(inc[y]);
+	    }
+	  }
+	}
+	uint32_t max_traffic = 0;
+	for (int x = 0; x < link._channels.size(); x++) {
+	  if (link._channels[x]._traffic > max_traffic) {
+	    max_traffic = link._channels[x]._traffic;
+	  }
+	}
+	_broken[l] = 4 * ((int64_t) max_traffic + 1) * (_conflicts[l].size() + 1);
+      }
+
+      _x.resize(_g.nodes());
+      for (int n = 0; n < _g.nodes(); n++) {
+	_x[n] = _g.node(n)._iface % 256;
+      }
+      _scratch.resize(1);
+      _scratch[0].reset(_g.links());
+    }
+
+    ~SR2ChannelSolverMulti() {
+      stop_workers();
+    }
+
+    /* channel of every radio, by radio id */
+    const Vector<uint32_t> &channels() const { return _x; }
+    void set_channel(int n, uint32_t channel) { _x[n] = channel; }
+    uint32_t moves() const { return _moves; }
+    uint32_t accepted() const { return _accepted; }
+
+    int64_t objective() const {
+      int64_t total = 0;
+      for (int l = 0; l < _g.links(); l++) {
+	total += cost(l, -1, 0);
+      }
+      return total;
+    }
+
+    /*
+     * cost change of moving radios nodes[i] to channels[i] together,
+     * *before gets the current cost of the links that can change
+     */
+    int64_t group_delta(const Vector<int> &nodes, const Vector<uint32_t> &channels, int64_t *before) {
+      Scratch &s = _scratch[0];
+      s._epoch++;
+      s._touched.clear();
+      for (int i = 0; i < nodes.size(); i++) {
+	touch(nodes[i], s);
+      }
+      Vector<uint32_t> old;
+      int64_t b = 0, after = 0;
+      for (int x = 0; x < s._touched.size(); x++) {
+	b += cost(s._touched[x], -1, 0);
+      }
+      for (int i = 0; i < nodes.size(); i++) {
+	old.push_back(_x[nodes[i]]);
+	_x[nodes[i]] = channels[i];
+      }
+      for (int x = 0; x < s._touched.size(); x++) {
+	after += cost(s._touched[x], -1, 0);
+      }
+      for (int i = 0; i < nodes.size(); i++) {
+	_x[nodes[i]] = old[i];
+      }
+      *before = b;
+      return after - b;
+    }
+
+    /* searches until budget has passed, leaves the best channels found */
+    void run(int algorithm, const Timestamp &budget, int threads = 1) {
+      start(algorithm, threads);
+      step(budget);
+      finish();
+    }
+
+    /*
+     * run() in pieces: start(), then step() as often as wanted, each
+     * searching for about slice, then finish(). The graph must not
+     * change in between. Tabu workers live from start() to finish().
+     */
+    void start(int algorithm, int threads = 1) {
+      _algorithm = algorithm;
+      _radios.clear();
+      _iter = 0;
+      if (!_channels.size() || !_g.links()) {
+	return;
+      }
+      if (algorithm == TABU) {
+	start_workers(threads);
+      }
+      for (int n = 0; n < _g.nodes(); n++) {
+	if (_g.incident(n).size()) {
+	  _radios.push_back(n);
+	}
+      }
+      _current = objective();
+      _best = _current;
+      _best_x = _x;
+
+      _tabu_until.assign(_g.nodes(), 0);
+      _tenure = _radios.size() / 4 + 1;
+      if (_tenure > 10) {
+	_tenure = 10;
+      }
+      _temperature = _current / (_g.links() + 1) + 1;
+    }
+
+    void step(const Timestamp &slice) {
+      if (!_radios.size()) {
+	return;
+      }
+      Timestamp deadline = Timestamp::now() + slice;
+      /* a tabu step scores 32 moves, worth a clock read each */
+      int check = (_algorithm == TABU) ? 0 : 15;
+      for (;;) {
+	_iter++;
+	if ((_iter & check) == 0 && !(Timestamp::now() < deadline)) {
+	  break;
+	}
+	if (_algorithm == TABU) {
+	  /* best of a sample of moves, tabu radios only if they beat best */
+	  _sample_n.clear();
+	  _sample_c.clear();
+	  for (int s = 0; s < 32; s++) {
+	    int n = _radios[click_random(0, _radios.size() - 1)];
+	    uint32_t c = _channels[click_random(0, _channels.size() - 1)];
+	    if (c != _x[n]) {
+	      _sample_n.push_back(n);
+	      _sample_c.push_back(c);
+	    }
+	  }
+	  _sample_d.resize(_sample_n.size());
+	  score_sample();
+	  _moves += _sample_n.size();
+	  int move_n = -1;
+	  uint32_t move_c = 0;
+	  int64_t move_delta = 0;
+	  for (int s = 0; s < _sample_n.size(); s++) {
+	    int n = _sample_n[s];
+	    uint32_t c = _sample_c[s];
+	    int64_t d = _sample_d[s];
+	    if (_tabu_until[n] > _iter && _current + d >= _best) {
+	      continue;
+	    }
+	    if (move_n < 0 || d < move_delta) {
+	      move_n = n;
+	      move_c = c;
+	      move_delta = d;
+	    }
+	  }
+	  if (move_n < 0) {
+	    continue;
+	  }
+	  _x[move_n] = move_c;
+	  _tabu_until[move_n] = _iter + _tenure;
+	  _current += move_delta;
+	  _accepted++;
+	} else {
+	  int n = _radios[click_random(0, _radios.size() - 1)];
+	  uint32_t c = _channels[click_random(0, _channels.size() - 1)];
+	  if (c == _x[n]) {
+	    continue;
+	  }
+	  int64_t d = delta(n, c, _scratch[0]);
+	  _moves++;
+	  /*
+	   * a worse move goes through with odds T / (T + delta), which
+	   * behaves like exp(-delta / T) without floating point
+	   */
+	  bool accept = (d <= 0);
+	  if (!accept && _temperature > 0) {
+	    int64_t range = _temperature + d;
+	    if (range > 0x7fffffff) {
+	      range = 0x7fffffff;
+	    }
+	    accept = click_random(0, range) < _temperature;
+	  }
+	  if (accept) {
+	    _x[n] = c;
+	    _current += d;
+	    _accepted++;
+	  }
+	  if ((_iter & 63) == 0) {
+	    _temperature = _temperature * 15 / 16;
+	  }
+	}
+	if (_current < _best) {
+	  _best = _current;
+	  _best_x = _x;
+	}
+      }
+    }
+
+    void finish() {
+      stop_workers();
+      if (_radios.size()) {
+	_x = _best_x;
+	_radios.clear();
+      }
+    }
+
+  private:
+
+    SR2ConflictGraphMulti &_g;
+    Vector<uint32_t> _channels;
+    Vector< Vector<int> > _conflicts;
+    Vector<int64_t> _broken;
+    Vector<uint32_t> _x;
+    uint32_t _moves;
+    uint32_t _accepted;
+
+    /* search state kept between step()s */
+    int _algorithm;
+    Vector<int> _radios;
+    int _iter;
+    int64_t _current;
+    int64_t _best;
+    Vector<uint32_t> _best_x;
+    Vector<int> _tabu_until;
+    int _tenure;
+    int64_t _temperature;
+
+    /* per thread state of a move evaluation */
+    class Scratch {
+      public:
+	Vector<int> _stamp;
+	Vector<int> _touched;
+	int _epoch;
+	void reset(int links) {
+	  _stamp.assign(links, -1);
+	  _touched.clear();
+	  _epoch = 0;
+	}
+    };
+    Vector<Scratch> _scratch; // one per thread
+
+    /* the tabu sample and the cost change of each move */
+    Vector<int> _sample_n;
+    Vector<uint32_t> _sample_c;
+    Vector<int64_t> _sample_d;
+
+#if CLICK_USERLEVEL && HAVE_MULTITHREAD
+    class Worker {
+      public:
+	SR2ChannelSolverMulti *_solver;
+	int _id;
+	pthread_t _thread;
+    };
+    Vector<Worker> _workers;
+    pthread_mutex_t _mutex;
+    pthread_cond_t _go;
+    pthread_cond_t _done;
+    int _round;  // bumped for every sample handed out
+    int _busy;   // workers still scoring the current sample
+    bool _quit;
+#endif
+
+    /* channel of radio r once radio n is on channel c, n < 0 for none */
+    uint32_t channel(int r, int n, uint32_t c) const {
+      return r == n ? c : _x[r];
+    }
+
+    bool works(int l, uint32_t channel_on, int n, uint32_t c) const {
+      const SR2ConflictGraphMulti::Link &link = _g.link(l);
+      return channel(link._a, n, c) == channel_on && channel(link._b, n, c) == channel_on;
+    }
+
+    /* cost of link l once radio n is on channel c, n < 0 for as is */
+    int64_t cost(int l, int n, uint32_t c) const {
+      const SR2ConflictGraphMulti::Link &link = _g.link(l);
+      uint32_t ch = channel(link._a, n, c);
+      if (channel(link._b, n, c) != ch) {
+	return _broken[l];
+      }
+      int64_t k = 1;
+      const Vector<int> &conf = _conflicts[l];
+      for (int x = 0; x < conf.size(); x++) {
+	if (works(conf[x], ch, n, c)) {
+	  k++;
+	}
+      }
+      return ((int64_t) link.traffic(ch) + 1) * k;
+    }
+
+    /* appends the links of radio n and their conflicts not stamped yet */
+    void touch(int n, Scratch &s) const {
+      const Vector<int> &inc = _g.incident(n);
+      for (int x = 0; x < inc.size(); x++) {
+	if (s._stamp[inc[x]] != s._epoch) {
+	  s._stamp[inc[x]] = s._epoch;
+	  s._touched.push_back(inc[x]);
+	}
+	const Vector<int> &conf = _conflicts[inc[x]];
+	for (int y = 0; y < conf.size(); y++) {
+	  if (s._stamp[conf[y]] != s._epoch) {
+	    s._stamp[conf[y]] = s._epoch;
+	    s._touched.push_back(conf[y]);
+	  }
+	}
+      }
+    }
+
+    /*
+     * cost change of moving radio n to channel c: only links of n and the
+     * links in conflict with them can change. Reads _x only, so threads
+     * with their own scratch can run it side by side.
+     */
+    int64_t delta(int n, uint32_t c, Scratch &s) const {
+      s._epoch++;
+      s._touched.clear();
+      touch(n, s);
+      int64_t before = 0, after = 0;
+      for (int x = 0; x < s._touched.size(); x++) {
+	before += cost(s._touched[x], -1, 0);
+	after += cost(s._touched[x], n, c);
+      }
+      return after - before;
+    }
+
+    /* scores the moves of the sample that fall to thread id */
+    void score_share(int id) {
+      int stride = _scratch.size();
+      for (int s = id; s < _sample_n.size(); s += stride) {
+	_sample_d[s] = delta(_sample_n[s], _sample_c[s], _scratch[id]);
+      }
+    }
+
+#if CLICK_USERLEVEL && HAVE_MULTITHREAD
+    static void *worker_main(void *arg) {
+      Worker *w = (Worker *) arg;
+      SR2ChannelSolverMulti *solver = w->_solver;
+      int seen = 0;
+      pthread_mutex_lock(&solver->_mutex);
+      while (1) {
+	while (solver->_round == seen && !solver->_quit) {
+	  pthread_cond_wait(&solver->_go, &solver->_mutex);
+	}
+	if (solver->_quit) {
+	  break;
+	}
+	seen = solver->_round;
+	pthread_mutex_unlock(&solver->_mutex);
+	solver->score_share(w->_id);
+	pthread_mutex_lock(&solver->_mutex);
+	if (--solver->_busy == 0) {
+	  pthread_cond_signal(&solver->_done);
+	}
+      }
+      pthread_mutex_unlock(&solver->_mutex);
+      return 0;
+    }
+#endif
+
+    /* starts threads - 1 workers, fewer if the system refuses more */
+    void start_workers(int threads) {
+#if CLICK_USERLEVEL && HAVE_MULTITHREAD
+      if (threads < 2) {
+	return;
+      }
+      pthread_mutex_init(&_mutex, 0);
+      pthread_cond_init(&_go, 0);
+      pthread_cond_init(&_done, 0);
+      _round = 0;
+      _busy = 0;
+      _quit = false;
+      /* sized once, workers keep pointers into both */
+      _scratch.resize(threads);
+      for (int x = 1; x < _scratch.size(); x++) {
+	_scratch[x].reset(_g.links());
+      }
+      _workers.resize(threads - 1);
+      int started = 0;
+      for (; started < _workers.size(); started++) {
+	Worker &w = _workers[started];
+	w._solver = this;
+	w._id = started + 1;
+	if (pthread_create(&w._thread, 0, worker_main, &w) != 0) {
+	  break;
+	}
+      }
+      _workers.resize(started);
+      _scratch.resize(started + 1);
+#else
+      (void) threads;
+#endif
+    }
+
+    void stop_workers() {
+#if CLICK_USERLEVEL && HAVE_MULTITHREAD
+      if (!_workers.size()) {
+	return;
+      }
+      pthread_mutex_lock(&_mutex);
+      _quit = true;
+      pthread_cond_broadcast(&_go);
+      pthread_mutex_unlock(&_mutex);
+      for (int x = 0; x < _workers.size(); x++) {
+	pthread_join(_workers[x]._thread, 0);
+      }
+      _workers.clear();
+      _scratch.resize(1);
+      pthread_cond_destroy(&_done);
+      pthread_cond_destroy(&_go);
+      pthread_mutex_destroy(&_mutex);
+#endif
+    }
+
+    /* fills _sample_d, the workers take their share of the sample */
+    void score_sample() {
+#if CLICK_USERLEVEL && HAVE_MULTITHREAD
+      if (_workers.size()) {
+	pthread_mutex_lock(&_mutex);
+	_round++;
+	_busy = _workers.size();
+	pthread_cond_broadcast(&_go);
+	pthread_mutex_unlock(&_mutex);
+	score_share(0);
+	pthread_mutex_lock(&_mutex);
+	while (_busy) {
+	  pthread_cond_wait(&_done, &_mutex);
+	}
+	pthread_mutex_unlock(&_mutex);
+	return;
+      }
+#endif
+      score_share(0);
+    }
+
+};
+
+CLICK_ENDDECLS
+#endif
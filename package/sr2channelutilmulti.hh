@@ -0,0 +1,105 @@
+#ifndef CLICK_SR2CHANNELUTILMULTI_HH
+#define CLICK_SR2CHANNELUTILMULTI_HH
+#include <click/glue.hh>
+#include <click/hashmap.hh>
+#include <click/vector.hh>
+#include <click/straccum.hh>
+CLICK_DECLS
+
+/*
+ * Channel utilisation seen while scanning, in permille of airtime.
+ *
+ * Every dwell on a channel gives one sample. Per channel we keep the
+ * last sample, an EWMA across scan rounds (ALPHA percent of weight on
+ * the new sample), the peak, and a histogram of samples in buckets of
+ * 100 permille.
+ */
+class SR2ChannelUtilMulti {
+  public:
+
+    enum { BUCKETS = 10 };
+
+    class Stats {
+      public:
+	Stats() : _samples(0), _last(0), _ewma(0), _peak(0) {
+	  memset(_hist, 0, sizeof(_hist));
+	}
+	uint32_t _samples;
+	int _last;
+	int _ewma; /* permille * 100 */
+	int _peak;
+	uint32_t _hist[BUCKETS];
+
+	int ewma() const { return (_ewma + 50) / 100; }
+    };
+
+    SR2ChannelUtilMulti() : _alpha(25) { }
+
+    void set_alpha(int alpha) { _alpha = alpha; }
+    int alpha() const { return _alpha; }
+    void clear() { _stats.clear(); }
+
+    const Stats *find(int channel) const { return _stats.findp(channel); }
+
+    /* adds a sample, returns the new EWMA */
+    int update(int channel, int permille) {
+      if (permille < 0) {
+	permille = 0;
+      }
+      if (permille > 1000) {
+	permille = 1000;
+      }
+      Stats *s = _stats.findp(channel);
+      if (!s) {
+	_stats.insert(channel, Stats());
+	s = _stats.findp(channel);
+	s->_ewma = permille * 100;
+      } else {
+	s->_ewma = (_alpha * permille * 100 + (100 - _alpha) * s->_ewma) / 100;
+      }
+      s->_samples++;
+      s->_last = permille;
+      if (permille > s->_peak) {
+	s->_peak = permille;
+      }
+      int b = permille * BUCKETS / 1000;
+      s->_hist[b < BUCKETS ? b : BUCKETS - 1]++;
+      return s->ewma();
+    }
+
+    String unparse() const {
+      Vector<int> channels;
+      for (HashMap<int, Stats>::const_iterator iter = _stats.begin(); iter.live(); iter++) {
+	channels.push_back(iter.key());
+      }
+      click_qsort(channels.begin(), channels.size(), sizeof(int), channel_sorter, 0);
+      StringAccum sa;
+      for (int x = 0; x < channels.size(); x++) {
+	const Stats *s = _stats.findp(channels[x]);
+	sa << "channel " << channels[x];
+	sa << " samples " << s->_samples;
+	sa << " last " << s->_last;
+	sa << " ewma " << s->ewma();
+	sa << " peak " << s->_peak;
+	sa << " hist";
+	for (int b = 0; b < BUCKETS; b++) {
+	  sa << " " << s->_hist[b];
+	}
+	sa << "\n";
+      }
+      return sa.take_string();
+    }
+
+  private:
+
+    HashMap<int, Stats> _stats;
+    int _alpha; /* percent */
+
+    static int channel_sorter(const void *va, const void *vb, void *) {
+      return *(const int *) va - *(const int *) vb;
+    }
+
+};
+
+CLICK_ENDDECLS
+#endif
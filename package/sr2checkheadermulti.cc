@@ -66,7 +66,7 @@ SR2CheckHeaderMulti::simple_action(Packet *p)
     p->kill();
     return 0;
   }
-  if ((pk->_type & SR2_PT_DATA) || (pk->_type & SR2_PT_CHSCINFO) || (pk->_type & SR2_PT_CHASSIGN) || (pk->_type & SR2_PT_CHNGWARN)) {
+  if ((pk->_type & SR2_PT_DATA) || (pk->_type & SR2_PT_CHSCINFO) || (pk->_type & SR2_PT_CHASSIGN) || (pk->_type & SR2_PT_CHNGWARN) || (pk->_type == SR2_PT_GATEWAY) || (pk->_type == SR2_PT_MQUERY)) {
     tlen = pk->hlen_with_data();
   } else {
     tlen = pk->hlen_wo_data();
@@ -0,0 +1,181 @@
+#ifndef CLICK_SR2COMMANDEXECMULTI_HH
+#define CLICK_SR2COMMANDEXECMULTI_HH
+#include <click/glue.hh>
+#include <click/string.hh>
+#include <click/timestamp.hh>
+#include <click/vector.hh>
+#include <click/straccum.hh>
+#include <spawn.h>
+#include <signal.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+extern char **environ;
+CLICK_DECLS
+
+/*
+ * Runs shell commands without waiting for them.
+ *
+ * submit() starts the command through posix_spawn() and returns at
+ * once; the owner calls poll() from a timer every POLL msec to reap
+ * finished commands, which come back with their data in submission
+ * order per key. Commands with the same key (a device name, say) run
+ * one at a time, others run side by side. A command running longer
+ * than the timeout is killed and reported as timed out.
+ */
+template <typename T>
+class SR2CommandExecMulti {
+  public:
+
+    enum { POLL = 10 };
+
+    class Job {
+      public:
+	Job() : _pid(-1), _status(-1), _spawned(false), _timed_out(false) { }
+	String _key;
+	String _command;
+	T _data;
+	pid_t _pid;
+	int _status;
+	bool _spawned;
+	bool _timed_out;
+	Timestamp _queued;
+	Timestamp _started;
+	Timestamp _done;
+
+	/* the command ran and exited with 0 */
+	bool ok() const {
+	  return _spawned && !_timed_out && WIFEXITED(_status) && WEXITSTATUS(_status) == 0;
+	}
+    };
+
+    SR2CommandExecMulti() : _timeout(5000), _submitted(0), _completed(0),
+			    _failed(0), _timed_out(0) { }
+
+    ~SR2CommandExecMulti() {
+      for (int x = 0; x < _jobs.size(); x++) {
+	if (_jobs[x]._pid > 0) {
+	  kill(_jobs[x]._pid, SIGKILL);
+	  waitpid(_jobs[x]._pid, 0, 0);
+	}
+      }
+    }
+
+    void set_timeout(unsigned msec) { _timeout = msec; }
+    unsigned timeout() const { return _timeout; }
+    int pending() const { return _jobs.size(); }
+
+    void submit(const String &key, const String &command, const T &data) {
+      Job j;
+      j._key = key;
+      j._command = command;
+      j._data = data;
+      j._queued = Timestamp::now();
+      _jobs.push_back(j);
+      _submitted++;
+      start_ready();
+    }
+
+    /*
+     * moves finished commands to done and starts the ones they held
+     * back, returns the number of commands still queued or running
+     */
+    int poll(Vector<Job> &done) {
+      Timestamp now = Timestamp::now();
+      Timestamp limit = Timestamp::make_msec(_timeout);
+      Vector<Job> left;
+      for (int x = 0; x < _jobs.size(); x++) {
+	Job &j = _jobs[x];
+	if (j._pid > 0) {
+	  int status;
+	  pid_t r = waitpid(j._pid, &status, WNOHANG);
+	  if (r == 0 && now - j._started > limit) {
+	    kill(j._pid, SIGKILL);
+	    r = waitpid(j._pid, &status, 0);
+	    j._timed_out = true;
+	    _timed_out++;
+	  }
+	  if (r == 0) {
+	    left.push_back(j);
+	    continue;
+	  }
+	  j._status = (r == j._pid) ? status : -1;
+	  j._pid = -1;
+	} else if (!j._started) {
+	  left.push_back(j);
+	  continue;
+	}
+	/* here the command finished, or posix_spawn() failed */
+	j._done = now;
+	if (j.ok()) {
+	  _completed++;
+	} else {
+	  _failed++;
+	}
+	_duration_total += j._done - j._started;
+	if (_duration_max < j._done - j._started) {
+	  _duration_max = j._done - j._started;
+	}
+	done.push_back(j);
+      }
+      _jobs.swap(left);
+      start_ready();
+      return _jobs.size();
+    }
+
+    void reset_stats() {
+      _submitted = _completed = _failed = _timed_out = 0;
+      _duration_total = _duration_max = Timestamp();
+    }
+
+    String stats() const {
+      StringAccum sa;
+      uint32_t finished = _completed + _failed;
+      sa << "submitted " << _submitted;
+      sa << " completed " << _completed;
+      sa << " failed " << _failed;
+      sa << " timed_out " << _timed_out;
+      sa << " pending " << _jobs.size();
+      sa << " avg_msec " << (finished ? _duration_total.msecval() / finished : 0);
+      sa << " max_msec " << _duration_max.msecval() << "\n";
+      return sa.take_string();
+    }
+
+  private:
+
+    Vector<Job> _jobs;
+    unsigned _timeout; // msecs
+
+    uint32_t _submitted;
+    uint32_t _completed;
+    uint32_t _failed;
+    uint32_t _timed_out;
+    Timestamp _duration_total;
+    Timestamp _duration_max;
+
+    /* start every queued job that no earlier job with its key holds back */
+    void start_ready() {
+      for (int x = 0; x < _jobs.size(); x++) {
+	Job &j = _jobs[x];
+	if (j._started) {
+	  continue;
+	}
+	bool blocked = false;
+	for (int y = 0; y < x && !blocked; y++) {
+	  blocked = (_jobs[y]._key == j._key);
+	}
+	if (blocked) {
+	  continue;
+	}
+	const char *argv[] = { "/bin/sh", "-c", j._command.c_str(), 0 };
+	j._started = Timestamp::now();
+	j._spawned = (posix_spawn(&j._pid, "/bin/sh", 0, 0, (char * const *) argv, environ) == 0);
+	if (!j._spawned) {
+	  j._pid = -1;
+	}
+      }
+    }
+
+};
+
+CLICK_ENDDECLS
+#endif
@@ -0,0 +1,254 @@
+#ifndef CLICK_SR2CONFLICTGRAPHMULTI_HH
+#define CLICK_SR2CONFLICTGRAPHMULTI_HH
+#include <click/glue.hh>
+#include <click/vector.hh>
+#include <click/hashmap.hh>
+#include "sr2nodemulti.hh"
+#include "sr2linktablemulti.hh"
+CLICK_DECLS
+
+/*
+ * Multi-channel conflict graph for SR2ChannelAssignerMulti.
+ *
+ * Radios (NodeAddress) and the links between them get dense ids, each
+ * radio keeps the ids of the links incident to it. Links are visited in
+ * (hop_count, delay) order through a binary min-heap. Removed links stay
+ * in place, marked dead, and are skipped by the heap and the incidence
+ * lists, so removing the links of a radio costs O(deg) and visiting the
+ * next link O(log L).
+ */
+class SR2ConflictGraphMulti {
+  public:
+
+    class ChannelLoad {
+      public:
+	ChannelLoad() : _channel(0), _traffic(0) { }
+	ChannelLoad(uint32_t channel, uint32_t traffic)
+	  : _channel(channel), _traffic(traffic) { }
+	uint32_t _channel;
+	uint32_t _traffic;
+    };
+
+    class Link {
+      public:
+	Link() : _a(-1), _b(-1), _hop_count(0), _hop_from(0), _hop_to(0),
+		 _delay(0), _live(false) { }
+	NodeAddress _from;
+	NodeAddress _to;
+	int _a;
+	int _b;
+	uint32_t _hop_count;
+	uint32_t _hop_from;
+	uint32_t _hop_to;
+	uint32_t _delay;
+	bool _live;
+	Vector<ChannelLoad> _channels;
+
+	void update_channel(uint32_t channel, uint32_t traffic) {
+	  for (int x = 0; x < _channels.size(); x++) {
+	    if (_channels[x]._channel == channel) {
+	      _channels[x]._traffic += traffic;
+	      return;
+	    }
+	  }
+	  _channels.push_back(ChannelLoad(channel, traffic));
+	}
+	/* the least loaded channel other than skip, 1 if there is none */
+	uint32_t best_channel(uint32_t skip) const {
+	  int best = -1;
+	  for (int x = 0; x < _channels.size(); x++) {
+	    if (_channels[x]._channel == skip) {
+	      continue;
+	    }
+	    if (best < 0 || _channels[x]._traffic < _channels[best]._traffic) {
+	      best = x;
+	    }
+	  }
+	  return (best < 0) ? 1 : _channels[best]._channel;
+	}
+	/* traffic seen on channel by either end, 0 if not reported */
+	uint32_t traffic(uint32_t channel) const {
+	  for (int x = 0; x < _channels.size(); x++) {
+	    if (_channels[x]._channel == channel) {
+	      return _channels[x]._traffic;
+	    }
+	  }
+	  return 0;
+	}
+    };
+
+    SR2ConflictGraphMulti() : _live(0) { }
+
+    void clear() {
+      _nodes.clear();
+      _node_ids.clear();
+      _incident.clear();
+      _links.clear();
+      _link_ids.clear();
+      _heap.clear();
+      _live = 0;
+    }
+
+    int nodes() const { return _nodes.size(); }
+    int links() const { return _links.size(); }
+    /* links not removed yet */
+    int size() const { return _live; }
+
+    const NodeAddress &node(int n) const { return _nodes[n]; }
+    Link &link(int l) { return _links[l]; }
+    const Link &link(int l) const { return _links[l]; }
+    const Vector<int> &incident(int n) const { return _incident[n]; }
+
+    int find_node(const NodeAddress &node) const {
+      const int *n = _node_ids.findp(node);
+      return n ? *n : -1;
+    }
+
+    int add_node(const NodeAddress &node) {
+      int n = find_node(node);
+      if (n < 0) {
+	n = _nodes.size();
+	_nodes.push_back(node);
+	_node_ids.insert(node, n);
+	_incident.push_back(Vector<int>());
+      }
+      return n;
+    }
+
+    /* the link between from and to, in either direction, or -1 */
+    int find_link(const NodeAddress &from, const NodeAddress &to) const {
+      const int *l = _link_ids.findp(NodePair(from, to));
+      if (!l) {
+	l = _link_ids.findp(NodePair(to, from));
+      }
+      return l ? *l : -1;
+    }
+
+    /* caller must have checked find_link() */
+    Link &add_link(const NodeAddress &from, const NodeAddress &to) {
+      int l = _links.size();
+      _links.push_back(Link());
+      Link &link = _links.back();
+      link._from = from;
+      link._to = to;
+      link._a = add_node(from);
+      link._b = add_node(to);
+      link._live = true;
+      _incident[link._a].push_back(l);
+      _incident[link._b].push_back(l);
+      _link_ids.insert(NodePair(from, to), l);
+      _live++;
+      return link;
+    }
+
+    /* call once all links are in, before next_link() */
+    void build_heap() {
+      _heap.clear();
+      for (int l = 0; l < _links.size(); l++) {
+	if (_links[l]._live) {
+	  heap_push(l);
+	}
+      }
+    }
+
+    /* the live link with the smallest (hop_count, delay), or -1 */
+    int next_link() {
+      while (_heap.size()) {
+	int l = _heap[0];
+	heap_pop();
+	if (_links[l]._live) {
+	  return l;
+	}
+      }
+      return -1;
+    }
+
+    void remove_link(int l) {
+      if (_links[l]._live) {
+	_links[l]._live = false;
+	_live--;
+      }
+    }
+
+    /*
+     * removes every live link of radio n, appending the radio at the
+     * other end of each to others
+     */
+    void remove_node_links(int n, Vector<int> &others) {
+      const Vector<int> &inc = _incident[n];
+      for (int x = 0; x < inc.size(); x++) {
+	Link &link = _links[inc[x]];
+	if (!link._live) {
+	  continue;
+	}
+	remove_link(inc[x]);
+	others.push_back(link._a == n ? link._b : link._a);
+      }
+    }
+
+  private:
+
+    Vector<NodeAddress> _nodes;
+    HashMap<NodeAddress, int> _node_ids;
+    Vector< Vector<int> > _incident;
+    Vector<Link> _links;
+    HashMap<NodePair, int> _link_ids;
+    Vector<int> _heap;
+    int _live;
+
+    bool before(int a, int b) const {
+      const Link &la = _links[a];
+      const Link &lb = _links[b];
+      if (la._hop_count != lb._hop_count) {
+	return la._hop_count < lb._hop_count;
+      }
+      if (la._delay != lb._delay) {
+	return la._delay < lb._delay;
+      }
+      return a < b;
+    }
+
+    void heap_push(int l) {
+      _heap.push_back(l);
+      int x = _heap.size() - 1;
+      while (x > 0) {
+	int p = (x - 1) / 2;
+	if (!before(_heap[x], _heap[p])) {
+	  break;
+	}
+	int t = _heap[x];
+	_heap[x] = _heap[p];
+	_heap[p] = t;
+	x = p;
+      }
+    }
+
+    void heap_pop() {
+      _heap[0] = _heap.back();
+      _heap.pop_back();
+      int n = _heap.size();
+      int x = 0;
+      for (;;) {
+	int l = 2 * x + 1;
+	int r = l + 1;
+	int m = x;
+	if (l < n && before(_heap[l], _heap[m])) {
+	  m = l;
+	}
+	if (r < n && before(_heap[r], _heap[m])) {
+	  m = r;
+	}
+	if (m == x) {
+	  break;
+	}
+	int t = _heap[x];
+	_heap[x] = _heap[m];
+	_heap[m] = t;
+	x = m;
+      }
+    }
+
+};
+
+CLICK_ENDDECLS
+#endif
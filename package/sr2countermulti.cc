@@ -26,7 +26,7 @@
 CLICK_DECLS
 
 SR2CounterMulti::SR2CounterMulti()
-  : _count(0), _byte_count(0)
+  : _count(0), _byte_count(0), _busy_time(0), _discard(false)
 {
 }
 
@@ -49,7 +49,17 @@ SR2CounterMulti::read_byte_count()
 uint32_t
 SR2CounterMulti::read_busy_time()
 {
-  return _byte_count;
+  return _busy_time;
+}
+
+int
+SR2CounterMulti::read_utilisation()
+{
+  int64_t elapsed = (Timestamp::now() - _since).usecval();
+  if (elapsed <= 0)
+    return 0;
+  int64_t permille = (int64_t) _busy_time * 1000 / elapsed;
+  return permille > 1000 ? 1000 : (int) permille;
 }
 
 void
@@ -58,6 +68,31 @@ SR2CounterMulti::reset()
 	_count = 0;
 	_byte_count = 0;
 	_busy_time = 0;
+	_since = Timestamp::now();
+}
+
+unsigned
+SR2CounterMulti::airtime(Packet *p)
+{
+  struct click_wifi_extra *ceh = WIFI_EXTRA_ANNO(p);
+  int rate = ceh->rate ? ceh->rate : 2;
+  unsigned usecs = calc_transmit_time(rate, p->length());
+  if (p->length() < sizeof(struct click_wifi))
+    return usecs;
+  const struct click_wifi *w = (const struct click_wifi *) p->data();
+  if ((w->i_fc[0] & WIFI_FC0_TYPE_MASK) == WIFI_FC0_TYPE_CTL) {
+    /* an ACK was charged with the frame it answers */
+    if ((w->i_fc[0] & WIFI_FC0_SUBTYPE_MASK) == WIFI_FC0_SUBTYPE_ACK)
+      return 0;
+    return usecs;
+  }
+  if (!(w->i_addr1[0] & 1)) {
+    if (is_b_rate(rate))
+      usecs += WIFI_SIFS_B + WIFI_ACK_B;
+    else
+      usecs += WIFI_SIFS_A + WIFI_ACK_A;
+  }
+  return usecs;
 }
 
 int
@@ -75,11 +110,9 @@ SR2CounterMulti::push(int, Packet *p)
     if (!_discard){
         output(0).push(p);
     } else {
-				struct click_wifi_extra *ceh = WIFI_EXTRA_ANNO(p);
-				int busy_time = calc_transmit_time(ceh->rate,p->length());
 		    _count++;
 		    _byte_count += p->length();
-				_busy_time += busy_time;
+				_busy_time += airtime(p);
         output(1).push(p);
     }
     
@@ -94,7 +127,7 @@ SR2CounterMulti::set_discard(bool discard)
     
 }
 
-enum { H_COUNT, H_BYTE_COUNT, H_BUSY_TIME, H_RESET };
+enum { H_COUNT, H_BYTE_COUNT, H_BUSY_TIME, H_UTILISATION, H_RESET };
 
 String
 SR2CounterMulti::read_handler(Element *e, void *thunk)
@@ -107,6 +140,8 @@ SR2CounterMulti::read_handler(Element *e, void *thunk)
 	return String(c->_byte_count);
       case H_BUSY_TIME:
 	return String(c->_busy_time);
+      case H_UTILISATION:
+	return String(c->read_utilisation());
       default:
 	return "<error>";
     }
@@ -132,6 +167,7 @@ SR2CounterMulti::add_handlers()
     add_read_handler("count", read_handler, (void *)H_COUNT);
     add_read_handler("byte_count", read_handler, (void *)H_BYTE_COUNT);
 		add_read_handler("busy_time", read_handler, (void *)H_BUSY_TIME);
+    add_read_handler("utilisation", read_handler, (void *)H_UTILISATION);
     add_write_handler("reset", write_handler, (void *)H_RESET, Handler::BUTTON);
 }
 
@@ -1,6 +1,7 @@
 #ifndef CLICK_SR2COUNTERMULTI_HH
 #define CLICK_SR2COUNTERMULTI_HH
 #include <click/element.hh>
+#include <click/timestamp.hh>
 #include <clicknet/wifi.h>
 CLICK_DECLS
 
@@ -59,6 +60,18 @@ weighted moving average, in bits per second.
 Returns the recent arrival rate, measured by exponential
 weighted moving average, in bytes per second.
 
+=h busy_time read-only
+
+Returns the airtime, in microseconds, of the packets counted since the
+last reset. A packet takes its PLCP preamble and header plus its payload
+at the rate in its wifi extra annotation; unicast data and management
+frames also take a SIFS and an ACK at a basic rate. Captured ACKs are
+not charged again.
+
+=h utilisation read-only
+
+Returns busy_time as permille of the time since the last reset.
+
 =h reset_counts write-only
 
 Resets the counts and rates to zero.
@@ -110,8 +123,11 @@ class SR2CounterMulti : public Element { public:
     uint32_t read_count();
     uint32_t read_byte_count();
     uint32_t read_busy_time();
+    int read_utilisation();
     void reset();
 
+    static unsigned airtime(Packet *);
+
     void add_handlers();
 
     void push(int, Packet *);
@@ -123,6 +139,7 @@ class SR2CounterMulti : public Element { public:
     uint32_t _count;
     uint32_t _byte_count;
 		uint32_t _busy_time;
+    Timestamp _since;
     bool _discard;
 
     static String read_handler(Element *, void *);
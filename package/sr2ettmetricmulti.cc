@@ -24,8 +24,12 @@
 #include "sr2nodemulti.hh"
 CLICK_DECLS 
 
+enum { H_BENCH };
+
 SR2ETTMetricMulti::SR2ETTMetricMulti()
-  : SR2LinkMetricMulti()
+  : SR2LinkMetricMulti(),
+    _bench_evals(0),
+    _bench_mismatches(0)
 {
 }
 
@@ -45,124 +49,219 @@ SR2ETTMetricMulti::cast(const char *n)
 }
 
 void
-SR2ETTMetricMulti::update_link(NodeAddress from, NodeAddress to, 
-		       Vector<SR2RateSize> rs, 
-		       Vector<int> fwd, Vector<int> rev, 
-		       uint32_t seq)
+SR2ETTMetricMulti::update_links(const SR2LinkBatchMulti &batch)
 {
+  Vector<SR2LinkUpdateMulti> updates;
 
-  if (!from || !to) {
-    click_chatter("%{element} :: %s :: called with %s %s\n",
-		  this,
-		  __func__,
-		  from._ipaddr.unparse().c_str(),
-		  from._iface,
-		  to._ipaddr.unparse().c_str(),
-		  to._iface);
-    return;
-  }
+  for (int i = 0; i < batch.size(); i++) {
+    const SR2LinkBatchMulti::Link &l = batch._links[i];
+    NodeAddress from = l._from;
+    NodeAddress to = l._to;
+    const SR2RateSize *rs = batch._rs.begin() + l._first;
+    const int *fwd = batch._fwd.begin() + l._first;
+    const int *rev = batch._rev.begin() + l._first;
 
-  int one_ack_fwd = 0;
-  int one_ack_rev = 0;
-  int six_ack_fwd = 0;
-  int six_ack_rev = 0;
-
-  /* 
-   * if we don't have a few probes going out, just pick
-   * the smallest size for fwd rate
-   */
-  int one_ack_size = 0;
-  int six_ack_size = 0;
-
-  for (int x = 0; x < rs.size(); x++) {
-    if (rs[x]._rate == 2 && 
-	(!one_ack_size ||
-	 one_ack_size > rs[x]._size)) {
-      one_ack_size = rs[x]._size;
-      one_ack_fwd = fwd[x];
-      one_ack_rev = rev[x];
-    } else if (rs[x]._rate == 12 && 
-	       (!six_ack_size ||
-		six_ack_size > rs[x]._size)) {
-      six_ack_size = rs[x]._size;
-      six_ack_fwd = fwd[x];
-      six_ack_rev = rev[x];
+    if (!from || !to) {
+      click_chatter("%{element} :: %s :: called with %s %s\n",
+		    this,
+		    __func__,
+		    from._ipaddr.unparse().c_str(),
+		    to._ipaddr.unparse().c_str());
+      continue;
+    }
+
+    int one_ack_fwd = 0;
+    int one_ack_rev = 0;
+    int six_ack_fwd = 0;
+    int six_ack_rev = 0;
+
+    /* 
+     * if we don't have a few probes going out, just pick
+     * the smallest size for fwd rate
+     */
+    int one_ack_size = 0;
+    int six_ack_size = 0;
+
+    for (int x = 0; x < l._count; x++) {
+      if (rs[x]._rate == 2 && 
+	  (!one_ack_size ||
+	   one_ack_size > rs[x]._size)) {
+	one_ack_size = rs[x]._size;
+	one_ack_fwd = fwd[x];
+	one_ack_rev = rev[x];
+      } else if (rs[x]._rate == 12 && 
+		 (!six_ack_size ||
+		  six_ack_size > rs[x]._size)) {
+	six_ack_size = rs[x]._size;
+	six_ack_fwd = fwd[x];
+	six_ack_rev = rev[x];
+      }
     }
-  }
     
-  if (!one_ack_fwd && !six_ack_fwd &&
-      !one_ack_rev && !six_ack_rev) {
-    return;
-  }
+    if (!one_ack_fwd && !six_ack_fwd &&
+	!one_ack_rev && !six_ack_rev) {
+      continue;
+    }
 
-  int rev_metric = 0;
-  int fwd_metric = 0;
+    int rev_metric = 0;
+    int fwd_metric = 0;
 
-  int rev_rate = 0;
-  int fwd_rate = 0;
+    int rev_rate = 0;
+    int fwd_rate = 0;
   
-  int rev_retries = 0;
-  int fwd_retries = 0;
+    int rev_retries = 0;
+    int fwd_retries = 0;
 
-  int rev_probe = 0;
-  int fwd_probe = 0;
+    int rev_probe = 0;
+    int fwd_probe = 0;
   
-  for (int x = 0; x < rs.size(); x++) {
-    if (rs[x]._size >= 100) {
-      int ack_fwd = 0;
-      int ack_rev = 0;
-      if ((rs[x]._rate == 2) ||
-	  (rs[x]._rate == 4) ||
-	  (rs[x]._rate == 11) ||
-	  (rs[x]._rate == 22)) {
-	ack_fwd = one_ack_fwd;
-	ack_rev = one_ack_rev;
-      } else {
-	ack_fwd = six_ack_fwd;
-	ack_rev = six_ack_rev;
-      }
+    for (int x = 0; x < l._count; x++) {
+      if (rs[x]._size >= 100) {
+	int ack_fwd = 0;
+	int ack_rev = 0;
+	if (_ett_table.etx().ack_rate(rs[x]._rate) == 2) {
+	  ack_fwd = one_ack_fwd;
+	  ack_rev = one_ack_rev;
+	} else {
+	  ack_fwd = six_ack_fwd;
+	  ack_rev = six_ack_rev;
+	}
 
-      int metric = sr2_ett_metric(ack_rev, fwd[x], rs[x]._rate);
-      int retries = sr2_etx_metric(ack_rev, fwd[x]);
+	int metric = _ett_table.metric(ack_rev, fwd[x], rs[x]._rate);
+	int retries = _ett_table.etx().metric(ack_rev, fwd[x]);
 
-      if (!fwd_metric|| (metric && metric < fwd_metric)) {
-	fwd_probe = rs[x]._size;
-	fwd_rate = rs[x]._rate;
-	fwd_metric = metric;
-	fwd_retries = retries;
-      }
+	if (!fwd_metric|| (metric && metric < fwd_metric)) {
+	  fwd_probe = rs[x]._size;
+	  fwd_rate = rs[x]._rate;
+	  fwd_metric = metric;
+	  fwd_retries = retries;
+	}
       
-      metric = sr2_ett_metric(ack_fwd, rev[x], rs[x]._rate);
-      retries = sr2_etx_metric(ack_rev, fwd[x]);
-
-      if (!rev_metric || (metric && metric < rev_metric)) {
-	rev_probe = rs[x]._size;
-	rev_rate= rs[x]._rate;
-	rev_metric = metric;
-	rev_retries = retries;
+	metric = _ett_table.metric(ack_fwd, rev[x], rs[x]._rate);
+	retries = _ett_table.etx().metric(ack_rev, fwd[x]);
+
+	if (!rev_metric || (metric && metric < rev_metric)) {
+	  rev_probe = rs[x]._size;
+	  rev_rate= rs[x]._rate;
+	  rev_metric = metric;
+	  rev_retries = retries;
+	}
       }
     }
+
+    if (fwd_metric) {
+      updates.push_back(SR2LinkUpdateMulti(from, to, l._seq, 0, fwd_metric, fwd_rate, fwd_probe, fwd_retries));
+    }
+    if (rev_metric) {
+      updates.push_back(SR2LinkUpdateMulti(to, from, l._seq, 0, rev_metric, rev_rate, rev_probe, rev_retries));
+    }
   }
 
   /* update linktable */
-  if (fwd_metric && 
-      _link_table && 
-      !_link_table->update_link(from, to, seq, 0, fwd_metric)) {
+  if (_link_table && updates.size()) {
+    _link_table->update_links(updates);
+  }
+}
+
+/*
+ * Evaluates ETT and ETX for every rate and pair of delivery ratios, 
+ * first with the formulas and then out of the tables.
+ */
+void
+SR2ETTMetricMulti::bench(int iterations)
+{
+  static const int rates[] = { 2, 4, 11, 22, 12, 18, 24, 36, 48, 72, 96, 108 };
+  int nrates = sizeof(rates) / sizeof(rates[0]);
+  unsigned formula_sum = 0;
+  unsigned table_sum = 0;
 
-    _link_table->set_link_rate(from, to, fwd_rate);
-    _link_table->set_link_probe(from, to, fwd_probe);
-    _link_table->set_link_retries(from, to, fwd_retries);
+  Timestamp start = Timestamp::now();
+  for (int i = 0; i < iterations; i++) {
+    for (int r = 0; r < nrates; r++) {
+      for (int ack = 0; ack <= 100; ack++) {
+	for (int data = 0; data <= 100; data++) {
+	  formula_sum += sr2_ett_metric(ack, data, rates[r]) + sr2_etx_metric(ack, data);
+	}
+      }
+    }
+  }
+  _bench_formula = Timestamp::now() - start;
+
+  start = Timestamp::now();
+  for (int i = 0; i < iterations; i++) {
+    for (int r = 0; r < nrates; r++) {
+      for (int ack = 0; ack <= 100; ack++) {
+	for (int data = 0; data <= 100; data++) {
+	  table_sum += _ett_table.metric(ack, data, rates[r]) + _ett_table.etx().metric(ack, data);
+	}
+      }
+    }
+  }
+  _bench_table = Timestamp::now() - start;
 
+  _bench_mismatches = 0;
+  for (int r = 0; r < nrates; r++) {
+    for (int ack = 0; ack <= 100; ack++) {
+      for (int data = 0; data <= 100; data++) {
+	if (sr2_ett_metric(ack, data, rates[r]) != _ett_table.metric(ack, data, rates[r]) ||
+	    sr2_etx_metric(ack, data) != _ett_table.etx().metric(ack, data)) {
+	  _bench_mismatches++;
+	}
+      }
+    }
+  }
+  _bench_evals = iterations * nrates * 101 * 101;
+  if (formula_sum != table_sum) {
+    click_chatter("%{element} :: %s :: formula and table sums differ (%u vs %u)",
+		  this,
+		  __func__,
+		  formula_sum,
+		  table_sum);
   }
-  if (rev_metric && 
-      _link_table && 
-      !_link_table->update_link(to, from, seq, 0, rev_metric)){
+}
 
-    _link_table->set_link_rate(from, to, rev_rate);
-    _link_table->set_link_probe(from, to, rev_probe);
-    _link_table->set_link_retries(from, to, rev_retries);
+String
+SR2ETTMetricMulti::read_handler(Element *e, void *thunk)
+{
+  SR2ETTMetricMulti *td = (SR2ETTMetricMulti *)e;
+  switch ((uintptr_t) thunk) {
+    case H_BENCH: {
+      StringAccum sa;
+      sa << "evals " << td->_bench_evals << "\n";
+      sa << "formula " << td->_bench_formula << "\n";
+      sa << "table " << td->_bench_table << "\n";
+      sa << "mismatches " << td->_bench_mismatches << "\n";
+      return sa.take_string();
+    }
+    default:
+      return String() + "\n";
+  }
+}
 
+int 
+SR2ETTMetricMulti::write_handler(const String &in_s, Element *e, void *vparam,
+		     ErrorHandler *errh)
+{
+  SR2ETTMetricMulti *f = (SR2ETTMetricMulti *)e;
+  String s = cp_uncomment(in_s);
+  switch((intptr_t)vparam) {
+    case H_BENCH: {
+      unsigned iterations = 1;
+      if (s.length() && !cp_unsigned(s, &iterations)) {
+        return errh->error("bench parameter must be unsigned");
+      }
+      f->bench(iterations);
+      break;
+    }
   }
+  return 0;
+}
+
+void
+SR2ETTMetricMulti::add_handlers()
+{
+  add_read_handler("bench", read_handler, (void *) H_BENCH);
+  add_write_handler("bench", write_handler, (void *) H_BENCH);
 }
 
 EXPORT_ELEMENT(SR2ETTMetricMulti)
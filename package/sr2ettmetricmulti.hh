@@ -6,6 +6,7 @@
 #include <click/etheraddress.hh>
 #include <clicknet/wifi.h>
 #include "sr2ettstatmulti.hh"
+#include "sr2txcountmetricmulti.hh"
 #include <elements/wifi/bitrate.hh>
 CLICK_DECLS
 
@@ -37,6 +38,50 @@ inline unsigned sr2_ett_metric(int ack_prob, int data_prob, int data_rate)
 
 }
 
+/*
+ * sr2_ett_metric() out of tables: the ETX comes from SR2ETXTableMulti and
+ * the airtime of a 1500 byte packet is kept per rate and number of 
+ * retries, so no division by the rate or calc_usecs_wifi_packet() is 
+ * left on the probe path. Unknown rates fall back to the formula.
+ */
+class SR2ETTTableMulti {
+  public:
+    SR2ETTTableMulti() {
+      static const int rates[] = { 2, 4, 11, 22, 12, 18, 24, 36, 48, 72, 96, 108 };
+      memset(_valid, 0, sizeof(_valid));
+      for (unsigned r = 0; r < sizeof(rates) / sizeof(rates[0]); r++) {
+	_valid[rates[r]] = true;
+	for (int retries = 0; retries <= MAX_RETRIES; retries++) {
+	  _usecs[rates[r]][retries] = calc_usecs_wifi_packet(1500, rates[r], retries);
+	}
+      }
+    }
+
+    unsigned metric(int ack_prob, int data_prob, int data_rate) const {
+      if ((unsigned) data_rate > MAX_RATE || !_valid[data_rate] ||
+	  (unsigned) ack_prob > 100 || (unsigned) data_prob > 100) {
+	return sr2_ett_metric(ack_prob, data_prob, data_rate);
+      }
+      if (ack_prob < 30 || data_prob < 30) {
+	return 999999;
+      }
+      /* at most 100 * 100 * 100 / (30 * 30) - 100 = 1011 */
+      unsigned retries = _etx.metric(ack_prob, data_prob);
+      unsigned low_usecs = _usecs[data_rate][retries / 100];
+      unsigned high_usecs = _usecs[data_rate][retries / 100 + 1];
+      unsigned diff = retries % 100;
+      return (diff * high_usecs + (100 - diff) * low_usecs) / 100;
+    }
+
+    const SR2ETXTableMulti &etx() const { return _etx; }
+
+  private:
+    enum { MAX_RATE = 108, MAX_RETRIES = 11 };
+    SR2ETXTableMulti _etx;
+    bool _valid[MAX_RATE + 1];
+    unsigned _usecs[MAX_RATE + 1][MAX_RETRIES + 1];
+};
+
 class SR2ETTMetricMulti : public SR2LinkMetricMulti {
   
 public:
@@ -47,10 +92,23 @@ public:
   void *cast(const char *);
   const char *processing() const { return AGNOSTIC; }
 
-  void update_link(NodeAddress from, NodeAddress to, 
-		   Vector<SR2RateSize> rs, 
-		   Vector<int> fwd, Vector<int> rev, 
-		   uint32_t seq);
+  void update_links(const SR2LinkBatchMulti &batch);
+
+  void add_handlers();
+
+private:
+
+  SR2ETTTableMulti _ett_table;
+
+  Timestamp _bench_formula;
+  Timestamp _bench_table;
+  uint32_t _bench_evals;
+  uint32_t _bench_mismatches;
+
+  void bench(int);
+
+  static int write_handler(const String &, Element *, void *, ErrorHandler *);
+  static String read_handler(Element *, void *);
 
 };
 
@@ -28,12 +28,23 @@
 #include "sr2linkmetricmulti.hh"
 CLICK_DECLS
 
-enum { H_RESET, H_BCAST_STATS, H_IP, H_TAU, H_PERIOD, H_PROBES };
+enum { H_RESET, H_BCAST_STATS, H_IP, H_TAU, H_PERIOD, H_PROBES, H_CUR_PERIOD, H_DELTA_STATS };
 
 SR2ETTStatMulti::SR2ETTStatMulti()
   : _ads_rs_index(0),
     _tau(10000), 
     _period(1000), 
+    _adaptive(false),
+    _min_period(0),
+    _max_period(0),
+    _stable_thresh(10),
+    _new_neighbor(false),
+    _delta(false),
+    _delta_thresh(5),
+    _refresh(60000),
+    _entries_sent(0),
+    _entries_suppressed(0),
+    _want_refresh(false),
     _sent(0),
     _link_metric(0),
     _arp_table(0),
@@ -50,15 +61,45 @@ void
 SR2ETTStatMulti::run_timer(Timer *)
 {
 
-  int p = _period / _ads_rs.size();
-  unsigned max_jitter = p / 10;
-  if (_if_table->check_if_available(_if_table->lookup_id(_eth))) {
-			if (_iface != _if_table->lookup_id(_eth)) {
-				_iface = _if_table->lookup_id(_eth);
+  /*
+   * _lock only covers our own state: the interface and ARP tables are
+   * read before taking it, the link table is updated and the probe
+   * pushed after releasing it
+   */
+  int my_iface = _if_table->lookup_id(_eth);
+  if (_if_table->check_if_available(my_iface)) {
+      Vector<int> rates = _if_table->get_local_rates(my_iface);
+      _lock.acquire();
+      Vector<EtherAddress> neighbors = _neighbors;
+      _lock.release();
+      HashMap<EtherAddress, NodeAddress> nodes;
+      for (int x = 0; x < neighbors.size(); x++) {
+        nodes.insert(neighbors[x], _arp_table->reverse_lookup(neighbors[x]));
+      }
+
+      SR2LinkBatchMulti batch;
+      _lock.acquire();
+			if (_iface != my_iface) {
+				_iface = my_iface;
 				reset();
 			}
-      send_probe();
+      Packet *p = make_probe(my_iface, rates, nodes, batch);
+      if (_adaptive && _ads_rs_index == 0) {
+        adapt_period();
+      }
+      _lock.release();
+
+      if (batch.size()) {
+        _link_metric->update_links(batch);
+      }
+      if (p) {
+        checked_output_push(0, p);
+      }
   }
+  _lock.acquire();
+  int p = cur_period() / _ads_rs.size();
+  _lock.release();
+  unsigned max_jitter = p / 10;
   unsigned j = click_random(0, 2 * max_jitter);
   unsigned delay = p + j - max_jitter;
   _timer.reschedule_after_msec(delay);
@@ -69,8 +110,9 @@ SR2ETTStatMulti::initialize(ErrorHandler *)
 {
 
 	_iface = _if_table->lookup_id(_eth);
+  _cur_period = _min_period;
   if (noutputs() > 0) {
-    int p = _period / _ads_rs.size();
+    int p = cur_period() / _ads_rs.size();
     unsigned max_jitter = p / 10;
     unsigned j = click_random(0, 2 * max_jitter);
     _timer.initialize(this);    
@@ -94,6 +136,13 @@ SR2ETTStatMulti::configure(Vector<String> &conf, ErrorHandler *errh)
 			 "METRIC", 0, cpElement, &_link_metric,
 			 "ARP", 0, cpElement, &_arp_table,
 			 "PROBES", 0, cpString, &probes,
+			 "ADAPTIVE", 0, cpBool, &_adaptive,
+			 "MIN_PERIOD", 0, cpUnsigned, &_min_period,
+			 "MAX_PERIOD", 0, cpUnsigned, &_max_period,
+			 "STABLE_THRESH", 0, cpUnsigned, &_stable_thresh,
+			 "DELTA", 0, cpBool, &_delta,
+			 "DELTA_THRESH", 0, cpUnsigned, &_delta_thresh,
+			 "REFRESH", 0, cpUnsigned, &_refresh,
 			 cpEnd);
 
   if ((res = write_handler(probes, this, (void *) H_PROBES, errh)) < 0) {
@@ -116,15 +165,36 @@ SR2ETTStatMulti::configure(Vector<String> &conf, ErrorHandler *errh)
   }
   if (_if_table && _if_table->cast("AvailableInterfaces") == 0) 
     return errh->error("AvailableInterfaces element is not an AvailableInterfaces");
+  if (!_min_period) {
+    _min_period = _period;
+  }
+  if (!_max_period) {
+    _max_period = WIFI_MAX(_min_period, _tau / 2);
+  }
+  if (_adaptive && _min_period > _max_period) {
+    return errh->error("MIN_PERIOD must not be greater than MAX_PERIOD");
+  }
+  if (_adaptive && _max_period > _tau / 2) {
+    return errh->error("MAX_PERIOD must not be greater than TAU/2");
+  }
+  if (_delta && !_refresh) {
+    return errh->error("REFRESH must be greater than 0");
+  }
   return res;
 }
 
-void
-SR2ETTStatMulti::send_probe() 
+/*
+ * Builds the next probe with _lock held. nodes maps each neighbour to
+ * its address as the ARP table knows it, the link updates go to batch.
+ */
+Packet *
+SR2ETTStatMulti::make_probe(int my_iface, const Vector<int> &rates,
+			    const HashMap<EtherAddress, NodeAddress> &nodes,
+			    SR2LinkBatchMulti &batch)
 {
   if (!_ads_rs.size()) {
     click_chatter("%{element} :: %s :: no probes to send at", this, __func__);
-    return;
+    return 0;
   }
 
 	Vector<EtherAddress> neighbors_remove;
@@ -141,13 +211,13 @@ SR2ETTStatMulti::send_probe()
 		  __func__,
 		  size,
 		  min_packet_size);
-    return;
+    return 0;
   }
 
   WritablePacket *p = Packet::make(size + sizeof(click_ether)); 
   if (!p) {
     click_chatter("%{element} :: %s :: cannot make packet!", this, __func__);
-    return;
+    return 0;
   }
 
   memset(p->data(), 0, p->length());
@@ -159,13 +229,15 @@ SR2ETTStatMulti::send_probe()
   link_probe_multi *lp = (struct link_probe_multi *) (p->data() + sizeof(click_ether));
   lp->_version = _sr2_version;
   lp->_type = SR2_PT_PROBE;
-	int my_iface = _if_table->lookup_id(_eth);
   lp->set_node(NodeAddress(_ip,my_iface));
   lp->set_seq(Timestamp::now().sec());
   lp->set_period(_period);
   lp->set_tau(_tau);
   lp->set_sent(_sent);
   lp->unset_flag(~0);
+  if (_adaptive) {
+    lp->set_flag(PROBE_ADAPTIVE);
+  }
   lp->set_rate(rate);
   lp->set_size(size);
   lp->set_num_probes(_ads_rs.size());
@@ -174,11 +246,6 @@ SR2ETTStatMulti::send_probe()
   uint8_t *end  = (uint8_t *) p->data() + p->length();
 
   // rate_entry
-  Vector<int> rates;
-  if (_if_table) {
-		int my_iface = _if_table->lookup_id(_eth);
-    rates = _if_table->get_local_rates(my_iface);
-  }
   if (rates.size() && ptr + sizeof(rate_entry) * rates.size() < end) {
     for (int x = 0; x < rates.size(); x++) {
         rate_entry *r_entry = (struct rate_entry *)(ptr); 
@@ -190,9 +257,23 @@ SR2ETTStatMulti::send_probe()
   } 
 
   int num_entries = 0;
+  int visited = 0;
+
+  /* delta probes keep room for the link_summary trailer */
+  uint8_t *entries_end = end;
+  if (_delta) {
+    entries_end = end - sizeof(struct link_summary);
+    if (!_last_refresh || Timestamp::now() - _last_refresh > Timestamp::make_msec(_refresh)) {
+      for (ProbeMap::iterator iter = _bcast_stats.begin(); iter.live(); iter++) {
+        iter.value()._refresh = true;
+      }
+      _last_refresh = Timestamp::now();
+    }
+  }
 
-  while (ptr < end && num_entries < _neighbors.size()) {
+  while (ptr < entries_end && visited < _neighbors.size()) {
 
+    visited++;
     _neighbors_index = (_neighbors_index + 1) % _neighbors.size();
 
     if (_neighbors_index >= _neighbors.size()) {
@@ -211,7 +292,12 @@ SR2ETTStatMulti::send_probe()
     } else {
 	
 			// Check for interface change
-			NodeAddress node = _arp_table->reverse_lookup(_neighbors[_neighbors_index]);
+			const NodeAddress *known = nodes.findp(_neighbors[_neighbors_index]);
+			if (!known) {
+				/* heard from after the ARP lookups, next round */
+				continue;
+			}
+			NodeAddress node = *known;
 			if (node._iface != probe->_node._iface) {
 
 				neighbors_remove.push_back(_neighbors[_neighbors_index]);
@@ -221,11 +307,28 @@ SR2ETTStatMulti::send_probe()
 				}
 									
 			} else {
+	      Vector<SR2RateSize> rates;
+	      Vector<int> fwd;
+	      Vector<int> rev;
+
+	      for (int x = 0; x < probe->_probe_types.size(); x++) {
+					SR2RateSize rs = probe->_probe_types[x];
+					rates.push_back(rs);
+					fwd.push_back(probe->fwd_rate(rs._rate, rs._size));
+					rev.push_back(probe->rev_rate(_start, rs._rate, rs._size));
+	      }
+
+				if (_delta && !probe->_refresh && !probe->adv_moved(fwd, rev, _delta_thresh)) {
+					_entries_suppressed++;
+					continue;
+				}
+
 				int size = probe->_probe_types.size()*sizeof(link_info) + sizeof(link_entry_multi);
-	      if (ptr + size > end) {
+	      if (ptr + size > entries_end) {
 					break;
 	      }
 	      num_entries++;
+	      _entries_sent++;
 	      link_entry_multi *entry = (struct link_entry_multi *)(ptr);
 	      entry->set_node(node);
 	      entry->set_seq(probe->_seq);	
@@ -236,24 +339,24 @@ SR2ETTStatMulti::send_probe()
 
 	      ptr += sizeof(link_entry_multi);
 
-	      Vector<SR2RateSize> rates;
-	      Vector<int> fwd;
-	      Vector<int> rev;
-
-	      for (int x = 0; x < probe->_probe_types.size(); x++) {
-					SR2RateSize rs = probe->_probe_types[x];
+	      for (int x = 0; x < rates.size(); x++) {
 					link_info *lnfo = (struct link_info *) (ptr + x*sizeof(link_info));
-					lnfo->set_size(rs._size);
-					lnfo->set_rate(rs._rate);
-					lnfo->set_fwd(probe->fwd_rate(rs._rate, rs._size));
-					lnfo->set_rev(probe->rev_rate(_start, rs._rate, rs._size));
-					rates.push_back(rs);
-					fwd.push_back(lnfo->fwd());
-					rev.push_back(lnfo->rev());
+					lnfo->set_size(rates[x]._size);
+					lnfo->set_rate(rates[x]._rate);
+					lnfo->set_fwd(fwd[x]);
+					lnfo->set_rev(rev[x]);
 	      }
-				int my_iface = _if_table->lookup_id(_eth);
-				node = _arp_table->reverse_lookup(probe->_eth);
-	      _link_metric->update_link(NodeAddress(_ip,my_iface), node, rates, fwd, rev, entry->seq());
+				if (_delta) {
+					probe->_adv_fwd = fwd;
+					probe->_adv_rev = rev;
+					probe->_adv_digest = entry->digest();
+					probe->_advertised = true;
+					probe->_refresh = false;
+				}
+				batch.add_link(NodeAddress(_ip,my_iface), node, entry->seq());
+				for (int x = 0; x < rates.size(); x++) {
+					batch.add_rate(rates[x], fwd[x], rev[x]);
+				}
 	      ptr += probe->_probe_types.size()*sizeof(link_info);
 	    }
 		
@@ -280,6 +383,29 @@ SR2ETTStatMulti::send_probe()
 	// End of cleaning _neighbors table
 	neighbors_remove.clear();
 
+  if (_delta && ptr + sizeof(struct link_summary) <= end) {
+    uint32_t advertised = 0;
+    uint32_t checksum = 0;
+    for (ProbeIter iter = _bcast_stats.begin(); iter.live(); iter++) {
+      if (iter.value()._advertised) {
+        advertised++;
+        checksum ^= iter.value()._adv_digest;
+      }
+    }
+    link_summary *summary = (struct link_summary *) (ptr);
+    summary->set_num_entries(advertised);
+    summary->set_checksum(checksum);
+    summary->set_refresh(_refresh);
+    lp->set_flag(PROBE_LINK_DELTA);
+    if ((uint32_t) num_entries == advertised) {
+      /* every entry written here is advertised, so these are all of them */
+      lp->set_flag(PROBE_LINK_FULL);
+    }
+  }
+  if (_want_refresh) {
+    lp->set_flag(PROBE_REFRESH_REQ);
+    _want_refresh = false;
+  }
   lp->set_flag(PROBE_LINK_ENTRIES);
   lp->set_num_links(num_entries);
   lp->set_checksum();
@@ -288,23 +414,53 @@ SR2ETTStatMulti::send_probe()
   ceh->magic = WIFI_EXTRA_MAGIC;
   ceh->rate = rate;
 
-  checked_output_push(0, p);
+  return p;
 }
 
 Packet *
 SR2ETTStatMulti::simple_action(Packet *p)
+{
+  if (!check_probe(p)) {
+    p->kill();
+    return 0;
+  }
+  click_ether *eh = (click_ether *) p->data();
+  struct link_probe_multi *lp = (struct link_probe_multi *) (eh+1);
+  if (_arp_table) {
+    _arp_table->insert(lp->node(), EtherAddress(eh->ether_shost));
+  }
+
+  /* as in run_timer(), other tables are only touched outside _lock */
+  SR2LinkBatchMulti batch;
+  Vector<int> rates;
+  bool has_rates = false;
+  _lock.acquire();
+  receive_probe(p, batch, rates, &has_rates);
+  _lock.release();
+
+  if (has_rates && _if_table) {
+    _if_table->insert(EtherPair(_eth,EtherAddress(eh->ether_shost)), rates);
+  }
+  /* all entries of the probe go to the metric in one batch */
+  if (batch.size()) {
+    _link_metric->update_links(batch);
+  }
+  p->kill();
+  return 0;
+}
+
+bool
+SR2ETTStatMulti::check_probe(Packet *p)
 {
   click_ether *eh = (click_ether *) p->data();
   struct link_probe_multi *lp = (struct link_probe_multi *) (eh+1);
   if (p->length() < sizeof(click_ether) + sizeof(struct sr2packetmulti)) {
     click_chatter("%{element} :: %s :: packet truncated", this, __func__);
-    p->kill();
-    return 0;
+    return false;
   }
   if (ntohs(eh->ether_type) != _et) {
     click_chatter("%{element} :: %s :: wrong packet type", this, __func__);
-    p->kill();
-    return 0;
+    return false;
   }
   if (lp->_version != _sr2_version) {
     click_chatter ("%{element} :: %s :: unknown protocol version %x from %s", 
@@ -312,21 +468,18 @@ SR2ETTStatMulti::simple_action(Packet *p)
 		   __func__,
 		   lp->_version,
 		   EtherAddress(eh->ether_shost).unparse().c_str());
-    p->kill();
-    return 0;
+    return false;
   }
   if (eh->ether_type != htons(_et)) {
     click_chatter("%{element} :: %s :: bad ether_type %04x",
                        this,
                        __func__,
                        ntohs(eh->ether_type));
-    p->kill();
-    return 0;
+    return false;
   }
   if (!lp->check_checksum()) {
     click_chatter("%{element} :: %s :: failed checksum", this, __func__);
-    p->kill();
-    return 0;
+    return false;
   }
   if (p->length() < lp->size() + sizeof(click_ether)) {
     click_chatter("%{element} :: %s :: packet is smaller (%d) than it claims (%u)",
@@ -334,8 +487,7 @@ SR2ETTStatMulti::simple_action(Packet *p)
 		  __func__,
 		  p->length(),
 		  lp->size());
-    p->kill();
-    return 0;
+    return false;
   }
   NodeAddress node = lp->node();
   if (node._ipaddr == _ip) {
@@ -345,12 +497,23 @@ SR2ETTStatMulti::simple_action(Packet *p)
 		  _ip.unparse().c_str(),
 			node._iface,
 			_iface);
-    p->kill();
-    return 0;
-  }
-  if (_arp_table) {
-    _arp_table->insert(node, EtherAddress(eh->ether_shost));
+    return false;
   }
+  return true;
+}
+
+/*
+ * Takes in a probe that passed check_probe(), with _lock held. The link
+ * entries go to batch and the rates the sender advertised, if any, to
+ * rates.
+ */
+void
+SR2ETTStatMulti::receive_probe(Packet *p, SR2LinkBatchMulti &batch,
+			       Vector<int> &rates, bool *has_rates)
+{
+  click_ether *eh = (click_ether *) p->data();
+  struct link_probe_multi *lp = (struct link_probe_multi *) (eh+1);
+  NodeAddress node = lp->node();
   struct click_wifi_extra *ceh = WIFI_EXTRA_ANNO(p);
   if (ceh->rate != lp->rate()) {
     click_chatter("%{element} :: %s :: packet says rate %d is %d\n",
@@ -358,8 +521,7 @@ SR2ETTStatMulti::simple_action(Packet *p)
 		  __func__,
 		  lp->rate(),
 		  ceh->rate);
-    p->kill();
-    return 0;
+    return;
   }
   uint32_t new_period = lp->period();
   uint32_t tau = lp->tau();
@@ -369,6 +531,7 @@ SR2ETTStatMulti::simple_action(Packet *p)
     probe_list = _bcast_stats.findp(EtherAddress(eh->ether_shost));
     probe_list->_sent = 0;
     _neighbors.push_back(EtherAddress(eh->ether_shost));
+    _new_neighbor = true;
   } else if (node._iface != probe_list->_node._iface) {
 	  click_chatter("%{element} :: %s :: %s,%d, has changed its interface %d to %d; clearing probe info",
 		  this,
@@ -379,6 +542,7 @@ SR2ETTStatMulti::simple_action(Packet *p)
 		  node._iface);
 			probe_list->_node._iface = node._iface;
 			probe_list->_probes.clear();
+			_new_neighbor = true;
 	} else if (probe_list->_period != new_period) {
     click_chatter("%{element} :: %s :: %s,%d, has changed its link probe period from %u to %u; clearing probe info",
 		  this,
@@ -405,6 +569,7 @@ SR2ETTStatMulti::simple_action(Packet *p)
 		  __func__,
 		  node._ipaddr.unparse().c_str());
     probe_list->_probes.clear();
+    probe_list->_mirror.clear();
   }
   Timestamp now = Timestamp::now();
   SR2RateSize rs = SR2RateSize(ceh->rate, lp->size());
@@ -413,7 +578,8 @@ SR2ETTStatMulti::simple_action(Packet *p)
   probe_list->_sent = lp->sent();
   probe_list->_last_rx = now;
   probe_list->_num_probes = lp->num_probes();
-  probe_list->_probes.push_back(Probe(now, lp->seq(), lp->rate(), lp->size(), ceh->rssi, ceh->silence));
+  probe_list->_adaptive = lp->flag(PROBE_ADAPTIVE);
+  probe_list->_probes.push_back(Probe(now, lp->seq(), lp->rate(), lp->size(), ceh->rssi, ceh->silence, lp->sent()));
   probe_list->_seq = lp->seq();
   uint32_t window = 1 + (probe_list->_tau / 1000);
 
@@ -440,15 +606,20 @@ SR2ETTStatMulti::simple_action(Packet *p)
 
   if (lp->flag(PROBE_AVAILABLE_RATES)) {
     int num_rates = lp->num_rates();
-    Vector<int> rates;
     for (int x = 0; x < num_rates; x++) {
         rate_entry *r_entry = (struct rate_entry *)(ptr); 
         rates.push_back(r_entry->rate());
         ptr += sizeof(rate_entry);
     }
-    if(_if_table) {
-      _if_table->insert(EtherPair(_eth,EtherAddress(eh->ether_shost)), rates);
-    }
+    *has_rates = true;
+  }
+  if (lp->flag(PROBE_LINK_FULL)) {
+    /* the entries below are all the sender advertises, forget the rest */
+    probe_list->_mirror.clear();
+  }
+  if (_delta && lp->flag(PROBE_REFRESH_REQ)) {
+    /* a neighbor lost track of our entries, send them all next probe */
+    _last_refresh = Timestamp();
   }
   int link_number = 0;
   int num_links = lp->num_links();
@@ -457,10 +628,16 @@ SR2ETTStatMulti::simple_action(Packet *p)
     link_entry_multi *entry = (struct link_entry_multi *)(ptr); 
     NodeAddress neighbor = entry->node();
     uint32_t num_rates = entry->num_rates();
+    if (lp->flag(PROBE_LINK_DELTA) && 
+        ptr + sizeof(struct link_entry_multi) + num_rates * sizeof(struct link_info) <= end) {
+      probe_list->_mirror.insert(neighbor, LinkDigest(entry->digest(), now));
+    }
     ptr += sizeof(struct link_entry_multi);
-    Vector<SR2RateSize> rates;
-    Vector<int> fwd;
-    Vector<int> rev;
+    int seq = entry->seq();
+    if (neighbor._ipaddr == node._ipaddr && ((uint32_t) neighbor._ipaddr > (uint32_t) _ip)) {
+	seq = now.sec();
+    }
+    batch.add_link(node, neighbor, seq);
     for (uint32_t x = 0; x < num_rates; x++) {
       struct link_info *nfo = (struct link_info *) (ptr + x * (sizeof(struct link_info)));
       uint16_t nfo_size = nfo->size();
@@ -470,12 +647,10 @@ SR2ETTStatMulti::simple_action(Packet *p)
       
       SR2RateSize rs = SR2RateSize(nfo_rate, nfo_size);
       /* update other link stuff */
-      rates.push_back(rs);
-      fwd.push_back(nfo_fwd);
       if (neighbor._ipaddr == _ip) {
-	rev.push_back(probe_list->rev_rate(_start, rates[x]._rate, rates[x]._size));
+	batch.add_rate(rs, nfo_fwd, probe_list->rev_rate(_start, rs._rate, rs._size));
       } else {
-	rev.push_back(nfo_rev);
+	batch.add_rate(rs, nfo_fwd, nfo_rev);
       }
 
       if (neighbor._ipaddr == _ip) {
@@ -488,25 +663,90 @@ SR2ETTStatMulti::simple_action(Packet *p)
 	}
       }
     }
-    int seq = entry->seq();
-    if (neighbor._ipaddr == node._ipaddr && ((uint32_t) neighbor._ipaddr > (uint32_t) _ip)) {
-	seq = now.sec();
-    }
-    _link_metric->update_link(node, neighbor, rates, fwd, rev, seq);
     ptr += num_rates * sizeof(struct link_info);
   }
-  p->kill();
-  return 0;
+  if (lp->flag(PROBE_LINK_DELTA) && ptr + sizeof(struct link_summary) <= end) {
+    link_summary *summary = (struct link_summary *) (ptr);
+    /* entries nothing else removed are forgotten after two missed refreshes */
+    Timestamp expire = now - Timestamp::make_msec(2 * summary->refresh());
+    Vector<NodeAddress> expired;
+    uint32_t checksum = 0;
+    for (HashMap<NodeAddress, LinkDigest>::const_iterator iter = probe_list->_mirror.begin(); iter.live(); iter++) {
+      if (iter.value()._when < expire) {
+        expired.push_back(iter.key());
+      } else {
+        checksum ^= iter.value()._digest;
+      }
+    }
+    for (int x = 0; x < expired.size(); x++) {
+      probe_list->_mirror.remove(expired[x]);
+    }
+    if (((uint32_t) probe_list->_mirror.size() != summary->num_entries() || checksum != summary->checksum()) &&
+        !probe_list->drop_unlisted(summary->num_entries(), summary->checksum(), checksum)) {
+      probe_list->_mismatches++;
+      /* at most once per averaging period, a full refresh takes a probe or more to arrive */
+      if (!probe_list->_refresh_asked ||
+          now - probe_list->_refresh_asked > Timestamp::make_msec(probe_list->_tau)) {
+        probe_list->_refresh_asked = now;
+        _want_refresh = true;
+      }
+    }
+  }
+}
+
+void
+SR2ETTStatMulti::adapt_period()
+{
+  /* 
+   * Called after each full round of probes. Back off towards MAX_PERIOD 
+   * while delivery ratios hold, go back to MIN_PERIOD as soon as one moves 
+   * or a new neighbor shows up. The advertised period is not touched, 
+   * receivers count our probes using the sent field instead.
+   */
+  bool moved = _new_neighbor;
+  _new_neighbor = false;
+  for (ProbeMap::iterator iter = _bcast_stats.begin(); iter.live(); iter++) {
+    ProbeListMulti &pl = iter.value();
+    if (pl._last_fwd.size() != pl._probe_types.size()) {
+      pl._last_fwd.resize(pl._probe_types.size(), -1);
+      pl._last_rev.resize(pl._probe_types.size(), -1);
+    }
+    for (int x = 0; x < pl._probe_types.size(); x++) {
+      int rate = pl._probe_types[x]._rate;
+      int size = pl._probe_types[x]._size;
+      int fwd = pl.fwd_rate(rate, size);
+      int rev = pl.rev_rate(_start, rate, size);
+      if (abs(fwd - pl._last_fwd[x]) > (int) _stable_thresh || 
+          abs(rev - pl._last_rev[x]) > (int) _stable_thresh) {
+        moved = true;
+      }
+      pl._last_fwd[x] = fwd;
+      pl._last_rev[x] = rev;
+    }
+  }
+  if (moved) {
+    _cur_period = _min_period;
+  } else {
+    _cur_period = WIFI_MIN(2 * _cur_period, _max_period);
+  }
 }
 
 void
 SR2ETTStatMulti::reset()
 {
+  _lock.acquire();
   _neighbors.clear();
   _bcast_stats.clear();
   _seq = 0;
   _sent = 0;
   _start = Timestamp::now();
+  _cur_period = _min_period;
+  _new_neighbor = false;
+  _last_refresh = Timestamp();
+  _want_refresh = false;
+  _entries_sent = 0;
+  _entries_suppressed = 0;
+  _lock.release();
 }
 /*
 static int nodeaddress_sorter(const void *va, const void *vb, void *) {
@@ -544,6 +784,7 @@ SR2ETTStatMulti::print_bcast_stats()
 {
   Vector<EtherAddress> eth_addrs;
   
+  _lock.acquire();
   for(ProbeIter iter = _bcast_stats.begin(); iter.live(); iter++) {
     eth_addrs.push_back(iter.key());
   }
@@ -580,10 +821,31 @@ SR2ETTStatMulti::print_bcast_stats()
 	    sa << "\n";
     }
   }
+  _lock.release();
   return sa.take_string();
 }
 
 
+String
+SR2ETTStatMulti::print_delta_stats()
+{
+  StringAccum sa;
+  _lock.acquire();
+  sa << "delta " << _delta << "\n";
+  sa << "entries_sent " << _entries_sent << "\n";
+  sa << "entries_suppressed " << _entries_suppressed << "\n";
+  for(ProbeIter iter = _bcast_stats.begin(); iter.live(); iter++) {
+    const ProbeListMulti &pl = iter.value();
+    sa << iter.key().unparse().c_str() << " " << pl._node._ipaddr.unparse().c_str() << "-" << pl._node._iface;
+    sa << " mirrored " << pl._mirror.size();
+    sa << " mismatches " << pl._mismatches;
+    sa << " unlisted " << pl._unlisted;
+    sa << "\n";
+  }
+  _lock.release();
+  return sa.take_string();
+}
+
 String
 SR2ETTStatMulti::read_handler(Element *e, void *thunk)
 {
@@ -597,6 +859,10 @@ SR2ETTStatMulti::read_handler(Element *e, void *thunk)
       return String(td->_tau) + "\n";
     case H_PERIOD: 
       return String(td->_period) + "\n";
+    case H_CUR_PERIOD: 
+      return String(td->cur_period()) + "\n";
+    case H_DELTA_STATS: 
+      return td->print_delta_stats();
     case H_PROBES: {
       StringAccum sa;
       for(int x = 0; x < td->_ads_rs.size(); x++) {
@@ -655,7 +921,9 @@ SR2ETTStatMulti::write_handler(const String &in_s, Element *e, void *vparam,
       if (!ads_rs.size()) {
         return errh->error("no PROBES provided\n");
       }
+      f->_lock.acquire();
       f->_ads_rs = ads_rs;
+      f->_lock.release();
     }
   }
   return 0;
@@ -669,6 +937,8 @@ SR2ETTStatMulti::add_handlers()
   add_read_handler("tau", read_handler, (void *) H_TAU);
   add_read_handler("period", read_handler, (void *) H_PERIOD);
   add_read_handler("probes", read_handler, (void *) H_PROBES);
+  add_read_handler("cur_period", read_handler, (void *) H_CUR_PERIOD);
+  add_read_handler("delta_stats", read_handler, (void *) H_DELTA_STATS);
 
   add_write_handler("reset", write_handler, (void *) H_RESET);
   add_write_handler("tau", write_handler, (void *) H_TAU);
@@ -678,4 +948,5 @@ SR2ETTStatMulti::add_handlers()
 
 CLICK_ENDDECLS
 EXPORT_ELEMENT(SR2ETTStatMulti)
+ELEMENT_MT_SAFE(SR2ETTStatMulti)
 
@@ -5,11 +5,14 @@
 #include <click/etheraddress.hh>
 #include <click/dequeue.hh>
 #include <click/hashmap.hh>
+#include <click/sync.hh>
 #include <clicknet/wifi.h>
 #include "sr2nodemulti.hh"
 #include "sr2linktablemulti.hh"
 CLICK_DECLS
 
+class SR2LinkBatchMulti;
+
 class SR2RateSize {
   public:
     SR2RateSize(int rate, int size): _rate(rate), _size(size) { };
@@ -25,7 +28,8 @@ class Probe {
           int rate,
           int size,
           uint32_t rssi,
-          uint32_t noise) : _when(when), _seq(seq), _rate(rate), _size(size), _rssi(rssi), _noise(noise) { }
+          uint32_t noise,
+          uint32_t sent) : _when(when), _seq(seq), _rate(rate), _size(size), _rssi(rssi), _noise(noise), _sent(sent) { }
 
     Timestamp _when;  
     uint32_t _seq;
@@ -33,14 +37,25 @@ class Probe {
     int _size;
     uint32_t _rssi;
     uint32_t _noise;
+    uint32_t _sent;   // sender's probe counter when this probe was sent
+};
+
+class LinkDigest {
+  public:
+    LinkDigest() : _digest(0) { }
+    LinkDigest(uint32_t digest, const Timestamp &when) : _digest(digest), _when(when) { }
+    uint32_t _digest;
+    Timestamp _when;
 };
 
 class ProbeListMulti {
   public:
-    ProbeListMulti() : _period(0), _tau(0) { }
+    ProbeListMulti() : _period(0), _tau(0), _adaptive(false), _adv_digest(0), _advertised(false), _refresh(false),
+                       _mismatches(0), _unlisted(0) { }
     ProbeListMulti(const EtherAddress &eth, const NodeAddress &node,
               uint32_t period, 
-              uint32_t tau) : _eth(eth), _node(node), _period(period), _tau(tau), _sent(0) { }
+              uint32_t tau) : _eth(eth), _node(node), _period(period), _tau(tau), _sent(0), _adaptive(false),
+                              _adv_digest(0), _advertised(false), _refresh(false), _mismatches(0), _unlisted(0) { }
 
     EtherAddress _eth;
 		NodeAddress _node;
@@ -49,11 +64,63 @@ class ProbeListMulti {
     uint32_t _sent;
     uint32_t _num_probes;
     uint32_t _seq;
+    bool _adaptive;                 // node stretches its probe spacing, _period is nominal
     Vector<SR2RateSize> _probe_types;
     Vector<int> _fwd_rates;
+    Vector<int> _last_fwd;          // delivery ratios at the last adaptive check
+    Vector<int> _last_rev;
+
+    /* our link entry for this node, as last put in a probe */
+    Vector<int> _adv_fwd;
+    Vector<int> _adv_rev;
+    uint32_t _adv_digest;
+    bool _advertised;
+    bool _refresh;                  // send the entry even if nothing moved
+
+    /* link entries this node put in its delta probes */
+    HashMap<NodeAddress, LinkDigest> _mirror;
+    uint32_t _mismatches;           // summaries that did not match _mirror
+    uint32_t _unlisted;             // mirrored entries dropped to match a summary
+    Timestamp _refresh_asked;       // last full refresh we asked for after a mismatch
     Timestamp _last_rx;
     DEQueue<Probe> _probes;         // most recently received probes
 
+    /*
+     * Entries the sender stopped advertising stay mirrored until they
+     * expire. When the mirror holds one or two entries more than the
+     * summary and their digests make up the checksum difference, they
+     * are the dropped ones: removes them and returns true.
+     */
+    bool drop_unlisted(uint32_t num_entries, uint32_t checksum, uint32_t mirror_checksum) {
+      int extra = _mirror.size() - (int) num_entries;
+      if (extra < 1 || extra > 2) {
+        return false;
+      }
+      uint32_t diff = checksum ^ mirror_checksum;
+      Vector<NodeAddress> nodes;
+      Vector<uint32_t> digests;
+      for (HashMap<NodeAddress, LinkDigest>::const_iterator iter = _mirror.begin(); iter.live(); iter++) {
+        nodes.push_back(iter.key());
+        digests.push_back(iter.value()._digest);
+      }
+      for (int x = 0; x < nodes.size(); x++) {
+        if (extra == 1 && digests[x] == diff) {
+          _mirror.remove(nodes[x]);
+          _unlisted++;
+          return true;
+        }
+        for (int y = x + 1; extra == 2 && y < nodes.size(); y++) {
+          if ((digests[x] ^ digests[y]) == diff) {
+            _mirror.remove(nodes[x]);
+            _mirror.remove(nodes[y]);
+            _unlisted += 2;
+            return true;
+          }
+        }
+      }
+      return false;
+    }
+
     int fwd_rate(int rate, int size) {
       if (Timestamp::now() - _last_rx > Timestamp::make_msec(_tau)) {
         return 0;
@@ -74,10 +141,17 @@ class ProbeListMulti {
 	return 0;
       }
       int num = 0;
-      for (int i = _probes.size() - 1; i >= 0; i--) {
+      int i;
+      bool restarted = false;
+      for (i = _probes.size() - 1; i >= 0; i--) {
 	if (earliest > _probes[i]._when) {
 	  break;
 	} 
+	if (i + 1 < _probes.size() && _probes[i]._sent > _probes[i + 1]._sent) {
+	  /* the sender restarted after probe i, only count what came since */
+	  restarted = true;
+	  break;
+	}
 	if ( _probes[i]._size == size &&
 	    _probes[i]._rate == rate) {
 	  num++;
@@ -91,10 +165,31 @@ class ProbeListMulti {
       if (_sent / _num_probes < num_expected) {
 	num_expected = _sent / _num_probes;
       }
+      if (_adaptive && _probes.size()) {
+	/* the sender's spacing is not _period, count what it actually sent in the window */
+	uint32_t base = (i >= 0) ? _probes[i]._sent : _probes[0]._sent - 1;
+	if (restarted || _sent < base) {
+	  /* a restarted sender counts again from 0 */
+	  base = 0;
+	}
+	num_expected = (_sent - base) / _num_probes;
+      }
       if (!num_expected) {
 	num_expected = 1;
       }
-      return WIFI_MAX(100, 100 * num / num_expected);
+      return WIFI_MIN(100, 100 * num / num_expected);
+    }
+
+    bool adv_moved(const Vector<int> &fwd, const Vector<int> &rev, int thresh) {
+      if (!_advertised || fwd.size() != _adv_fwd.size()) {
+        return true;
+      }
+      for (int x = 0; x < fwd.size(); x++) {
+        if (abs(fwd[x] - _adv_fwd[x]) > thresh || abs(rev[x] - _adv_rev[x]) > thresh) {
+          return true;
+        }
+      }
+      return false;
     }
 
     int rev_rssi(int rate, int size) {
@@ -166,6 +261,8 @@ class SR2ETTStatMulti : public Element {
 	/* handler stuff */
 	void add_handlers();
 	String print_bcast_stats();
+	uint32_t cur_period() { return _adaptive ? _cur_period : _period; }
+	String print_delta_stats();
 
   private:
 
@@ -190,6 +287,21 @@ class SR2ETTStatMulti : public Element {
 	uint32_t _period; // msecs
 	uint32_t _expire; // msecs
 
+	bool _adaptive;
+	uint32_t _min_period; // msecs
+	uint32_t _max_period; // msecs
+	uint32_t _cur_period; // msecs, current probe period in adaptive mode
+	uint32_t _stable_thresh; // max delivery ratio change (percent) of a stable link
+	bool _new_neighbor;
+
+	bool _delta;
+	uint32_t _delta_thresh; // min delivery ratio change (percent) worth an entry
+	uint32_t _refresh; // msecs between full refreshes
+	Timestamp _last_refresh;
+	uint32_t _entries_sent;
+	uint32_t _entries_suppressed;
+	bool _want_refresh; // ask neighbors for full entries in our next probe
+
 	uint32_t _seq;
 	uint32_t _sent;
 
@@ -199,9 +311,20 @@ class SR2ETTStatMulti : public Element {
 
 	Timer _timer;
 
+	/*
+	 * the timer may run on the thread of the radio while probes come in
+	 * on the receive thread, both hold _lock over the probe state but
+	 * never while calling into another element
+	 */
+	Spinlock _lock;
+
 	void run_timer(Timer *);
+	bool check_probe(Packet *);
+	void receive_probe(Packet *, SR2LinkBatchMulti &, Vector<int> &, bool *);
 	void reset();
-	void send_probe();
+	Packet *make_probe(int, const Vector<int> &,
+			   const HashMap<EtherAddress, NodeAddress> &, SR2LinkBatchMulti &);
+	void adapt_period();
 
 	static int write_handler(const String &, Element *, void *, ErrorHandler *);
 	static String read_handler(Element *, void *);
@@ -0,0 +1,309 @@
+#ifndef CLICK_SR2FLOWTABLEMULTI_HH
+#define CLICK_SR2FLOWTABLEMULTI_HH
+#include <click/glue.hh>
+#include <click/ipflowid.hh>
+#include <click/timestamp.hh>
+#include <click/vector.hh>
+#include <click/straccum.hh>
+CLICK_DECLS
+
+/*
+ * Fixed size flow table keyed on IPFlowID.
+ *
+ * All CAPACITY entries are allocated up front and handed out from a free
+ * list. Lookups go through an open-addressing index (linear probing,
+ * backward shift on removal) of at least twice the capacity.
+ *
+ * Every live entry sits on one bucket of a timing wheel of TICK msec
+ * buckets. touch() only moves the expiry time forward; the entry is
+ * moved to a later bucket when its old bucket comes up, so a packet
+ * costs no list operations. Timeouts longer than the wheel wrap around
+ * the same way. expire() costs one step per tick elapsed plus one per
+ * entry on the buckets it passes. The owner only needs to call it
+ * while size() is non zero; the first insert() into an empty table
+ * moves the wheel up to now.
+ *
+ * When the table is full, insert() evicts the entry closest to its
+ * expiry, taken from the earliest non-empty bucket. Finding that bucket
+ * walks the wheel from the current tick: a full table rarely has empty
+ * buckets in front, but the worst case is WHEEL buckets plus the
+ * touched entries refiled on the way.
+ */
+template <typename T>
+class SR2FlowTableMulti {
+  public:
+
+    enum { WHEEL = 1024, TICK = 100 };
+
+    class Entry {
+      public:
+	Entry() : _prev(-1), _next(-1), _bucket(-1), _live(false) { }
+	IPFlowID _id;
+	T _data;
+	Timestamp _expire;
+	int _prev;
+	int _next;
+	int _bucket;
+	bool _live;
+    };
+
+    SR2FlowTableMulti() : _lookups(0), _hits(0), _inserts(0),
+			  _evictions(0), _expired(0), _full(0) {
+      configure(16384);
+    }
+
+    void configure(int capacity) {
+      if (capacity < 1)
+	capacity = 1;
+      _capacity = capacity;
+      int size = 4;
+      while (size < 2 * capacity)
+	size <<= 1;
+      _mask = size - 1;
+      _slots.clear();
+      _slots.resize(capacity);
+      _index.clear();
+      _index.resize(size, -1);
+      _wheel.clear();
+      _wheel.resize(WHEEL, -1);
+      _cursor = tick(Timestamp::now());
+      _count = 0;
+      _free = -1;
+      for (int x = capacity - 1; x >= 0; x--) {
+	_slots[x]._next = _free;
+	_free = x;
+      }
+    }
+
+    int size() const { return _count; }
+    int capacity() const { return _capacity; }
+
+    /* raw slot access for walking the table; check _live */
+    int slots() const { return _slots.size(); }
+    const Entry &slot(int n) const { return _slots[n]; }
+
+    Entry *find(const IPFlowID &id) {
+      _lookups++;
+      int pos = lookup(id);
+      if (pos < 0)
+	return 0;
+      _hits++;
+      return &_slots[_index[pos]];
+    }
+
+    /* caller must have checked that id is not in the table */
+    Entry *insert(const IPFlowID &id, const T &data, unsigned timeout) {
+      if (_free < 0) {
+	_full++;
+	evict();
+      }
+      if (!_count) {
+	/* nothing on the wheel, skip the ticks nobody expired */
+	_cursor = tick(Timestamp::now());
+      }
+      int n = _free;
+      Entry &e = _slots[n];
+      _free = e._next;
+      e._id = id;
+      e._data = data;
+      e._expire = Timestamp::now() + Timestamp::make_msec(timeout);
+      e._live = true;
+      _count++;
+      _inserts++;
+
+      int pos = bucket(id);
+      while (_index[pos] >= 0)
+	pos = (pos + 1) & _mask;
+      _index[pos] = n;
+      file(n);
+      return &e;
+    }
+
+    /* the entry now expires timeout msec from now */
+    void touch(Entry *e, unsigned timeout) {
+      Timestamp expire = Timestamp::now() + Timestamp::make_msec(timeout);
+      if (expire < e->_expire) {
+	/* expiry moved earlier, as when a flow closes */
+	e->_expire = expire;
+	int n = e - _slots.begin();
+	unlink(n);
+	file(n);
+      } else
+	e->_expire = expire;
+    }
+
+    void remove(Entry *e) {
+      release(e - _slots.begin());
+    }
+
+    /* drop everything that expired up to now */
+    void expire(const Timestamp &now) {
+      int64_t t = tick(now);
+      if (t - _cursor > WHEEL)
+	_cursor = t - WHEEL;
+      while (_cursor < t) {
+	int b = _cursor & (WHEEL - 1);
+	int n = _wheel[b];
+	_wheel[b] = -1;
+	_cursor++;
+	while (n >= 0) {
+	  int next = _slots[n]._next;
+	  _slots[n]._bucket = -1;
+	  if (_slots[n]._expire < now) {
+	    _expired++;
+	    drop(n);
+	  } else
+	    file(n);
+	  n = next;
+	}
+      }
+    }
+
+    void clear() {
+      for (int x = 0; x < _slots.size(); x++)
+	if (_slots[x]._live)
+	  release(x);
+    }
+
+    void reset_stats() {
+      _lookups = _hits = _inserts = _evictions = _expired = _full = 0;
+    }
+
+    String stats() const {
+      StringAccum sa;
+      sa << "entries " << _count;
+      sa << " capacity " << _capacity;
+      sa << " lookups " << _lookups;
+      sa << " hits " << _hits;
+      sa << " inserts " << _inserts;
+      sa << " evictions " << _evictions;
+      sa << " expired " << _expired;
+      sa << " full " << _full << "\n";
+      return sa.take_string();
+    }
+
+  private:
+
+    Vector<Entry> _slots;
+    Vector<int> _index;
+    Vector<int> _wheel;
+    int64_t _cursor; /* first tick not yet expired */
+    int _capacity;
+    int _mask;
+    int _count;
+    int _free;
+
+    uint32_t _lookups;
+    uint32_t _hits;
+    uint32_t _inserts;
+    uint32_t _evictions;
+    uint32_t _expired;
+    uint32_t _full;
+
+    static int64_t tick(const Timestamp &t) {
+      return t.msecval() / TICK;
+    }
+
+    int bucket(const IPFlowID &id) const {
+      uint32_t h = id.hashcode();
+      h ^= h >> 16;
+      h *= 0x85EBCA6BU;
+      h ^= h >> 13;
+      return h & _mask;
+    }
+
+    int lookup(const IPFlowID &id) const {
+      int pos = bucket(id);
+      while (_index[pos] >= 0) {
+	if (_slots[_index[pos]]._id == id)
+	  return pos;
+	pos = (pos + 1) & _mask;
+      }
+      return -1;
+    }
+
+    /* put slot n on the bucket for its expiry, or the last one in reach */
+    void file(int n) {
+      Entry &e = _slots[n];
+      int64_t t = tick(e._expire);
+      if (t < _cursor)
+	t = _cursor;
+      if (t > _cursor + WHEEL - 1)
+	t = _cursor + WHEEL - 1;
+      int b = t & (WHEEL - 1);
+      e._bucket = b;
+      e._prev = -1;
+      e._next = _wheel[b];
+      if (e._next >= 0)
+	_slots[e._next]._prev = n;
+      _wheel[b] = n;
+    }
+
+    void unlink(int n) {
+      Entry &e = _slots[n];
+      if (e._prev >= 0)
+	_slots[e._prev]._next = e._next;
+      else if (e._bucket >= 0)
+	_wheel[e._bucket] = e._next;
+      if (e._next >= 0)
+	_slots[e._next]._prev = e._prev;
+      e._prev = e._next = -1;
+      e._bucket = -1;
+    }
+
+    void release(int n) {
+      unlink(n);
+      drop(n);
+    }
+
+    /* free slot n, which is already off the wheel */
+    void drop(int n) {
+      Entry &e = _slots[n];
+      int i = lookup(e._id);
+      e._live = false;
+      e._data = T();
+      e._next = _free;
+      _free = n;
+      _count--;
+      if (i < 0)
+	return;
+      for (;;) {
+	_index[i] = -1;
+	int j = i;
+	for (;;) {
+	  j = (j + 1) & _mask;
+	  if (_index[j] < 0)
+	    return;
+	  int k = bucket(_slots[_index[j]]._id);
+	  if ((i <= j) ? (i < k && k <= j) : (i < k || k <= j))
+	    continue;
+	  break;
+	}
+	_index[i] = _index[j];
+	i = j;
+      }
+    }
+
+    /* make room: drop the entry due first, refiling any that were touched */
+    void evict() {
+      for (int64_t c = _cursor; ; c++) {
+	int b = c & (WHEEL - 1);
+	int n = _wheel[b];
+	while (n >= 0) {
+	  int next = _slots[n]._next;
+	  if (tick(_slots[n]._expire) <= c || c >= _cursor + WHEEL - 1) {
+	    _evictions++;
+	    release(n);
+	    return;
+	  }
+	  unlink(n);
+	  file(n);
+	  n = next;
+	}
+      }
+    }
+
+};
+
+CLICK_ENDDECLS
+#endif
@@ -0,0 +1,78 @@
+#ifndef CLICK_SR2FORWARDQUEUEMULTI_HH
+#define CLICK_SR2FORWARDQUEUEMULTI_HH
+#include <click/glue.hh>
+#include <click/ipaddress.hh>
+#include <click/timestamp.hh>
+#include <click/vector.hh>
+CLICK_DECLS
+
+/*
+ * Pending re-floods, kept as a binary min-heap on the time they are due.
+ * An element owns one timer, scheduled for top()._when, and pops only
+ * the entries that are due when it fires. Entries refer back to the
+ * element's seen cache by (src, seq).
+ */
+class SR2ForwardQueueMulti {
+  public:
+
+    class Item {
+      public:
+	Item() : _seq(0) { }
+	Item(IPAddress src, uint32_t seq, const Timestamp &when)
+	  : _src(src), _seq(seq), _when(when) { }
+	IPAddress _src;
+	uint32_t _seq;
+	Timestamp _when;
+    };
+
+    int size() const { return _heap.size(); }
+    bool empty() const { return _heap.size() == 0; }
+    const Item &top() const { return _heap[0]; }
+    void clear() { _heap.clear(); }
+
+    void push(IPAddress src, uint32_t seq, const Timestamp &when) {
+      _heap.push_back(Item(src, seq, when));
+      int x = _heap.size() - 1;
+      while (x > 0) {
+	int p = (x - 1) / 2;
+	if (!(_heap[x]._when < _heap[p]._when))
+	  break;
+	swap(x, p);
+	x = p;
+      }
+    }
+
+    void pop() {
+      _heap[0] = _heap.back();
+      _heap.pop_back();
+      int n = _heap.size();
+      int x = 0;
+      for (;;) {
+	int l = 2 * x + 1;
+	int r = l + 1;
+	int m = x;
+	if (l < n && _heap[l]._when < _heap[m]._when)
+	  m = l;
+	if (r < n && _heap[r]._when < _heap[m]._when)
+	  m = r;
+	if (m == x)
+	  break;
+	swap(x, m);
+	x = m;
+      }
+    }
+
+  private:
+
+    Vector<Item> _heap;
+
+    void swap(int a, int b) {
+      Item t = _heap[a];
+      _heap[a] = _heap[b];
+      _heap[b] = t;
+    }
+
+};
+
+CLICK_ENDDECLS
+#endif
@@ -99,11 +99,10 @@ SR2GatewayResponderMulti::run_timer(Timer *)
 {
 	if (!_gw_sel->is_gateway()) {
 		IPAddress gateway = _gw_sel->best_gateway();
-		_link_table->dijkstra(false);
-		SR2PathMulti best = _link_table->best_route(gateway, false);
+		SR2RouteHeaderMulti hdr = _link_table->route_header(gateway);
 		
-		if (_link_table->valid_route(best)) {
-			int links = best.size() - 1;
+		if (hdr._valid) {
+			int links = hdr.num_links();
 			int len = sr2packetmulti::len_wo_data(links);
 			if (_debug) {
 				click_chatter("%{element} :: %s :: start_reply %s <- %s\n",
@@ -127,14 +126,7 @@ SR2GatewayResponderMulti::run_timer(Timer *)
 			pk->set_next(links-1);
 			pk->set_qdst(_ip);
 			
-			for (int i = 0; i < links; i++) {
-				pk->set_link(i,
-					     best[i].get_dep(), best[i+1].get_arr(),
-					     _link_table->get_link_metric(best[i].get_dep(), best[i+1].get_arr()),
-					     _link_table->get_link_metric(best[i+1].get_dep(), best[i].get_arr()),
-					     _link_table->get_link_seq(best[i].get_dep(), best[i+1].get_arr()),
-					     _link_table->get_link_age(best[i].get_dep(), best[i+1].get_arr()));
-			}
+			hdr.write_links(pk);
 			
 			IPAddress next_ip = pk->get_link_node(pk->next());
 			uint16_t next_if = pk->get_link_if(pk->next());
@@ -21,6 +21,7 @@
 #include <click/glue.hh>
 #include <click/straccum.hh>
 #include <click/ipaddress.hh>
+#include <click/handlercall.hh>
 #include <clicknet/ether.h>
 #include "arptablemulti.hh"
 #include "availableinterfaces.hh"
@@ -31,12 +32,19 @@
 CLICK_DECLS
 
 SR2GatewaySelectorMulti::SR2GatewaySelectorMulti()
-  :  _ip(),
+  :  _forward_timer(static_forward_ad_hook, this),
+     _ip(),
      _et(0),
      _link_table(0),
      _if_table(0),
      _arp_table(0),
-     _timer(this)
+     _timer(this),
+     _best_metric(0),
+     _best_generation(0),
+     _best_valid(false),
+     _best_hits(0),
+     _best_updates(0),
+     _load(0)
 {
   // Pick a starting sequence number that we have not used before.
   _seq = Timestamp::now().usec();
@@ -50,6 +58,8 @@ int
 SR2GatewaySelectorMulti::configure (Vector<String> &conf, ErrorHandler *errh)
 {
   int ret;
+  int seen_capacity = 100;
+  unsigned int seen_expire = 30000;
   _is_gw = false;
   ret = cp_va_kparse(conf, this, errh,
 		     "ETHTYPE", 0, cpUnsignedShort, &_et,
@@ -60,7 +70,10 @@ SR2GatewaySelectorMulti::configure (Vector<String> &conf, ErrorHandler *errh)
 		     "PERIOD", 0, cpUnsigned, &_period,
 		     "JITTER", 0, cpUnsigned, &_jitter,
 		     "EXPIRE", 0, cpUnsigned, &_expire,
+		     "SEEN_CAPACITY", 0, cpInteger, &seen_capacity,
+		     "SEEN_EXPIRE", 0, cpUnsigned, &seen_expire,
 		     "GW", 0, cpBool, &_is_gw,
+		     "LOAD", 0, cpString, &_load_handler,
 		     cpEnd);
 
   if (!_et) 
@@ -75,6 +88,10 @@ SR2GatewaySelectorMulti::configure (Vector<String> &conf, ErrorHandler *errh)
     return errh->error("AvailableInterfaces element is not an AvailableInterfaces");
   if (_arp_table && _arp_table->cast("ARPTableMulti") == 0) 
     return errh->error("ARPTable element is not an ARPtableMulti");
+  if (seen_capacity < 1) 
+    return errh->error("SEEN_CAPACITY must be positive");
+
+  _seen.configure(seen_capacity, seen_expire);
 
   return ret;
 }
@@ -84,6 +101,7 @@ SR2GatewaySelectorMulti::initialize (ErrorHandler *)
 {
   _timer.initialize (this);
   _timer.schedule_now ();
+  _forward_timer.initialize(this);
 
   return 0;
 }
@@ -107,7 +125,7 @@ SR2GatewaySelectorMulti::start_ad()
 
   HashMap<EtherAddress,AvailableInterfaces::LocalIfInfo> my_iftable = _if_table->get_if_list();
 
-	int len = sr2packetmulti::len_wo_data(1);
+	int len = sr2packetmulti::len_wo_data(1) + sizeof(uint32_t);
 	WritablePacket *p = Packet::make(len + sizeof(click_ether));
 	if(p == 0)
 	  return;
@@ -126,11 +144,35 @@ SR2GatewaySelectorMulti::start_ad()
 	int my_iface = _if_table->lookup_def_id();
 	
 	pk->set_link_if(0,my_iface);
+	pk->set_gw_load(read_load());
 
 	send(p,my_eth);
   
 }
 
+/*
+ * Load advertised with our ads. The LOAD handler, for instance a queue 
+ * length or a Counter's byte_rate, overrides the value set through the 
+ * "load" handler. Fractions are dropped.
+ */
+uint32_t
+SR2GatewaySelectorMulti::read_load()
+{
+  if (!_load_handler) {
+    return _load;
+  }
+  String s = cp_uncomment(HandlerCall::call_read(_load_handler, this));
+  int dot = s.find_left('.');
+  if (dot >= 0) {
+    s = s.substring(0, dot);
+  }
+  uint32_t load;
+  if (cp_unsigned(s, &load)) {
+    _load = load;
+  }
+  return _load;
+}
+
 void
 SR2GatewaySelectorMulti::send(WritablePacket *p, EtherAddress my_eth)
 {
@@ -160,11 +202,25 @@ void
 SR2GatewaySelectorMulti::forward_ad_hook() 
 {
     Timestamp now = Timestamp::now();
-    for (int x = 0; x < _seen.size(); x++) {
-	if (_seen[x]._to_send < now && !_seen[x]._forwarded) {
-	    forward_ad(&_seen[x]);
+    while (!_pending.empty() && !(now < _pending.top()._when)) {
+	Seen *s = _seen.peek(_pending.top()._src, _pending.top()._seq);
+	_pending.pop();
+	if (s && !s->_forwarded) {
+	    forward_ad(s);
 	}
     }
+    if (!_pending.empty()) {
+	_forward_timer.schedule_at(_pending.top()._when);
+    }
+}
+
+void
+SR2GatewaySelectorMulti::schedule_forward(Seen *s)
+{
+  _pending.push(s->_gw, s->_seq, s->_to_send);
+  if (!_forward_timer.scheduled() || s->_to_send < _forward_timer.expiry()) {
+    _forward_timer.schedule_at(s->_to_send);
+  }
 }
 
 void
@@ -172,11 +228,10 @@ SR2GatewaySelectorMulti::forward_ad(Seen *s)
 {
 
   s->_forwarded = true;
-  _link_table->dijkstra(false);
   IPAddress src = s->_gw;
-  SR2PathMulti best = _link_table->best_route(src, false);
+  SR2RouteHeaderMulti hdr = _link_table->route_header(src);
   
-  if (!_link_table->valid_route(best)) {
+  if (!hdr._valid) {
     click_chatter("%{element} :: %s :: invalid route from src %s\n",
 		  this,
 		  __func__,
@@ -184,9 +239,9 @@ SR2GatewaySelectorMulti::forward_ad(Seen *s)
     return;
   }
 
-  int links = best.size() - 1;
+  int links = hdr.num_links();
 
-  int len = sr2packetmulti::len_wo_data(links);
+  int len = sr2packetmulti::len_wo_data(links) + sizeof(uint32_t);
   WritablePacket *p = Packet::make(len + sizeof(click_ether));
   if(p == 0)
     return;
@@ -200,13 +255,8 @@ SR2GatewaySelectorMulti::forward_ad(Seen *s)
   pk->set_seq(s->_seq);
   pk->set_num_links(links);
 
-  for(int i=0; i < links; i++) {
-    pk->set_link(i, best[i].get_dep(), best[i+1].get_arr(),
-		  _link_table->get_link_metric(best[i].get_dep(), best[i+1].get_arr()),
-		  _link_table->get_link_metric(best[i+1].get_dep(), best[i].get_arr()),
-		  _link_table->get_link_seq(best[i].get_dep(), best[i+1].get_arr()),
-		  _link_table->get_link_age(best[i].get_dep(), best[i+1].get_arr()));
-  }
+  hdr.write_links(pk);
+  pk->set_gw_load(s->_load);
 
   //EtherAddress my_eth = _if_table->lookup_if(best[links].get_arr()._iface);
 	EtherAddress my_eth = _if_table->lookup_def();
@@ -214,28 +264,59 @@ SR2GatewaySelectorMulti::forward_ad(Seen *s)
   send(p,my_eth);
 }
 
+/*
+ * The choice only changes when an ad arrives, the chosen gateway 
+ * expires, the ignore/allow lists change or the link table moves to a
+ * new generation, so it is kept until one of these happens.
+ */
 IPAddress
 SR2GatewaySelectorMulti::best_gateway() 
+{
+  if (_best_valid &&
+      _best_generation == _link_table->generation() &&
+      (!_best_gw || Timestamp::now() < _best_expire)) {
+    _best_hits++;
+    return _best_gw;
+  }
+  return compute_best_gateway();
+}
+
+IPAddress
+SR2GatewaySelectorMulti::compute_best_gateway() 
 {
   IPAddress best_gw = IPAddress();
   int best_metric = 0;
+  Timestamp best_expire;
   Timestamp now = Timestamp::now();
+  _candidates.clear();
   
   for(GWIter iter = _gateways.begin(); iter.live(); iter++) {
-    GWInfo nfo = iter.value();
+    const GWInfo &nfo = iter.value();
     Timestamp expire = nfo._last_update + Timestamp::make_msec(_expire);
-    SR2PathMulti p = _link_table->best_route(nfo._ip, false);
-    int metric = _link_table->get_route_metric(p);
-    if (now < expire &&
-				metric && 
-				((!best_metric) || best_metric > metric) &&
-				!_ignore.findp(nfo._ip) &&
-				(!_allow.size() || _allow.findp(nfo._ip))) {
+    if (!(now < expire) ||
+				_ignore.findp(nfo._ip) ||
+				(_allow.size() && !_allow.findp(nfo._ip))) {
+      continue;
+    }
+    SR2RouteHeaderMulti hdr = _link_table->route_header(nfo._ip);
+    int metric = _link_table->get_route_metric(hdr._path);
+    if (metric) {
+      _candidates.push_back(GWCandidate(nfo._ip, metric, nfo._load));
+    }
+    if (metric && 
+				((!best_metric) || best_metric > metric)) {
 					best_gw = nfo._ip;
       		best_metric = metric;
+      		best_expire = expire;
     }
   }
-  
+
+  _best_gw = best_gw;
+  _best_metric = best_metric;
+  _best_expire = best_expire;
+  _best_generation = _link_table->generation();
+  _best_valid = true;
+  _best_updates++;
   return best_gw;
 }
 
@@ -251,6 +332,9 @@ SR2GatewaySelectorMulti::cleanup() {
       new_table.insert(nfo._ip, nfo);
     }
   }
+  if (new_table.size() != _gateways.size()) {
+    _best_valid = false;
+  }
   _gateways.clear();
   for(GWIter iter = new_table.begin(); iter.live(); iter++) {
     GWInfo nfo = iter.value();
@@ -325,24 +409,20 @@ SR2GatewaySelectorMulti::push(int, Packet *p_in)
 	  return;
   }
 
-  int si = 0;
   uint32_t seq = pk->seq();
-  for(si = 0; si < _seen.size(); si++){
-    if(gw == _seen[si]._gw && seq == _seen[si]._seq){
-      _seen[si]._count++;
-      p_in->kill();
-      return;
-    }
+  Seen *s = _seen.find(gw, seq);
+  if (s) {
+    s->_count++;
+    p_in->kill();
+    return;
   }
 
-  if (si == _seen.size()) {
-    if (_seen.size() == 100) {
-      _seen.pop_front();
-      si--;
-    }
-    _seen.push_back(Seen(gw, seq, 0, 0));
+  s = _seen.insert(gw, seq, Seen(gw, seq, 0, 0));
+  s->_count++;
+  s->_when = Timestamp::now();
+  if (p_in->length() >= sizeof(click_ether) + pk->hlen_with_data()) {
+    s->_load = pk->gw_load();
   }
-  _seen[si]._count++;
 
   GWInfo *nfo = _gateways.findp(gw);
   if (!nfo) {
@@ -353,8 +433,11 @@ SR2GatewaySelectorMulti::push(int, Packet *p_in)
   }
   
   nfo->_ip = gw;
+  nfo->_load = s->_load;
   nfo->_last_update = Timestamp::now();
   nfo->_seen++;
+  _best_valid = false;
+  _link_table->keep_host(gw);
 
   if (_is_gw) {
     p_in->kill();
@@ -364,11 +447,9 @@ SR2GatewaySelectorMulti::push(int, Packet *p_in)
   /* schedule timer */
   int delay = click_random(1, _jitter);
   
-  _seen[si]._to_send = _seen[si]._when + Timestamp::make_msec(delay);
-  _seen[si]._forwarded = false;
-  Timer *t = new Timer(static_forward_ad_hook, (void *) this);
-  t->initialize(this);
-  t->schedule_after_msec(delay);
+  s->_to_send = s->_when + Timestamp::make_msec(delay);
+  s->_forwarded = false;
+  schedule_forward(s);
 
   p_in->kill();
   return;
@@ -383,6 +464,7 @@ SR2GatewaySelectorMulti::print_gateway_stats()
       GWInfo nfo = iter.value();
       sa << nfo._ip.unparse().c_str() << " ";
       sa << "seen " << nfo._seen << " ";
+      sa << "load " << nfo._load << " ";
       sa << "first_update " << now - nfo._first_update << " ";
       sa << "last_update " << now - nfo._last_update << " ";
       
@@ -394,7 +476,7 @@ SR2GatewaySelectorMulti::print_gateway_stats()
   return sa.take_string();
 }
 
-enum { H_IS_GATEWAY, H_GATEWAY_STATS, H_ALLOW, H_ALLOW_ADD, H_ALLOW_DEL, H_ALLOW_CLEAR, H_IGNORE, H_IGNORE_ADD, H_IGNORE_DEL, H_IGNORE_CLEAR};
+enum { H_IS_GATEWAY, H_GATEWAY_STATS, H_ALLOW, H_ALLOW_ADD, H_ALLOW_DEL, H_ALLOW_CLEAR, H_IGNORE, H_IGNORE_ADD, H_IGNORE_DEL, H_IGNORE_CLEAR, H_SEEN_STATS, H_BEST_GATEWAY, H_LOAD};
 
 String
 SR2GatewaySelectorMulti::read_handler(Element *e, void *thunk)
@@ -405,6 +487,17 @@ SR2GatewaySelectorMulti::read_handler(Element *e, void *thunk)
     return String(f->_is_gw) + "\n";
   case H_GATEWAY_STATS:
     return f->print_gateway_stats();
+  case H_SEEN_STATS:
+    return f->_seen.stats();
+  case H_LOAD:
+    return String(f->read_load()) + "\n";
+  case H_BEST_GATEWAY: {
+    StringAccum sa;
+    IPAddress gw = f->best_gateway();
+    sa << gw << " metric " << f->_best_metric;
+    sa << " hits " << f->_best_hits << " updates " << f->_best_updates << "\n";
+    return sa.take_string();
+  }
   case H_IGNORE: {
     StringAccum sa;
     for (IPIter iter = f->_ignore.begin(); iter.live(); iter++) {
@@ -480,7 +573,16 @@ SR2GatewaySelectorMulti::write_handler(const String &in_s, Element *e, void *vpa
       f->_allow.clear();
       break;
     }
+    case H_LOAD: {  
+      uint32_t load;
+      if (!cp_unsigned(s, &load)) {
+        return errh->error("load parameter must be unsigned");
+      }
+      f->_load = load;
+      break;
+    }
   }
+  f->_best_valid = false;
   return 0;
 }
 
@@ -489,6 +591,9 @@ SR2GatewaySelectorMulti::add_handlers()
 {
   add_read_handler("is_gateway", read_handler, (void *) H_IS_GATEWAY);
   add_read_handler("gateway_stats", read_handler, (void *) H_GATEWAY_STATS);
+  add_read_handler("seen_stats", read_handler, (void *) H_SEEN_STATS);
+  add_read_handler("best_gateway", read_handler, (void *) H_BEST_GATEWAY);
+  add_read_handler("load", read_handler, (void *) H_LOAD);
   add_read_handler("ignore", read_handler, (void *) H_IGNORE);
   add_read_handler("allow", read_handler, (void *) H_ALLOW);
 
@@ -499,6 +604,7 @@ SR2GatewaySelectorMulti::add_handlers()
   add_write_handler("allow_add", write_handler, (void *) H_ALLOW_ADD);
   add_write_handler("allow_del", write_handler, (void *) H_ALLOW_DEL);
   add_write_handler("allow_clear", write_handler, (void *) H_ALLOW_CLEAR);
+  add_write_handler("load", write_handler, (void *) H_LOAD);
 }
 
 CLICK_ENDDECLS
@@ -9,6 +9,8 @@
 #include <click/hashmap.hh>
 #include <click/dequeue.hh>
 #include <elements/wifi/path.hh>
+#include "sr2seencachemulti.hh"
+#include "sr2forwardqueuemulti.hh"
 CLICK_DECLS
 
 /*
@@ -45,6 +47,25 @@ class SR2GatewaySelectorMulti : public Element {
   void run_timer(Timer *);
 
   IPAddress best_gateway();
+  void invalidate_best_gateway() { _best_valid = false; }
+
+  class GWCandidate {
+  public:
+    GWCandidate() : _metric(0), _load(0) { }
+    GWCandidate(IPAddress ip, int metric, uint32_t load) 
+      : _ip(ip), _metric(metric), _load(load) { }
+    IPAddress _ip;
+    int _metric;
+    uint32_t _load;
+  };
+
+  /* gateways with a usable route, valid until gateway_updates() moves */
+  const Vector<GWCandidate> &gateways() { best_gateway(); return _candidates; }
+  /*
+   * ads, expiries and list changes only invalidate the choice, so this
+   * redoes it first if needed, or the count would not move
+   */
+  uint32_t gateway_updates() { best_gateway(); return _best_updates; }
   bool is_gateway() { return _is_gw; }
 
   bool update_link(NodeAddress from, NodeAddress to, uint32_t seq, uint32_t metric);
@@ -58,11 +79,12 @@ private:
   // List of query sequence #s that we've already seen.
   class Seen {
    public:
-    Seen();
+    Seen() : _seq(0), _count(0), _forwarded(false), _load(0) { }
     Seen(IPAddress gw, u_long seq, int fwd, int rev) {
 	_gw = gw; 
 	_seq = seq; 
 	_count = 0;
+	_load = 0;
 	(void) fwd, (void) rev;
     }
     IPAddress _gw;
@@ -71,9 +93,12 @@ private:
     Timestamp _when; /* when we saw the first query */
     Timestamp _to_send;
     bool _forwarded;
+    uint32_t _load;
   };
   
-  DEQueue<Seen> _seen;
+  SR2SeenCacheMulti<Seen> _seen;
+  SR2ForwardQueueMulti _pending;
+  Timer _forward_timer;
 
   class GWInfo {
   public:
@@ -82,12 +107,14 @@ private:
 		_ip(e._ip),
 		_first_update(e._first_update),
 		_last_update(e._last_update),
-		_seen(e._seen) {
+		_seen(e._seen),
+		_load(e._load) {
 	}
     IPAddress _ip;
     Timestamp _first_update;
     Timestamp _last_update;
     int _seen;
+    uint32_t _load;
   };
 
   typedef HashMap<IPAddress, GWInfo> GWTable;
@@ -115,10 +142,27 @@ private:
 
   Timer _timer;
 
+  /* best_gateway() cache */
+  IPAddress _best_gw;
+  int _best_metric;
+  Timestamp _best_expire;
+  uint32_t _best_generation;
+  bool _best_valid;
+  uint32_t _best_hits;
+  uint32_t _best_updates;
+  Vector<GWCandidate> _candidates;
+
+  String _load_handler; // read handler giving our load, when we are a gateway
+  uint32_t _load;
+
+  uint32_t read_load();
+
+  IPAddress compute_best_gateway();
   void start_ad();
   void send(WritablePacket *, EtherAddress);
   void forward_ad(Seen *s);
   void forward_ad_hook();
+  void schedule_forward(Seen *s);
   void cleanup();
 
   static int write_handler(const String &, Element *, void *, ErrorHandler *);
@@ -0,0 +1,193 @@
+#ifndef CLICK_SR2HOPACKMULTI_HH
+#define CLICK_SR2HOPACKMULTI_HH
+#include <click/glue.hh>
+#include <click/ipaddress.hh>
+#include <click/packet.hh>
+#include <click/timestamp.hh>
+#include <click/vector.hh>
+#include <click/straccum.hh>
+CLICK_DECLS
+
+/*
+ * Per-hop acknowledgements for channel control packets.
+ *
+ * A packet handed to insert() is kept, keyed on (origin, seq, type),
+ * until every node it waits for has acked it: the next hop for a source
+ * routed packet, each known neighbour for a broadcast. due() hands out a
+ * copy of every packet not fully acked within RETRY msec, and a packet
+ * still not acked after RETRIES resends is dropped and counted as
+ * failed. The interval is fixed, so a hop is done or given up on within
+ * (RETRIES + 1) * RETRY msec.
+ */
+class SR2HopAckMulti {
+  public:
+
+    class Entry {
+      public:
+	Entry() : _seq(0), _type(0), _p(0), _tries(0) { }
+	IPAddress _origin;
+	uint32_t _seq;
+	int _type;
+	Packet *_p;
+	Vector<IPAddress> _waiting;
+	int _tries;
+	Timestamp _first;
+	Timestamp _next;
+    };
+
+    SR2HopAckMulti() : _retry(100), _retries(3), _sent(0), _resent(0),
+		       _acked(0), _failed(0) { }
+
+    ~SR2HopAckMulti() {
+      for (int x = 0; x < _entries.size(); x++) {
+	_entries[x]._p->kill();
+      }
+    }
+
+    void configure(unsigned retry, unsigned retries) {
+      _retry = retry;
+      _retries = retries;
+    }
+    unsigned retry() const { return _retry; }
+    unsigned retries() const { return _retries; }
+    int pending() const { return _entries.size(); }
+
+    /*
+     * keeps p until everyone in waiting has acked it, returns the packet
+     * to send now: a copy, or p itself when nobody has to ack
+     */
+    Packet *insert(IPAddress origin, uint32_t seq, int type, Packet *p,
+		   const Vector<IPAddress> &waiting) {
+      _sent++;
+      if (!waiting.size()) {
+	return p;
+      }
+      Packet *copy = p->clone();
+      if (!copy) {
+	return p;
+      }
+      Entry e;
+      e._origin = origin;
+      e._seq = seq;
+      e._type = type;
+      e._p = p;
+      e._waiting = waiting;
+      e._tries = 1;
+      e._first = Timestamp::now();
+      e._next = e._first + Timestamp::make_msec(_retry);
+      _entries.push_back(e);
+      return copy;
+    }
+
+    /* from acked (origin, seq, type), true if that was still pending */
+    bool ack(IPAddress origin, uint32_t seq, int type, IPAddress from) {
+      for (int x = 0; x < _entries.size(); x++) {
+	Entry &e = _entries[x];
+	if (e._origin != origin || e._seq != seq || e._type != type) {
+	  continue;
+	}
+	bool found = false;
+	for (int y = 0; y < e._waiting.size(); y++) {
+	  if (e._waiting[y] == from) {
+	    e._waiting[y] = e._waiting.back();
+	    e._waiting.pop_back();
+	    found = true;
+	    break;
+	  }
+	}
+	if (found && !e._waiting.size()) {
+	  Timestamp delay = Timestamp::now() - e._first;
+	  _acked++;
+	  _delay_total += delay;
+	  if (_delay_max < delay) {
+	    _delay_max = delay;
+	  }
+	  remove(x);
+	}
+	return found;
+      }
+      return false;
+    }
+
+    /* appends a copy of every packet due for a resend, drops the failed */
+    void due(Vector<Packet *> &out) {
+      Timestamp now = Timestamp::now();
+      for (int x = 0; x < _entries.size(); ) {
+	Entry &e = _entries[x];
+	if (now < e._next) {
+	  x++;
+	  continue;
+	}
+	if (e._tries > (int) _retries) {
+	  _failed++;
+	  remove(x);
+	  continue;
+	}
+	if (Packet *copy = e._p->clone()) {
+	  out.push_back(copy);
+	}
+	e._tries++;
+	e._next = now + Timestamp::make_msec(_retry);
+	_resent++;
+	x++;
+      }
+    }
+
+    /* when due() next has work, false if nothing is pending */
+    bool next_due(Timestamp *when) const {
+      if (!_entries.size()) {
+	return false;
+      }
+      *when = _entries[0]._next;
+      for (int x = 1; x < _entries.size(); x++) {
+	if (_entries[x]._next < *when) {
+	  *when = _entries[x]._next;
+	}
+      }
+      return true;
+    }
+
+    void reset_stats() {
+      _sent = _resent = _acked = _failed = 0;
+      _delay_total = _delay_max = Timestamp();
+    }
+
+    String stats() const {
+      StringAccum sa;
+      sa << "sent " << _sent;
+      sa << " resent " << _resent;
+      sa << " acked " << _acked;
+      sa << " failed " << _failed;
+      sa << " pending " << _entries.size();
+      sa << " retry " << _retry;
+      sa << " retries " << _retries;
+      sa << " avg_ack_msec " << (_acked ? _delay_total.msecval() / _acked : 0);
+      sa << " max_ack_msec " << _delay_max.msecval() << "\n";
+      return sa.take_string();
+    }
+
+  private:
+
+    Vector<Entry> _entries;
+    unsigned _retry; // msecs
+    unsigned _retries;
+
+    uint32_t _sent;
+    uint32_t _resent;
+    uint32_t _acked;
+    uint32_t _failed;
+    Timestamp _delay_total;
+    Timestamp _delay_max;
+
+    void remove(int x) {
+      _entries[x]._p->kill();
+      if (x != _entries.size() - 1) {
+	_entries[x] = _entries.back();
+      }
+      _entries.pop_back();
+    }
+
+};
+
+CLICK_ENDDECLS
+#endif
@@ -49,10 +49,21 @@ SR2LinkMetricMulti::configure(Vector<String> &conf, ErrorHandler *errh)
 }
 
 void
-SR2LinkMetricMulti::update_link(NodeAddress, NodeAddress, 
-			   Vector<SR2RateSize>, 
-			   Vector<int>, Vector<int>, 
-			   uint32_t) {}
+SR2LinkMetricMulti::update_link(NodeAddress from, NodeAddress to, 
+			   const Vector<SR2RateSize> &rs, 
+			   const Vector<int> &fwd, const Vector<int> &rev, 
+			   uint32_t seq)
+{
+  SR2LinkBatchMulti batch;
+  batch.add_link(from, to, seq);
+  for (int x = 0; x < rs.size(); x++) {
+    batch.add_rate(rs[x], fwd[x], rev[x]);
+  }
+  update_links(batch);
+}
+
+void
+SR2LinkMetricMulti::update_links(const SR2LinkBatchMulti &) {}
 
 ELEMENT_REQUIRES(bitrate)
 ELEMENT_PROVIDES(SR2LinkMetricMulti)
@@ -4,6 +4,49 @@
 #include "sr2ettstatmulti.hh"
 CLICK_DECLS
 
+/*
+ * Probe results of several links, handed to a SR2LinkMetricMulti in one 
+ * call. The (rate, size), fwd and rev values of all links are kept in 
+ * three flat vectors, each link points at its own range.
+ */
+class SR2LinkBatchMulti {
+  public:
+
+    class Link {
+      public:
+	Link(NodeAddress from, NodeAddress to, uint32_t seq, int first) 
+	  : _from(from), _to(to), _seq(seq), _first(first), _count(0) { }
+	NodeAddress _from;
+	NodeAddress _to;
+	uint32_t _seq;
+	int _first;
+	int _count;
+    };
+
+    Vector<Link> _links;
+    Vector<SR2RateSize> _rs;
+    Vector<int> _fwd;
+    Vector<int> _rev;
+
+    int size() const { return _links.size(); }
+
+    void add_link(NodeAddress from, NodeAddress to, uint32_t seq) {
+      _links.push_back(Link(from, to, seq, _rs.size()));
+    }
+    void add_rate(SR2RateSize rs, int fwd, int rev) {
+      _rs.push_back(rs);
+      _fwd.push_back(fwd);
+      _rev.push_back(rev);
+      _links.back()._count++;
+    }
+    void clear() {
+      _links.clear();
+      _rs.clear();
+      _fwd.clear();
+      _rev.clear();
+    }
+};
+
 class SR2LinkMetricMulti : public Element {
  public:
 
@@ -15,10 +58,11 @@ class SR2LinkMetricMulti : public Element {
 
   int configure(Vector<String> &, ErrorHandler *);
 
-  virtual void update_link(NodeAddress, NodeAddress, 
-			   Vector<SR2RateSize>, 
-			   Vector<int>, Vector<int>, 
-			   uint32_t);
+  void update_link(NodeAddress, NodeAddress, 
+		   const Vector<SR2RateSize> &, 
+		   const Vector<int> &, const Vector<int> &, 
+		   uint32_t);
+  virtual void update_links(const SR2LinkBatchMulti &);
 
  protected:
 
@@ -25,12 +25,28 @@
 #include "sr2linktablemulti.hh"
 #include "sr2nodemulti.hh"
 #include "sr2pathmulti.hh"
+#include "sr2packetmulti.hh"
 
 CLICK_DECLS
 
 SR2LinkTableMulti::SR2LinkTableMulti()
-  : _timer(this)
+  : _path_metric(PATH_WCETT),
+    _wcett_beta(50),
+    _bench_iterations(0),
+    _generation(1),
+    _header_builds(0),
+    _header_hits(0),
+    _max_hosts(0),
+    _max_links(0),
+    _evicted_hosts(0),
+    _evicted_links(0),
+    _eviction_runs(0),
+    _pruned_hosts(0),
+    _hosts_mark(0),
+    _links_mark(0),
+    _timer(this)
 {
+  _dijkstra_generation[0] = _dijkstra_generation[1] = 0;
 }
 
 
@@ -73,13 +89,30 @@ SR2LinkTableMulti::configure (Vector<String> &conf, ErrorHandler *errh)
 {
   int ret;
   int stale_period = 120;
+  String metric = "WCETT";
   ret = cp_va_kparse(conf, this, errh,
 		     "IP", 0, cpIPAddress, &_ip,		
 		     "STALE", 0, cpUnsigned, &stale_period,
+		     "METRIC", 0, cpWord, &metric,
+		     "BETA", 0, cpUnsigned, &_wcett_beta,
+		     "MAX_HOSTS", 0, cpInteger, &_max_hosts,
+		     "MAX_LINKS", 0, cpInteger, &_max_links,
 		     cpEnd);
 
   if (!_ip)
     return errh->error("IP not specified");
+  _path_metric = PATH_NMETRICS;
+  for (int m = 0; m < PATH_NMETRICS; m++) {
+    if (metric == path_metric_name(m)) {
+      _path_metric = m;
+    }
+  }
+  if (_path_metric == PATH_NMETRICS)
+    return errh->error("METRIC must be one of ETT, WCETT, HOPCOUNT or BOTTLENECK");
+  if (_wcett_beta > 100)
+    return errh->error("BETA must be between 0 and 100");
+  if (_max_hosts < 0 || _max_links < 0)
+    return errh->error("MAX_HOSTS and MAX_LINKS must not be negative");
 
   _stale_timeout.assign(stale_period, 0);
   _hosts.insert(_ip, SR2HostInfoMulti(_ip));
@@ -89,11 +122,14 @@ SR2LinkTableMulti::configure (Vector<String> &conf, ErrorHandler *errh)
 
 void
 SR2LinkTableMulti::take_state(Element *e, ErrorHandler *) {
+  Locked locked(_lock);
   SR2LinkTableMulti *q = (SR2LinkTableMulti *)e->cast("SR2LinkTableMulti");
   if (!q) return;
 
   _hosts = q->_hosts;
   _links = q->_links;
+  rebuild_adjacency();
+  _generation++;
   dijkstra(true);
   dijkstra(false);
 }
@@ -109,43 +145,45 @@ SR2LinkTableMulti::static_update_link(const String &arg, Element *e,
   uint32_t seq;
   uint32_t age;
   uint32_t metric;
+  unsigned from_if;
+  unsigned to_if;
   cp_spacevec(arg, args);
 
-  if (args.size() != 5) {
-    return errh->error("Must have three arguments: currently has %d: %s", args.size(), args[0].c_str());
+  if (args.size() != 7) {
+    return errh->error("Must have seven arguments: currently has %d", args.size());
   }
 
+  if (!cp_ip_address(args[0], &from._ipaddr)) {
+    return errh->error("Couldn't read IPAddress out of from");
+  }
 
-// Give a look here:
-
-//  if (!cp_ip_address(args[0]._ipaddr, &from)) {
-//    return errh->error("Couldn't read IPAddress out of from");
-//  }
-
-// Add here the checking code that can check the interface
-// of type uint16_t
-
-// Give a look here:
+  if (!cp_unsigned(args[1], &from_if) || from_if > 0xFFFF) {
+    return errh->error("Couldn't read interface out of from");
+  }
 
-//  if (!cp_ip_address(args[1]._ipaddr, &to)) {
-//    return errh->error("Couldn't read IPAddress out of to");
-//  }
+  if (!cp_ip_address(args[2], &to._ipaddr)) {
+    return errh->error("Couldn't read IPAddress out of to");
+  }
 
-// Add here the checking code that can check the interface
-// of type uint16_t
+  if (!cp_unsigned(args[3], &to_if) || to_if > 0xFFFF) {
+    return errh->error("Couldn't read interface out of to");
+  }
 
-  if (!cp_unsigned(args[2], &metric)) {
+  if (!cp_unsigned(args[4], &metric)) {
     return errh->error("Couldn't read metric");
   }
 
-  if (!cp_unsigned(args[3], &seq)) {
+  if (!cp_unsigned(args[5], &seq)) {
     return errh->error("Couldn't read seq");
   }
 
-  if (!cp_unsigned(args[4], &age)) {
+  if (!cp_unsigned(args[6], &age)) {
     return errh->error("Couldn't read age");
   }
 
+  from._iface = from_if;
+  to._iface = to_if;
+
   n->update_link(from, to, seq, age, metric);
   return 0;
 
@@ -155,8 +193,12 @@ SR2LinkTableMulti::static_update_link(const String &arg, Element *e,
 void
 SR2LinkTableMulti::clear()
 {
+  Locked locked(_lock);
   _hosts.clear();
   _links.clear();
+  _adjacency.clear();
+  _route_headers.clear();
+  _generation++;
 
 }
 
@@ -165,6 +207,7 @@ bool
 SR2LinkTableMulti::update_link(NodeAddress from, NodeAddress to,
 		       uint32_t seq, uint32_t age, uint32_t metric)
 {
+  Locked locked(_lock);
   if (!from || !to || !metric) {
     return false;
   }
@@ -173,37 +216,304 @@ SR2LinkTableMulti::update_link(NodeAddress from, NodeAddress to,
   }
 
   /* make sure both the hosts exist */
-  SR2HostInfoMulti *nfrom = _hosts.findp(from._ipaddr);
-  if (!nfrom) {
-    SR2HostInfoMulti foo = SR2HostInfoMulti(from._ipaddr);
-    _hosts.insert(from._ipaddr, foo);
-    nfrom = _hosts.findp(from._ipaddr);
-  }
-  SR2HostInfoMulti *nto = _hosts.findp(to._ipaddr);
-  if (!nto) {
-    _hosts.insert(to._ipaddr, SR2HostInfoMulti(to._ipaddr));
-    nto = _hosts.findp(to._ipaddr);
-  }
-
-  nfrom->new_interface(from._iface);
-  nto->new_interface(to._iface);
-
-  assert(nfrom);
-  assert(nto);
+  touch_host(from);
+  touch_host(to);
 
   NodePair p = NodePair(from, to);
   SR2LinkInfoMulti *lnfo = _links.findp(p);
   if (!lnfo) {
     _links.insert(p, SR2LinkInfoMulti(from, to, seq, age, metric));
+    index_link(p);
+    _generation++;
   } else {
+    unsigned old_metric = lnfo->_metric;
     lnfo->update(seq, age, metric);
+    if (lnfo->_metric != old_metric) {
+      _generation++;
+    }
+  }
+  if (eviction_due()) {
+    enforce_limits();
   }
   return true;
 }
 
+/*
+ * Applies a whole batch of link updates, metric, rate, probe and retries 
+ * of each link are set with a single lookup. Returns the number of links
+ * that were updated.
+ */
+int
+SR2LinkTableMulti::update_links(const Vector<SR2LinkUpdateMulti> &updates)
+{
+  Locked locked(_lock);
+  int updated = 0;
+  for (int x = 0; x < updates.size(); x++) {
+    const SR2LinkUpdateMulti &u = updates[x];
+    if (!u._from || !u._to || !u._metric) {
+      continue;
+    }
+    if (_stale_timeout.sec() < (int) u._age) {
+      continue;
+    }
+
+    touch_host(u._from);
+    touch_host(u._to);
+
+    NodePair p = NodePair(u._from, u._to);
+    SR2LinkInfoMulti *lnfo = _links.findp(p);
+    if (!lnfo) {
+      _links.insert(p, SR2LinkInfoMulti(u._from, u._to, u._seq, u._age, u._metric));
+      index_link(p);
+      lnfo = _links.findp(p);
+      _generation++;
+    } else {
+      unsigned old_metric = lnfo->_metric;
+      lnfo->update(u._seq, u._age, u._metric);
+      if (lnfo->_metric != old_metric) {
+	_generation++;
+      }
+    }
+    updated++;
+
+    if (_blacklist.size() && 
+	(_blacklist.findp(u._from._ipaddr) || _blacklist.findp(u._to._ipaddr))) {
+      continue;
+    }
+    if (u._rate) {
+      lnfo->_rate = u._rate;
+    }
+    if (u._probe) {
+      lnfo->_probe = u._probe;
+    }
+    if (u._retries) {
+      lnfo->_retries = u._retries;
+    }
+  }
+  if (eviction_due()) {
+    enforce_limits();
+  }
+  return updated;
+}
+
+void
+SR2LinkTableMulti::touch_host(NodeAddress node)
+{
+  SR2HostInfoMulti *nfo = _hosts.findp(node._ipaddr);
+  if (!nfo) {
+    _hosts.insert(node._ipaddr, SR2HostInfoMulti(node._ipaddr));
+    nfo = _hosts.findp(node._ipaddr);
+    _generation++;
+  }
+  assert(nfo);
+  nfo->new_interface(node._iface);
+  nfo->_last_seen = Timestamp::now();
+}
+
+void
+SR2LinkTableMulti::keep_host(IPAddress ip)
+{
+  Locked locked(_lock);
+  SR2HostInfoMulti *nfo = _hosts.findp(ip);
+  if (nfo) {
+    nfo->_kept = Timestamp::now();
+  }
+}
+
+void
+SR2LinkTableMulti::set_limits(int max_hosts, int max_links)
+{
+  Locked locked(_lock);
+  _max_hosts = max_hosts;
+  _max_links = max_links;
+  if (over_limits()) {
+    enforce_limits();
+  }
+}
+
+class SR2EvictHostMulti {
+public:
+  IPAddress _ip;
+  int _links;
+  Timestamp _last_seen;
+};
+
+class SR2EvictLinkMulti {
+public:
+  NodePair _pair;
+  Timestamp _last_updated;
+};
+
+static int evict_host_sorter(const void *va, const void *vb, void *) {
+  const SR2EvictHostMulti *a = (const SR2EvictHostMulti *) va;
+  const SR2EvictHostMulti *b = (const SR2EvictHostMulti *) vb;
+  if (!a->_links != !b->_links) {
+    return a->_links ? 1 : -1;
+  }
+  if (a->_last_seen == b->_last_seen) {
+    return 0;
+  }
+  return (a->_last_seen < b->_last_seen) ? -1 : 1;
+}
+
+static int evict_link_sorter(const void *va, const void *vb, void *) {
+  const SR2EvictLinkMulti *a = (const SR2EvictLinkMulti *) va;
+  const SR2EvictLinkMulti *b = (const SR2EvictLinkMulti *) vb;
+  if (a->_last_updated == b->_last_updated) {
+    return 0;
+  }
+  return (a->_last_updated < b->_last_updated) ? -1 : 1;
+}
+
+void
+SR2LinkTableMulti::enforce_limits()
+{
+  Timestamp now = Timestamp::now();
+  typedef HashMap<IPAddress, int> IPCount;
+  IPCount keep;
+  IPCount links_per_host;
+  _eviction_runs++;
+
+  /* ourselves and our neighbours */
+  keep.insert(_ip, 1);
+  for (SR2LTIterMulti iter = _links.begin(); iter.live(); iter++) {
+    const SR2LinkInfoMulti &nfo = iter.value();
+    if (nfo._from._ipaddr == _ip) {
+      keep.insert(nfo._to._ipaddr, 1);
+    } else if (nfo._to._ipaddr == _ip) {
+      keep.insert(nfo._from._ipaddr, 1);
+    }
+    for (int x = 0; x < 2; x++) {
+      IPAddress ip = x ? nfo._to._ipaddr : nfo._from._ipaddr;
+      int *n = links_per_host.findp(ip);
+      if (n) {
+	(*n)++;
+      } else {
+	links_per_host.insert(ip, 1);
+      }
+    }
+  }
+
+  /* kept destinations and the hosts on their routes */
+  Vector<IPAddress> kept;
+  for (SR2HTIterMulti iter = _hosts.begin(); iter.live(); iter++) {
+    const SR2HostInfoMulti &nfo = iter.value();
+    if (nfo._kept && now < nfo._kept + _stale_timeout) {
+      kept.push_back(nfo._ip);
+    }
+  }
+  if (kept.size()) {
+    refresh_dijkstra(true);
+    refresh_dijkstra(false);
+  }
+  for (int x = 0; x < kept.size(); x++) {
+    keep.insert(kept[x], 1);
+    for (int from_me = 0; from_me < 2; from_me++) {
+      Vector<NodeAirport> route = best_route(kept[x], from_me);
+      for (int y = 0; y < route.size(); y++) {
+	keep.insert(route[y]._ipaddr, 1);
+      }
+    }
+  }
+
+  int removed_links = 0;
+  int removed_hosts = 0;
+  if (_max_hosts && _hosts.size() > _max_hosts) {
+    int target = _max_hosts - _max_hosts / 10;
+    Vector<SR2EvictHostMulti> victims;
+    for (SR2HTIterMulti iter = _hosts.begin(); iter.live(); iter++) {
+      const SR2HostInfoMulti &nfo = iter.value();
+      if (keep.findp(nfo._ip)) {
+	continue;
+      }
+      SR2EvictHostMulti v;
+      v._ip = nfo._ip;
+      int *n = links_per_host.findp(nfo._ip);
+      v._links = n ? *n : 0;
+      v._last_seen = nfo._last_seen;
+      victims.push_back(v);
+    }
+    click_qsort(victims.begin(), victims.size(), sizeof(SR2EvictHostMulti), evict_host_sorter);
+
+    IPCount gone;
+    for (int x = 0; x < victims.size() && _hosts.size() > target; x++) {
+      _hosts.remove(victims[x]._ip);
+      _route_headers.remove(victims[x]._ip);
+      gone.insert(victims[x]._ip, 1);
+      removed_hosts++;
+    }
+    if (gone.size()) {
+      Vector<NodePair> dead;
+      for (SR2LTIterMulti iter = _links.begin(); iter.live(); iter++) {
+	const SR2LinkInfoMulti &nfo = iter.value();
+	if (gone.findp(nfo._from._ipaddr) || gone.findp(nfo._to._ipaddr)) {
+	  dead.push_back(iter.key());
+	}
+      }
+      for (int x = 0; x < dead.size(); x++) {
+	_links.remove(dead[x]);
+	unindex_link(dead[x]);
+      }
+      removed_links += dead.size();
+    }
+  }
+
+  if (_max_links && _links.size() > _max_links) {
+    int target = _max_links - _max_links / 10;
+    Vector<SR2EvictLinkMulti> victims;
+    for (SR2LTIterMulti iter = _links.begin(); iter.live(); iter++) {
+      const SR2LinkInfoMulti &nfo = iter.value();
+      if (nfo._from._ipaddr == _ip || nfo._to._ipaddr == _ip ||
+	  (keep.findp(nfo._from._ipaddr) && keep.findp(nfo._to._ipaddr))) {
+	continue;
+      }
+      SR2EvictLinkMulti v;
+      v._pair = iter.key();
+      v._last_updated = nfo._last_updated;
+      victims.push_back(v);
+    }
+    click_qsort(victims.begin(), victims.size(), sizeof(SR2EvictLinkMulti), evict_link_sorter);
+    for (int x = 0; x < victims.size() && _links.size() > target; x++) {
+      _links.remove(victims[x]._pair);
+      unindex_link(victims[x]._pair);
+      removed_links++;
+    }
+  }
+  _evicted_hosts += removed_hosts;
+  _evicted_links += removed_links;
+  _hosts_mark = _hosts.size();
+  _links_mark = _links.size();
+
+  if (removed_links || removed_hosts) {
+    _generation++;
+  }
+}
+
+String
+SR2LinkTableMulti::print_memory_stats()
+{
+  Locked locked(_lock);
+  StringAccum sa;
+  size_t bytes = _hosts.size() * sizeof(SR2HostInfoMulti) +
+    _links.size() * sizeof(SR2LinkInfoMulti) +
+    _route_headers.size() * sizeof(SR2RouteHeaderMulti);
+  sa << "hosts " << _hosts.size();
+  sa << " max_hosts " << _max_hosts;
+  sa << " links " << _links.size();
+  sa << " max_links " << _max_links;
+  sa << " headers " << _route_headers.size();
+  sa << " approx_bytes " << bytes;
+  sa << " eviction_runs " << _eviction_runs;
+  sa << " evicted_hosts " << _evicted_hosts;
+  sa << " evicted_links " << _evicted_links;
+  sa << " pruned_hosts " << _pruned_hosts << "\n";
+  return sa.take_string();
+}
+
 SR2LinkTableMulti::SR2LinkMulti
 SR2LinkTableMulti::random_link()
 {
+  Locked locked(_lock);
   int ndx = click_random(0, _links.size() - 1);
   int current_ndx = 0;
   for (SR2LTIterMulti iter = _links.begin(); iter.live(); iter++, current_ndx++) {
@@ -221,6 +531,7 @@ SR2LinkTableMulti::random_link()
 Vector<IPAddress>
 SR2LinkTableMulti::get_hosts()
 {
+  Locked locked(_lock);
   Vector<IPAddress> v;
   for (SR2HTIterMulti iter = _hosts.begin(); iter.live(); iter++) {
     SR2HostInfoMulti n = iter.value();
@@ -233,6 +544,7 @@ SR2LinkTableMulti::get_hosts()
 uint32_t
 SR2LinkTableMulti::get_host_metric_to_me(IPAddress s)
 {
+  Locked locked(_lock);
   if (!s) {
     return 0;
   }
@@ -247,6 +559,7 @@ SR2LinkTableMulti::get_host_metric_to_me(IPAddress s)
 uint32_t
 SR2LinkTableMulti::get_host_metric_from_me(IPAddress s)
 {
+  Locked locked(_lock);
   if (!s) {
     return 0;
   }
@@ -261,6 +574,7 @@ SR2LinkTableMulti::get_host_metric_from_me(IPAddress s)
 uint32_t
 SR2LinkTableMulti::get_link_metric(NodeAddress from, NodeAddress to)
 {
+  Locked locked(_lock);
   if (!from || !to) {
     return 0;
   }
@@ -279,6 +593,7 @@ SR2LinkTableMulti::get_link_metric(NodeAddress from, NodeAddress to)
 uint32_t
 SR2LinkTableMulti::get_link_seq(NodeAddress from, NodeAddress to)
 {
+  Locked locked(_lock);
   if (!from || !to) {
     return 0;
   }
@@ -297,6 +612,7 @@ SR2LinkTableMulti::get_link_seq(NodeAddress from, NodeAddress to)
 uint32_t
 SR2LinkTableMulti::get_link_age(NodeAddress from, NodeAddress to)
 {
+  Locked locked(_lock);
   if (!from || !to) {
     return 0;
   }
@@ -314,6 +630,7 @@ SR2LinkTableMulti::get_link_age(NodeAddress from, NodeAddress to)
 uint16_t
 SR2LinkTableMulti::get_if_def(IPAddress node)
 {
+  Locked locked(_lock);
 	if (!node) {
     return 0;
   }
@@ -330,6 +647,7 @@ SR2LinkTableMulti::get_if_def(IPAddress node)
 uint32_t
 SR2LinkTableMulti::get_link_rate(NodeAddress from, NodeAddress to)
 {
+  Locked locked(_lock);
   if (!from || !to) {
     return 0;
   }
@@ -347,6 +665,7 @@ SR2LinkTableMulti::get_link_rate(NodeAddress from, NodeAddress to)
 void
 SR2LinkTableMulti::set_link_rate(NodeAddress from, NodeAddress to, uint32_t rate)
 {
+  Locked locked(_lock);
   if (!from || !to || !rate) {
     return;
   }
@@ -365,6 +684,7 @@ SR2LinkTableMulti::set_link_rate(NodeAddress from, NodeAddress to, uint32_t rate
 uint32_t
 SR2LinkTableMulti::get_link_retries(NodeAddress from, NodeAddress to)
 {
+  Locked locked(_lock);
   if (!from || !to) {
     return 0;
   }
@@ -383,6 +703,7 @@ SR2LinkTableMulti::get_link_retries(NodeAddress from, NodeAddress to)
 void
 SR2LinkTableMulti::set_link_retries(NodeAddress from, NodeAddress to, uint32_t retries)
 {
+  Locked locked(_lock);
   if (!from || !to || !retries) {
     return;
   }
@@ -401,6 +722,7 @@ SR2LinkTableMulti::set_link_retries(NodeAddress from, NodeAddress to, uint32_t r
 uint32_t
 SR2LinkTableMulti::get_link_probe(NodeAddress from, NodeAddress to)
 {
+  Locked locked(_lock);
   if (!from || !to) {
     return 0;
   }
@@ -419,6 +741,7 @@ SR2LinkTableMulti::get_link_probe(NodeAddress from, NodeAddress to)
 void
 SR2LinkTableMulti::set_link_probe(NodeAddress from, NodeAddress to, uint32_t probe)
 {
+  Locked locked(_lock);
   if (!from || !to || !probe) {
     return;
   }
@@ -433,108 +756,231 @@ SR2LinkTableMulti::set_link_probe(NodeAddress from, NodeAddress to, uint32_t pro
   nfo->_probe = probe;
 }
 
+void
+SR2LinkTableMulti::index_link(const NodePair &p)
+{
+  for (int x = 0; x < 2; x++) {
+    NodeAddress n = x ? p._to : p._from;
+    Vector<NodePair> *adj = _adjacency.findp(n);
+    if (!adj) {
+      _adjacency.insert(n, Vector<NodePair>());
+      adj = _adjacency.findp(n);
+    }
+    adj->push_back(p);
+  }
+}
+
+void
+SR2LinkTableMulti::unindex_link(const NodePair &p)
+{
+  for (int x = 0; x < 2; x++) {
+    NodeAddress n = x ? p._to : p._from;
+    Vector<NodePair> *adj = _adjacency.findp(n);
+    if (!adj) {
+      continue;
+    }
+    for (int y = 0; y < adj->size(); y++) {
+      if ((*adj)[y] == p) {
+	(*adj)[y] = adj->back();
+	adj->pop_back();
+	break;
+      }
+    }
+    if (!adj->size()) {
+      _adjacency.remove(n);
+    }
+  }
+}
+
+void
+SR2LinkTableMulti::rebuild_adjacency()
+{
+  _adjacency.clear();
+  for (SR2LTIterMulti iter = _links.begin(); iter.live(); iter++) {
+    index_link(iter.key());
+  }
+}
+
+/* the newest update of any link of radio, zero if it has none */
+Timestamp
+SR2LinkTableMulti::last_heard(NodeAddress radio)
+{
+  Locked locked(_lock);
+  Timestamp newest;
+  Vector<NodePair> *adj = _adjacency.findp(radio);
+  for (int x = 0; adj && x < adj->size(); x++) {
+    SR2LinkInfoMulti *lnfo = _links.findp((*adj)[x]);
+    if (lnfo && newest < lnfo->_last_updated) {
+      newest = lnfo->_last_updated;
+    }
+  }
+  return newest;
+}
+
+/* hosts at the far end of a link from radio updated after since */
+Vector<IPAddress>
+SR2LinkTableMulti::neighbors_since(NodeAddress radio, const Timestamp &since)
+{
+  Locked locked(_lock);
+  Vector<IPAddress> neighbors;
+  Vector<NodePair> *adj = _adjacency.findp(radio);
+  for (int x = 0; adj && x < adj->size(); x++) {
+    const NodePair &p = (*adj)[x];
+    if (p._from != radio) {
+      continue;
+    }
+    SR2LinkInfoMulti *lnfo = _links.findp(p);
+    if (!lnfo || !(since < lnfo->_last_updated)) {
+      continue;
+    }
+    bool known = false;
+    for (int y = 0; y < neighbors.size() && !known; y++) {
+      known = (neighbors[y] == p._to._ipaddr);
+    }
+    if (!known) {
+      neighbors.push_back(p._to._ipaddr);
+    }
+  }
+  return neighbors;
+}
+
+/*
+ * true if some best route from this node leaves through radio, that is
+ * if a host at the far end of one of its links is reached over it, and
+ * that link was updated after since
+ */
+bool
+SR2LinkTableMulti::routes_via(NodeAddress radio, const Timestamp &since)
+{
+  Locked locked(_lock);
+  refresh_dijkstra(true);
+  Vector<NodePair> *adj = _adjacency.findp(radio);
+  for (int x = 0; adj && x < adj->size(); x++) {
+    const NodePair &p = (*adj)[x];
+    if (p._from != radio) {
+      continue;
+    }
+    SR2LinkInfoMulti *lnfo = _links.findp(p);
+    if (!lnfo || !(since < lnfo->_last_updated)) {
+      continue;
+    }
+    SR2HostInfoMulti *nfo = _hosts.findp(p._to._ipaddr);
+    if (nfo && nfo->_prev_from_me == radio) {
+      return true;
+    }
+  }
+  return false;
+}
+
+/*
+ * Renumbers radio node as new_iface after a channel switch. Only the
+ * links of node, found through the adjacency index, and the host
+ * records that can name it, its own and those at the far end of its
+ * links, are touched. A link is renumbered only if its far end already
+ * is on the new channel, the others can no longer carry traffic and are
+ * removed. Routes keep their shape under the new numbers, so the last
+ * dijkstra runs stay valid unless the path metric weighs channels, a
+ * link was removed, or a renumbered link ran into one already known.
+ */
 void
 SR2LinkTableMulti::change_if(NodeAddress node, uint16_t new_iface){
-	
-	for (SR2LTIterMulti iter = _links.begin(); iter.live(); iter++) {
-		NodePair nodep = iter.key();
+	Locked locked(_lock);
+
+	if (node._iface == new_iface) {
+		return;
 	}
-	for (SR2HTIterMulti iter = _hosts.begin(); iter.live(); iter++) {
-		SR2HostInfoMulti hinfo = iter.value();
+	NodeAddress renamed = NodeAddress(node._ipaddr, new_iface);
+	bool routes_kept = (_path_metric != PATH_WCETT);
+	bool current[2];
+	for (int x = 0; x < 2; x++) {
+		current[x] = (_dijkstra_generation[x] == _generation);
 	}
-	
-	for (SR2HTIterMulti iter = _hosts.begin(); iter.live(); iter++) {
 
-		SR2HostInfoMulti hinfo = iter.value();
-		SR2PathMulti best = best_route(iter.key(), true);
-		
-		for (int i=0; i < best.size(); i++) {
-			NodeAirport tmp = best[i];
-	  }
-			
+	Vector<NodePair> pairs;
+	Vector<IPAddress> far_ends;
+	Vector<NodePair> *adj = _adjacency.findp(node);
+	if (adj) {
+		pairs = *adj;
 	}
-	
-	Vector<NodePair> link_remove;
-	Vector<SR2HostInfoMulti> host_remove;
-	
-	for (SR2LTIterMulti iter = _links.begin(); iter.live(); iter++) {
-    if ((iter.key()._from == node) || (iter.key()._to == node)){
-			link_remove.push_back(iter.key());
+	for (int i = 0; i < pairs.size(); i++) {
+		SR2LinkInfoMulti *lnfo = _links.findp(pairs[i]);
+		if (!lnfo) {
+			continue;
+		}
+		SR2LinkInfoMulti nfo = *lnfo;
+		_links.remove(pairs[i]);
+		unindex_link(pairs[i]);
+
+		NodeAddress far = (nfo._from == node) ? nfo._to : nfo._from;
+		if (far._iface % 256 != new_iface % 256) {
+			routes_kept = false;
+			continue;
+		}
+		if (nfo._from == node) {
+			nfo._from = renamed;
+		} else {
+			far_ends.push_back(nfo._from._ipaddr);
+		}
+		if (nfo._to == node) {
+			nfo._to = renamed;
+		} else {
+			far_ends.push_back(nfo._to._ipaddr);
 		}
-  }
 
-	for (int i=0; i< link_remove.size(); i++) {
-		NodePair nodep = link_remove[i];
-		_links.remove(link_remove[i]);
+		NodePair p = NodePair(nfo._from, nfo._to);
+		SR2LinkInfoMulti *known = _links.findp(p);
+		if (!known) {
+			_links.insert(p, nfo);
+			index_link(p);
+		} else {
+			if (known->_seq < nfo._seq) {
+				*known = nfo;
+			}
+			routes_kept = false;
+		}
 	}
 
-	link_remove.clear();
-
-	for (SR2HTIterMulti iter = _hosts.begin(); iter.live(); iter++) {
-
-		SR2HostInfoMulti hinfo = iter.value();
-		bool changed = false;
-		
-		if (((iter.key() == node._ipaddr) && (hinfo._if_from_me == node._iface)) || (hinfo._prev_from_me == node)) {
-			hinfo._if_from_me = hinfo._if_def;
-			hinfo._prev_from_me._iface = get_if_def(hinfo._prev_from_me._ipaddr);
-			changed=true;
+	SR2HostInfoMulti *hinfo = _hosts.findp(node._ipaddr);
+	if (hinfo) {
+		hinfo->update_interface(node._iface, new_iface);
+		if (hinfo->_if_def == node._iface) {
+			hinfo->_if_def = new_iface;
 		}
-		if (((iter.key() == node._ipaddr) && (hinfo._if_to_me == node._iface)) || (hinfo._prev_to_me == node)) {
-			hinfo._if_to_me = hinfo._if_def;
-			hinfo._prev_to_me._iface = get_if_def(hinfo._prev_to_me._ipaddr);
-			changed=true;
+		if (hinfo->_if_from_me == node._iface) {
+			hinfo->_if_from_me = new_iface;
 		}
-		
-		if (changed){
-			hinfo.update_interface(node._iface,new_iface);
-			host_remove.push_back(hinfo);
+		if (hinfo->_if_to_me == node._iface) {
+			hinfo->_if_to_me = new_iface;
 		}
-			
-	}
-	
-	for (int i=0; i < host_remove.size(); i++){
-		SR2HostInfoMulti hinfo = host_remove[i];
-		_hosts.remove(hinfo._ip);
-		_hosts.insert(hinfo._ip,hinfo);
-	}
-	
-	host_remove.clear();
-	
-	for (SR2LTIterMulti iter = _links.begin(); iter.live(); iter++) {
-		NodePair nodep = iter.key();
-	}
-	for (SR2HTIterMulti iter = _hosts.begin(); iter.live(); iter++) {
-		SR2HostInfoMulti hinfo = iter.value();
-	}
-
-	//dijkstra(true);
-  //dijkstra(false);
-
-	for (SR2LTIterMulti iter = _links.begin(); iter.live(); iter++) {
-		NodePair nodep = iter.key();
 	}
-	for (SR2HTIterMulti iter = _hosts.begin(); iter.live(); iter++) {
-		SR2HostInfoMulti hinfo = iter.value();
+	for (int i = 0; i < far_ends.size(); i++) {
+		hinfo = _hosts.findp(far_ends[i]);
+		if (!hinfo) {
+			continue;
+		}
+		if (hinfo->_prev_from_me == node) {
+			hinfo->_prev_from_me = renamed;
+		}
+		if (hinfo->_prev_to_me == node) {
+			hinfo->_prev_to_me = renamed;
+		}
 	}
 
-	for (SR2HTIterMulti iter = _hosts.begin(); iter.live(); iter++) {
-
-		SR2HostInfoMulti hinfo = iter.value();
-		SR2PathMulti best = best_route(iter.key(), true);
-		
-		for (int i=0; i < best.size(); i++) {
-			NodeAirport tmp = best[i];
-	  }
-			
+	_generation++;
+	if (routes_kept) {
+		for (int x = 0; x < 2; x++) {
+			if (current[x]) {
+				_dijkstra_generation[x] = _generation;
+			}
+		}
 	}
-
 }
 
 
 unsigned
 SR2LinkTableMulti::get_route_metric(const Vector<NodeAirport> &route)
 {
+  Locked locked(_lock);
   unsigned metric = 0;
   for (int i = 0; i < route.size() - 1; i++) {
     NodeAddress nfrom = NodeAddress(route[i]._ipaddr, route[i]._dep_iface);
@@ -552,6 +998,7 @@ SR2LinkTableMulti::get_route_metric(const Vector<NodeAirport> &route)
 
 String
 SR2LinkTableMulti::route_to_string(SR2PathMulti p) {
+	Locked locked(_lock);
 	StringAccum sa;
 	int hops = p.size()-1;
 	int metric = 0;
@@ -574,6 +1021,7 @@ SR2LinkTableMulti::route_to_string(SR2PathMulti p) {
 bool
 SR2LinkTableMulti::valid_route(const Vector<NodeAirport> &route)
 {
+  Locked locked(_lock);
   if (route.size() < 1) {
     return false;
   }
@@ -600,6 +1048,7 @@ SR2LinkTableMulti::valid_route(const Vector<NodeAirport> &route)
 Vector<NodeAirport>
 SR2LinkTableMulti::best_route(IPAddress dst, bool from_me)
 {
+  Locked locked(_lock);
   Vector<NodeAirport> reverse_route;
   if (!dst) {
     return reverse_route;
@@ -652,6 +1101,7 @@ static int ipaddr_sorter(const void *va, const void *vb, void *) {
 String
 SR2LinkTableMulti::print_routes(bool from_me, bool pretty)
 {
+  Locked locked(_lock);
   StringAccum sa;
 
   Vector<IPAddress> ip_addrs;
@@ -691,6 +1141,7 @@ SR2LinkTableMulti::print_routes(bool from_me, bool pretty)
 String
 SR2LinkTableMulti::print_links()
 {
+  Locked locked(_lock);
   StringAccum sa;
   for (SR2LTIterMulti iter = _links.begin(); iter.live(); iter++) {
     SR2LinkInfoMulti n = iter.value();
@@ -706,6 +1157,7 @@ SR2LinkTableMulti::print_links()
 String
 SR2LinkTableMulti::print_hosts()
 {
+  Locked locked(_lock);
   StringAccum sa;
   Vector<IPAddress> ip_addrs;
 
@@ -731,6 +1183,7 @@ SR2LinkTableMulti::print_hosts()
 
 void
 SR2LinkTableMulti::clear_stale() {
+  Locked locked(_lock);
 
   SR2LTableMulti links;
   for (SR2LTIterMulti iter = _links.begin(); iter.live(); iter++) {
@@ -752,19 +1205,50 @@ SR2LinkTableMulti::clear_stale() {
       }
     }
   }
+  if (links.size() != _links.size()) {
+    _generation++;
+  }
   _links.clear();
 
   for (SR2LTIterMulti iter = links.begin(); iter.live(); iter++) {
     SR2LinkInfoMulti nfo = iter.value();
     _links.insert(NodePair(nfo._from, nfo._to), nfo);
   }
+  rebuild_adjacency();
 
+  /* hosts left without any link can not be routed through */
+  HashMap<IPAddress, bool> linked;
+  for (SR2LTIterMulti iter = _links.begin(); iter.live(); iter++) {
+    linked.insert(iter.value()._from._ipaddr, true);
+    linked.insert(iter.value()._to._ipaddr, true);
+  }
+  Timestamp now = Timestamp::now();
+  Vector<IPAddress> unlinked;
+  for (SR2HTIterMulti iter = _hosts.begin(); iter.live(); iter++) {
+    const SR2HostInfoMulti &nfo = iter.value();
+    if (nfo._ip != _ip && !linked.findp(nfo._ip) &&
+	!(nfo._kept && now < nfo._kept + _stale_timeout)) {
+      unlinked.push_back(nfo._ip);
+    }
+  }
+  for (int x = 0; x < unlinked.size(); x++) {
+    _hosts.remove(unlinked[x]);
+    _route_headers.remove(unlinked[x]);
+  }
+  if (unlinked.size()) {
+    _pruned_hosts += unlinked.size();
+    _generation++;
+  }
+  if (over_limits()) {
+    enforce_limits();
+  }
 }
 
 
 Vector<IPAddress>
 SR2LinkTableMulti::get_neighbors(IPAddress ip)
 {
+  Locked locked(_lock);
   Vector<IPAddress> neighbors;
 
   typedef HashMap<IPAddress, bool> IPMap;
@@ -800,6 +1284,7 @@ SR2LinkTableMulti::get_neighbors(IPAddress ip)
 HashMap<NodeAddress,int>
 SR2LinkTableMulti::get_neighbors_if(int iface)
 {
+  Locked locked(_lock);
   HashMap<NodeAddress,int> neighbors;
 
   typedef HashMap<IPAddress, bool> IPMap;
@@ -831,8 +1316,24 @@ SR2LinkTableMulti::get_neighbors_if(int iface)
 }
 
 
-void
-SR2LinkTableMulti::dijkstra(bool from_me)
+const char *
+SR2LinkTableMulti::path_metric_name(int m)
+{
+  switch (m) {
+  case PATH_ETT: return "ETT";
+  case PATH_WCETT: return "WCETT";
+  case PATH_HOPCOUNT: return "HOPCOUNT";
+  case PATH_BOTTLENECK: return "BOTTLENECK";
+  default: return "unknown";
+  }
+}
+
+/*
+ * The path metric is a template parameter so that each metric gets its 
+ * own copy of the relaxation loop, with extend() inlined.
+ */
+template <typename PathMetric> void
+SR2LinkTableMulti::dijkstra(bool from_me, const PathMetric &path_metric)
 {
   Timestamp start = Timestamp::now();
   IPAddress src = _ip;
@@ -907,16 +1408,7 @@ SR2LinkTableMulti::dijkstra(bool from_me)
 					current_metric = current_min->_metric_from_me;
 				  }
 
-					// For ETT
-				  // uint32_t adjusted_metric = current_metric + lnfo->_metric;
-					// End ETT
-				
-					// For WCETT
-				
-					uint32_t max_metric = 0;
-					uint32_t total_ett = lnfo->_metric;
 					uint32_t link_channel = neighbor->_interfaces[i_ifnei] % 256;
-					bool ch_found = false;
 					MetricTable * metric_table;
 				
 					if (from_me) {
@@ -925,30 +1417,8 @@ SR2LinkTableMulti::dijkstra(bool from_me)
 						metric_table = &(current_min->_metric_table_to_me);
 					}
 				
-					for (MetricIter it_metric = metric_table->begin(); it_metric.live(); it_metric++) {
-						uint32_t actual_metric = 0;
-						if (it_metric.key() == link_channel) {
-							ch_found = true;
-							actual_metric = it_metric.value() + lnfo->_metric;
-						} else {
-							actual_metric = it_metric.value();
-						}
-
-						if (actual_metric > max_metric) {
-							max_metric = actual_metric;
-						}
-
-						total_ett = total_ett + it_metric.value();
-
-					}
-				
-					if ((!ch_found) && (lnfo->_metric > max_metric)) {
-						max_metric = lnfo->_metric;
-					}
-				
-				  uint32_t adjusted_metric = total_ett + max_metric;
-
-				// End WCETT
+				  uint32_t adjusted_metric = path_metric.extend(current_metric, *metric_table, 
+										link_channel, lnfo->_metric);
 			
 				  if (!neighbor_metric ||
 				  adjusted_metric < neighbor_metric) {
@@ -956,6 +1426,9 @@ SR2LinkTableMulti::dijkstra(bool from_me)
 					  neighbor->_metric_from_me = adjusted_metric;
 					  neighbor->_prev_from_me = NodeAddress(current_min_ip,current_min->_interfaces[i_ifcur]);
 					  neighbor->_if_from_me = neighbor->_interfaces[i_ifnei];
+						if (!PathMetric::per_channel) {
+							continue;
+						}
 						// WCETT support
 						neighbor->_metric_table_from_me.clear();
 						for (MetricIter it_metric = current_min->_metric_table_from_me.begin(); it_metric.live(); it_metric++) {
@@ -972,6 +1445,9 @@ SR2LinkTableMulti::dijkstra(bool from_me)
 					  neighbor->_metric_to_me = adjusted_metric;
 					  neighbor->_prev_to_me = NodeAddress(current_min_ip,current_min->_interfaces[i_ifcur]);
 					  neighbor->_if_to_me = neighbor->_interfaces[i_ifnei];
+						if (!PathMetric::per_channel) {
+							continue;
+						}
 						// WCETT support
 						neighbor->_metric_table_to_me.clear();
 						for (MetricIter it_metric = current_min->_metric_table_to_me.begin(); it_metric.live(); it_metric++) {
@@ -1017,6 +1493,153 @@ SR2LinkTableMulti::dijkstra(bool from_me)
   //click_chatter("%s: %s\n", name().c_str(), sa.take_string().c_str());
 }
 
+void
+SR2LinkTableMulti::dijkstra(bool from_me, int path_metric)
+{
+  switch (path_metric) {
+  case PATH_ETT:
+    dijkstra(from_me, SR2ETTPathMetric());
+    break;
+  case PATH_HOPCOUNT:
+    dijkstra(from_me, SR2HopCountPathMetric());
+    break;
+  case PATH_BOTTLENECK:
+    dijkstra(from_me, SR2BottleneckPathMetric());
+    break;
+  default:
+    dijkstra(from_me, SR2WCETTPathMetric(_wcett_beta));
+    break;
+  }
+  _dijkstra_generation[from_me] = _generation;
+}
+
+void
+SR2LinkTableMulti::dijkstra(bool from_me)
+{
+  Locked locked(_lock);
+  dijkstra(from_me, _path_metric);
+}
+
+/* rerun dijkstra only if something changed since the last run */
+void
+SR2LinkTableMulti::refresh_dijkstra(bool from_me)
+{
+  Locked locked(_lock);
+  if (_dijkstra_generation[from_me] != _generation) {
+    dijkstra(from_me);
+  }
+}
+
+/*
+ * Returns the best route from src to this node and the state of its 
+ * links. Routes to this node are only recomputed, and the header of src
+ * only rebuilt, when the link table changed since the last time. The
+ * caller gets a copy, taken before the lock is released.
+ */
+SR2RouteHeaderMulti
+SR2LinkTableMulti::route_header(IPAddress src)
+{
+  Locked locked(_lock);
+  SR2RouteHeaderMulti *hdr = _route_headers.findp(src);
+  if (!hdr) {
+    _route_headers.insert(src, SR2RouteHeaderMulti());
+    hdr = _route_headers.findp(src);
+  } else if (hdr->_generation == _generation) {
+    _header_hits++;
+    for (int i = 0; i < hdr->_hops.size(); i++) {
+      SR2RouteHeaderMulti::Hop &hop = hdr->_hops[i];
+      hop._seq = get_link_seq(hop._from, hop._to);
+      hop._age = get_link_age(hop._from, hop._to);
+    }
+    return *hdr;
+  }
+
+  refresh_dijkstra(false);
+  _header_builds++;
+  hdr->_generation = _generation;
+  hdr->_path = best_route(src, false);
+  hdr->_valid = valid_route(hdr->_path);
+  hdr->_hops.clear();
+  if (!hdr->_valid) {
+    return *hdr;
+  }
+
+  SR2PathMulti &best = hdr->_path;
+  for (int i = 0; i < best.size() - 1; i++) {
+    SR2RouteHeaderMulti::Hop hop;
+    hop._from = best[i].get_dep();
+    hop._to = best[i+1].get_arr();
+    hop._fwd = get_link_metric(hop._from, hop._to);
+    hop._rev = get_link_metric(best[i+1].get_dep(), best[i].get_arr());
+    hop._seq = get_link_seq(hop._from, hop._to);
+    hop._age = get_link_age(hop._from, hop._to);
+    hdr->_hops.push_back(hop);
+  }
+  return *hdr;
+}
+
+void
+SR2RouteHeaderMulti::write_links(struct sr2packetmulti *pk) const
+{
+  for (int i = 0; i < _hops.size(); i++) {
+    const Hop &hop = _hops[i];
+    pk->set_link(i, hop._from, hop._to, hop._fwd, hop._rev, hop._seq, hop._age);
+  }
+}
+
+String
+SR2LinkTableMulti::print_header_stats()
+{
+  Locked locked(_lock);
+  StringAccum sa;
+  sa << "generation " << _generation;
+  sa << " headers " << _route_headers.size();
+  sa << " builds " << _header_builds;
+  sa << " hits " << _header_hits << "\n";
+  return sa.take_string();
+}
+
+/*
+ * Runs every path metric on the current topology, iterations times in
+ * both directions, then recomputes the routes with the configured one.
+ */
+void
+SR2LinkTableMulti::bench_path_metrics(int iterations)
+{
+  Locked locked(_lock);
+  for (int m = 0; m < PATH_NMETRICS; m++) {
+    Timestamp start = Timestamp::now();
+    for (int i = 0; i < iterations; i++) {
+      dijkstra(true, m);
+      dijkstra(false, m);
+    }
+    _bench_time[m] = Timestamp::now() - start;
+    _bench_reached[m] = 0;
+    for (SR2HTIterMulti iter = _hosts.begin(); iter.live(); iter++) {
+      if (iter.value()._metric_from_me) {
+	_bench_reached[m]++;
+      }
+    }
+  }
+  _bench_iterations = iterations;
+  dijkstra(true);
+  dijkstra(false);
+}
+
+String
+SR2LinkTableMulti::print_path_metric_bench()
+{
+  Locked locked(_lock);
+  StringAccum sa;
+  sa << "hosts " << _hosts.size() << " links " << _links.size();
+  sa << " iterations " << _bench_iterations << "\n";
+  for (int m = 0; m < PATH_NMETRICS; m++) {
+    sa << path_metric_name(m) << " time " << _bench_time[m];
+    sa << " reached " << _bench_reached[m] << "\n";
+  }
+  return sa.take_string();
+}
+
 
 enum {H_BLACKLIST,
       H_BLACKLIST_CLEAR,
@@ -1029,7 +1652,13 @@ enum {H_BLACKLIST,
       H_HOSTS,
       H_CLEAR,
       H_DIJKSTRA,
-      H_DIJKSTRA_TIME};
+      H_DIJKSTRA_TIME,
+      H_METRIC,
+      H_BENCH,
+      H_HEADER_STATS,
+      H_MEMORY_STATS,
+      H_MAX_HOSTS,
+      H_MAX_LINKS};
 
 static String
 SR2LinkTableMulti_read_param(Element *e, void *thunk)
@@ -1057,6 +1686,12 @@ SR2LinkTableMulti_read_param(Element *e, void *thunk)
       sa << td->dijkstra_time << "\n";
       return sa.take_string();
     }
+    case H_METRIC: return String(td->path_metric_name(td->path_metric())) + "\n";
+    case H_BENCH: return td->print_path_metric_bench();
+    case H_HEADER_STATS: return td->print_header_stats();
+    case H_MEMORY_STATS: return td->print_memory_stats();
+    case H_MAX_HOSTS: return String(td->max_hosts()) + "\n";
+    case H_MAX_LINKS: return String(td->max_links()) + "\n";
     default:
       return String();
     }
@@ -1070,6 +1705,7 @@ SR2LinkTableMulti_write_param(const String &in_s, Element *e, void *vparam,
   switch((intptr_t)vparam) {
   case H_BLACKLIST_CLEAR: {
     f->_blacklist.clear();
+    f->bump_generation();
     break;
   }
   case H_BLACKLIST_ADD: {
@@ -1077,6 +1713,7 @@ SR2LinkTableMulti_write_param(const String &in_s, Element *e, void *vparam,
     if (!cp_ip_address(s, &m))
       return errh->error("blacklist_add parameter must be ipaddress");
     f->_blacklist.insert(m, m);
+    f->bump_generation();
     break;
   }
   case H_BLACKLIST_REMOVE: {
@@ -1084,10 +1721,32 @@ SR2LinkTableMulti_write_param(const String &in_s, Element *e, void *vparam,
     if (!cp_ip_address(s, &m))
       return errh->error("blacklist_add parameter must be ipaddress");
     f->_blacklist.erase(m);
+    f->bump_generation();
     break;
   }
   case H_CLEAR: f->clear(); break;
   case H_DIJKSTRA: f->dijkstra(true); f->dijkstra(false); break;
+  case H_BENCH: {
+    unsigned iterations = 1;
+    if (s.length() && !cp_unsigned(s, &iterations))
+      return errh->error("bench parameter must be unsigned");
+    f->bench_path_metrics(iterations);
+    break;
+  }
+  case H_MAX_HOSTS: {
+    int m;
+    if (!cp_integer(s, &m) || m < 0)
+      return errh->error("max_hosts parameter must be a non-negative integer");
+    f->set_limits(m, f->max_links());
+    break;
+  }
+  case H_MAX_LINKS: {
+    int m;
+    if (!cp_integer(s, &m) || m < 0)
+      return errh->error("max_links parameter must be a non-negative integer");
+    f->set_limits(f->max_hosts(), m);
+    break;
+  }
   }
   return 0;
 }
@@ -1103,12 +1762,21 @@ SR2LinkTableMulti::add_handlers() {
   add_read_handler("hosts", SR2LinkTableMulti_read_param, (void *)H_HOSTS);
   add_read_handler("blacklist", SR2LinkTableMulti_read_param, (void *)H_BLACKLIST);
   add_read_handler("dijkstra_time", SR2LinkTableMulti_read_param, (void *)H_DIJKSTRA_TIME);
+  add_read_handler("metric", SR2LinkTableMulti_read_param, (void *)H_METRIC);
+  add_read_handler("bench", SR2LinkTableMulti_read_param, (void *)H_BENCH);
+  add_read_handler("header_stats", SR2LinkTableMulti_read_param, (void *)H_HEADER_STATS);
+  add_read_handler("memory_stats", SR2LinkTableMulti_read_param, (void *)H_MEMORY_STATS);
+  add_read_handler("max_hosts", SR2LinkTableMulti_read_param, (void *)H_MAX_HOSTS);
+  add_read_handler("max_links", SR2LinkTableMulti_read_param, (void *)H_MAX_LINKS);
 
   add_write_handler("clear", SR2LinkTableMulti_write_param, (void *)H_CLEAR);
   add_write_handler("blacklist_clear", SR2LinkTableMulti_write_param, (void *)H_BLACKLIST_CLEAR);
   add_write_handler("blacklist_add", SR2LinkTableMulti_write_param, (void *)H_BLACKLIST_ADD);
   add_write_handler("blacklist_remove", SR2LinkTableMulti_write_param, (void *)H_BLACKLIST_REMOVE);
   add_write_handler("dijkstra", SR2LinkTableMulti_write_param, (void *)H_DIJKSTRA);
+  add_write_handler("bench", SR2LinkTableMulti_write_param, (void *)H_BENCH);
+  add_write_handler("max_hosts", SR2LinkTableMulti_write_param, (void *)H_MAX_HOSTS);
+  add_write_handler("max_links", SR2LinkTableMulti_write_param, (void *)H_MAX_LINKS);
 
 
   add_write_handler("update_link", static_update_link, 0);
@@ -1117,4 +1785,5 @@ SR2LinkTableMulti::add_handlers() {
 }
 
 EXPORT_ELEMENT(SR2LinkTableMulti)
+ELEMENT_MT_SAFE(SR2LinkTableMulti)
 CLICK_ENDDECLS
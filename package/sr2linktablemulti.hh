@@ -6,18 +6,28 @@
 #include <click/element.hh>
 #include <click/bighashmap.hh>
 #include <click/hashmap.hh>
+#include <click/sync.hh>
 #include "sr2pathmulti.hh"
 #include "sr2nodemulti.hh"
 CLICK_DECLS
 
 /*
  * =c
- * SR2LinkTableMulti(IP Address, [STALE timeout])
+ * SR2LinkTableMulti(IP Address, [STALE timeout], [MAX_HOSTS n], [MAX_LINKS n])
  * =s Wifi
  * Keeps a Multiradio Link state database and calculates Weighted Shortest Path
  * for other elements
  * =d
  * Runs dijkstra's algorithm occasionally.
+ *
+ * Every public entry point takes a Spinlock, which also serialises
+ * user-level threads in a multithreaded build, so the SR2ETTStatMulti of
+ * each radio may update links from its own thread. The lock is recursive,
+ * public functions call each other freely. route_header() hands out a
+ * copy made under the lock, as eviction may drop the cached header.
+ *
+ * Writing "FROM_IP FROM_IFACE TO_IP TO_IFACE METRIC SEQ AGE" to
+ * update_link adds a link by hand.
  * =a ARPTable
  *
  */
@@ -49,6 +59,129 @@ class NodePair {
 
 };
 
+/* one link of a SR2LinkTableMulti::update_links() batch */
+class SR2LinkUpdateMulti {
+  public:
+
+    NodeAddress _from;
+    NodeAddress _to;
+    uint32_t _seq;
+    uint32_t _age;
+    uint32_t _metric;
+    uint32_t _rate;
+    uint32_t _probe;
+    uint32_t _retries;
+
+    SR2LinkUpdateMulti()
+	: _from(), _to(), _seq(0), _age(0), _metric(0), _rate(0), _probe(0), _retries(0) {
+    }
+
+    SR2LinkUpdateMulti(NodeAddress from, NodeAddress to, uint32_t seq, uint32_t age,
+		       uint32_t metric, uint32_t rate, uint32_t probe, uint32_t retries)
+	: _from(from), _to(to), _seq(seq), _age(age), _metric(metric), 
+	  _rate(rate), _probe(probe), _retries(retries) {
+    }
+
+};
+/*
+ * Path metrics for SR2LinkTableMulti::dijkstra(). extend() gives the 
+ * metric of a path of metric path once a link of metric link on channel 
+ * is appended to it. channels holds the ETT sum per channel of the path,
+ * it is only kept up to date for metrics with per_channel set.
+ */
+class SR2ETTPathMetric {
+  public:
+    static const bool per_channel = false;
+    inline uint32_t extend(uint32_t path, const HashMap<uint16_t, uint32_t> &,
+			   uint16_t, uint32_t link) const {
+      return path + link;
+    }
+};
+
+class SR2HopCountPathMetric {
+  public:
+    static const bool per_channel = false;
+    inline uint32_t extend(uint32_t path, const HashMap<uint16_t, uint32_t> &,
+			   uint16_t, uint32_t) const {
+      return path + 1;
+    }
+};
+
+/* ETT of the worst link along the path */
+class SR2BottleneckPathMetric {
+  public:
+    static const bool per_channel = false;
+    inline uint32_t extend(uint32_t path, const HashMap<uint16_t, uint32_t> &,
+			   uint16_t, uint32_t link) const {
+      return (link > path) ? link : path;
+    }
+};
+
+/* 
+ * WCETT, (1 - beta) * sum of ETTs + beta * ETT sum of the busiest channel,
+ * with beta in percent and scaled by 2 so that beta 50 is sum + max.
+ */
+class SR2WCETTPathMetric {
+  public:
+    static const bool per_channel = true;
+    SR2WCETTPathMetric(uint32_t beta) : _beta(beta) { }
+    inline uint32_t extend(uint32_t, const HashMap<uint16_t, uint32_t> &channels,
+			   uint16_t channel, uint32_t link) const {
+      uint32_t max_metric = 0;
+      uint32_t total_ett = link;
+      bool ch_found = false;
+      for (HashMap<uint16_t, uint32_t>::const_iterator it = channels.begin(); it.live(); it++) {
+	uint32_t actual_metric = it.value();
+	if (it.key() == channel) {
+	  ch_found = true;
+	  actual_metric += link;
+	}
+	if (actual_metric > max_metric) {
+	  max_metric = actual_metric;
+	}
+	total_ett += it.value();
+      }
+      if (!ch_found && link > max_metric) {
+	max_metric = link;
+      }
+      return ((uint64_t) (100 - _beta) * total_ett + (uint64_t) _beta * max_metric) / 50;
+    }
+  private:
+    uint32_t _beta;
+};
+
+/*
+ * Best route from a source to this node together with the link state
+ * of each hop, ready to be copied into the link section of a 
+ * sr2packetmulti. SR2LinkTableMulti::route_header() keeps one per 
+ * source and only rebuilds it after the link table has changed. Seq and
+ * age of the hops move on without such a change, with every probe, so
+ * they are read again from the table each time the header is handed out.
+ * Callers get their own copy, so eviction never pulls it from under them.
+ */
+class SR2RouteHeaderMulti {
+  public:
+
+    class Hop {
+      public:
+	NodeAddress _from;
+	NodeAddress _to;
+	uint32_t _fwd;
+	uint32_t _rev;
+	uint32_t _seq;
+	uint32_t _age;
+    };
+
+    SR2RouteHeaderMulti() : _generation(0), _valid(false) { }
+
+    SR2PathMulti _path;
+    Vector<Hop> _hops;
+    uint32_t _generation;
+    bool _valid;
+
+    int num_links() const { return _hops.size(); }
+    void write_links(struct sr2packetmulti *pk) const;
+};
 
 class SR2LinkTableMulti: public Element{
 public:
@@ -83,6 +216,31 @@ public:
     }
     return false;
   }
+  int update_links(const Vector<SR2LinkUpdateMulti> &updates);
+
+  /* bumped whenever a change may alter a route or a route header */
+  uint32_t generation() const { return _generation; }
+  void bump_generation() { _generation++; }
+  void refresh_dijkstra(bool from_me);
+  uint32_t stale_timeout() const { return _stale_timeout.sec(); }
+
+  /* 
+   * With MAX_HOSTS or MAX_LINKS set, the table is trimmed to 90% of the 
+   * limit by the clear_stale() timer whenever it is past it, and right
+   * away on a link update once it has grown a tenth of the limit beyond
+   * where the last trim left it. Ourselves, our direct neighbours,
+   * and hosts passed to keep_host() within the last STALE seconds are
+   * kept along with the hosts on their best routes. Of the rest, hosts
+   * without links go first, then the least recently heard from. Links
+   * are evicted least recently updated first.
+   */
+  void keep_host(IPAddress ip);
+  int max_hosts() const { return _max_hosts; }
+  int max_links() const { return _max_links; }
+  void set_limits(int max_hosts, int max_links);
+  String print_memory_stats();
+  SR2RouteHeaderMulti route_header(IPAddress src);
+  String print_header_stats();
 
   uint32_t get_link_metric(NodeAddress from, NodeAddress to);
   uint32_t get_link_seq(NodeAddress from, NodeAddress to);
@@ -95,12 +253,17 @@ public:
   uint32_t get_link_probe(NodeAddress from, NodeAddress to);
   void set_link_probe(NodeAddress, NodeAddress, uint32_t);
 	void change_if(NodeAddress, uint16_t);
+	Timestamp last_heard(NodeAddress radio);
+	bool routes_via(NodeAddress radio, const Timestamp &since);
+	Vector<IPAddress> neighbors_since(NodeAddress radio, const Timestamp &since);
 
   bool valid_route(const Vector<NodeAirport> &route);
   unsigned get_route_metric(const Vector<NodeAirport> &route);
   Vector<IPAddress> get_neighbors(IPAddress ip);
 	HashMap<NodeAddress,int> get_neighbors_if(int iface);
   void dijkstra(bool);
+  void bench_path_metrics(int);
+  String print_path_metric_bench();
   void clear_stale();
   Vector<NodeAirport> best_route(IPAddress dst, bool from_me);
 	//Vector<NodeAirport> rewrite_def(Vector<NodeAirport>);
@@ -134,6 +297,11 @@ public:
   IPTable _blacklist;
 
   Timestamp dijkstra_time;
+
+  enum { PATH_ETT, PATH_WCETT, PATH_HOPCOUNT, PATH_BOTTLENECK, PATH_NMETRICS };
+  static const char *path_metric_name(int);
+  int path_metric() const { return _path_metric; }
+
 protected:
   class SR2LinkInfoMulti {
   public:
@@ -215,6 +383,9 @@ protected:
     bool _marked_from_me;
     bool _marked_to_me;
 
+    Timestamp _last_seen; // last link update naming this host
+    Timestamp _kept;      // last keep_host()
+
 	Vector<int> _interfaces;
 
     SR2HostInfoMulti(IPAddress p) {
@@ -252,7 +423,9 @@ protected:
       _prev_from_me(p._prev_from_me),
       _prev_to_me(p._prev_to_me),
       _marked_from_me(p._marked_from_me),
-      _marked_to_me(p._marked_to_me)
+      _marked_to_me(p._marked_to_me),
+      _last_seen(p._last_seen),
+      _kept(p._kept)
     { }
 
     void clear(bool from_me) {
@@ -287,12 +460,24 @@ protected:
 	}
 	
 	void update_interface(uint16_t old_iface, uint16_t new_iface){
-		for (Vector<int>::iterator iter = _interfaces.begin(); iter != _interfaces.end(); iter ++){
-			if (old_iface == *iter){
-				_interfaces.erase(iter);
-				_interfaces.push_back(new_iface);
+		int old_x = -1;
+		bool present = false;
+		for (int i=0; i<_interfaces.size(); i++){
+			if (old_iface == _interfaces[i]){
+				old_x = i;
+			}
+			if (new_iface == _interfaces[i]){
+				present = true;
 			}
 		}
+		if (old_x < 0){
+			return;
+		}
+		if (present){
+			_interfaces.erase(_interfaces.begin() + old_x);
+		} else {
+			_interfaces[old_x] = new_iface;
+		}
 	}
 	
 
@@ -308,10 +493,65 @@ protected:
   SR2HTableMulti _hosts;
   SR2LTableMulti _links;
 
+  /* the links of each radio, as from or to, kept in step with _links */
+  typedef HashMap<NodeAddress, Vector<NodePair> > SR2AdjTableMulti;
+  SR2AdjTableMulti _adjacency;
+
+  void index_link(const NodePair &p);
+  void unindex_link(const NodePair &p);
+  void rebuild_adjacency();
+
+  void touch_host(NodeAddress node);
+
+  int _path_metric;
+  uint32_t _wcett_beta; // percent
+  Timestamp _bench_time[PATH_NMETRICS];
+  int _bench_reached[PATH_NMETRICS];
+  int _bench_iterations;
+
+  template <typename PathMetric> void dijkstra(bool from_me, const PathMetric &path_metric);
+  void dijkstra(bool from_me, int path_metric);
+
+  uint32_t _generation;
+  uint32_t _dijkstra_generation[2]; // to me, from me
+  HashMap<IPAddress, SR2RouteHeaderMulti> _route_headers;
+  uint32_t _header_builds;
+  uint32_t _header_hits;
+
+  int _max_hosts;
+  int _max_links;
+  uint32_t _evicted_hosts;
+  uint32_t _evicted_links;
+  uint32_t _eviction_runs;
+  uint32_t _pruned_hosts;
+  int _hosts_mark; // sizes the last enforce_limits() left
+  int _links_mark;
+  bool over_limits() const {
+    return (_max_hosts && _hosts.size() > _max_hosts) ||
+      (_max_links && _links.size() > _max_links);
+  }
+  bool eviction_due() const {
+    return (_max_hosts && _hosts.size() > _max_hosts &&
+	    _hosts.size() > _hosts_mark + _max_hosts / 10) ||
+      (_max_links && _links.size() > _max_links &&
+       _links.size() > _links_mark + _max_links / 10);
+  }
+  void enforce_limits();
+
 
   IPAddress _ip;
   Timestamp _stale_timeout;
   Timer _timer;
+
+  /* holds _lock from construction to the end of the scope */
+  class Locked {
+    public:
+      Locked(Spinlock &lock) : _lock(lock) { _lock.acquire(); }
+      ~Locked() { _lock.release(); }
+    private:
+      Spinlock &_lock;
+  };
+  Spinlock _lock;
 };
 
 
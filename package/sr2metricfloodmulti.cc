@@ -31,11 +31,15 @@
 CLICK_DECLS
 
 SR2MetricFloodMulti::SR2MetricFloodMulti()
-  :  _ip(),
+  :  _forward_timer(static_forward_query_hook, this),
+     _ip(),
      _et(0),
      _link_table(0),
      _arp_table(0),
-	 _if_table(0)
+	 _if_table(0),
+     _queries_forwarded(0),
+     _aggregates_forwarded(0),
+     _aggregate_dsts(0)
 {
 }
 
@@ -47,6 +51,8 @@ int
 SR2MetricFloodMulti::configure (Vector<String> &conf, ErrorHandler *errh)
 {
   int ret;
+  int seen_capacity = 100;
+  unsigned int seen_expire = 30000;
   _debug = false;
   ret = cp_va_kparse(conf, this, errh,
 		     "ETHTYPE", 0, cpUnsignedShort, &_et,
@@ -56,6 +62,8 @@ SR2MetricFloodMulti::configure (Vector<String> &conf, ErrorHandler *errh)
 		     "ARP", 0, cpElement, &_arp_table,
 		     "JITTER", 0, cpUnsigned, &_jitter,
 		     "DEBUG", 0, cpBool, &_debug,
+		     "SEEN_CAPACITY", 0, cpInteger, &seen_capacity,
+		     "SEEN_EXPIRE", 0, cpUnsigned, &seen_expire,
 		     cpEnd);
 
   if (!_et) 
@@ -70,6 +78,10 @@ SR2MetricFloodMulti::configure (Vector<String> &conf, ErrorHandler *errh)
     return errh->error("ARPTableMulti element is not a ARPTableMulti");
   if (_if_table && _if_table->cast("AvailableInterfaces") == 0) 
     return errh->error("AvailableInterfaces element is not an AvailableInterfaces");
+  if (seen_capacity < 1) 
+    return errh->error("SEEN_CAPACITY must be positive");
+
+  _seen.configure(seen_capacity, seen_expire);
 
   return ret;
 }
@@ -77,6 +89,7 @@ SR2MetricFloodMulti::configure (Vector<String> &conf, ErrorHandler *errh)
 int
 SR2MetricFloodMulti::initialize (ErrorHandler *)
 {
+  _forward_timer.initialize(this);
   return 0;
 }
 
@@ -102,12 +115,26 @@ void
 SR2MetricFloodMulti::forward_query_hook() 
 {
   Timestamp now = Timestamp::now();
-  for (int x = 0; x < _seen.size(); x++) {
-    if (_seen[x]._to_send < now && !_seen[x]._forwarded) {
+  while (!_pending.empty() && !(now < _pending.top()._when)) {
+    Seen *s = _seen.peek(_pending.top()._src, _pending.top()._seq);
+    _pending.pop();
+    if (s && !s->_forwarded) {
 		  EtherAddress eth = _if_table->lookup_def();
-	    forward_query(&_seen[x],eth);
+	    forward_query(s,eth);
     }
   }
+  if (!_pending.empty()) {
+    _forward_timer.schedule_at(_pending.top()._when);
+  }
+}
+
+void
+SR2MetricFloodMulti::schedule_forward(Seen *s)
+{
+  _pending.push(s->_src, s->_seq, s->_to_send);
+  if (!_forward_timer.scheduled() || s->_to_send < _forward_timer.expiry()) {
+    _forward_timer.schedule_at(s->_to_send);
+  }
 }
 
 void
@@ -115,7 +142,6 @@ SR2MetricFloodMulti::forward_query(Seen *s, EtherAddress eth)
 {
 
   s->_forwarded = true;
-  _link_table->dijkstra(false);
 
   if (_debug) {
     StringAccum sa;
@@ -127,10 +153,9 @@ SR2MetricFloodMulti::forward_query(Seen *s, EtherAddress eth)
   }
 
   IPAddress src = s->_src;
-  SR2PathMulti best = _link_table->best_route(src, false);
-  bool best_valid = _link_table->valid_route(best);
+  SR2RouteHeaderMulti hdr = _link_table->route_header(src);
 
-  if (!best_valid) {
+  if (!hdr._valid) {
     if (_debug) {
       click_chatter("%{element} :: %s :: invalid route from src %s\n",
                     this,
@@ -149,29 +174,34 @@ SR2MetricFloodMulti::forward_query(Seen *s, EtherAddress eth)
 		  s->_seq);
   }
 
-  int links = best.size() - 1;
+  int links = hdr.num_links();
+  int ndsts = s->_dsts.size();
+  int dlen = ndsts * sizeof(uint32_t);
 
   int len = sr2packetmulti::len_wo_data(links);
-  WritablePacket *p = Packet::make(len + sizeof(click_ether));
+  WritablePacket *p = Packet::make(len + dlen + sizeof(click_ether));
   if(p == 0)
     return;
   click_ether *eh = (click_ether *) p->data();
   struct sr2packetmulti *pk = (struct sr2packetmulti *) (eh+1);
-  memset(pk, '\0', len);
+  memset(pk, '\0', len + dlen);
   pk->_version = _sr2_version;
-  pk->_type = SR2_PT_QUERY;
+  pk->_type = ndsts ? SR2_PT_MQUERY : SR2_PT_QUERY;
   pk->unset_flag(~0);
   pk->set_qdst(s->_dst);
   pk->set_seq(s->_seq);
   pk->set_num_links(links);
+  pk->set_data_len(dlen);
 
-  for (int i = 0; i < links; i++) {
-    pk->set_link(i,
-		 best[i].get_dep(), best[i+1].get_arr(),
-		 _link_table->get_link_metric(best[i].get_dep(), best[i+1].get_arr()),
-		 _link_table->get_link_metric(best[i+1].get_dep(), best[i].get_arr()),
-		 _link_table->get_link_seq(best[i].get_dep(), best[i+1].get_arr()),
-		 _link_table->get_link_age(best[i].get_dep(), best[i+1].get_arr()));
+  hdr.write_links(pk);
+  for (int x = 0; x < ndsts; x++) {
+    pk->set_qdst(x, s->_dsts[x]);
+  }
+  if (ndsts) {
+    _aggregates_forwarded++;
+    _aggregate_dsts += ndsts;
+  } else {
+    _queries_forwarded++;
   }
 	       
   eh->ether_type = htons(_et);
@@ -193,7 +223,7 @@ SR2MetricFloodMulti::push(int, Packet *p_in)
     p_in->kill();
     return;
   }
-  if (pk->_type != SR2_PT_QUERY) {
+  if (pk->_type != SR2_PT_QUERY && pk->_type != SR2_PT_MQUERY) {
 	click_chatter("%{element} :: %s :: bad packet_type %04x",
 		this,
 		__func__,
@@ -258,45 +288,73 @@ SR2MetricFloodMulti::push(int, Packet *p_in)
   IPAddress dst = pk->qdst();
   uint32_t seq = pk->seq();
 
-  int si = 0;
-  
-  for(si = 0; si < _seen.size(); si++){
-    if(src == _seen[si]._src && seq == _seen[si]._seq) {
-      _seen[si]._count++;
-      p_in->kill();
-      return;
-    }
+  if (pk->_type == SR2_PT_MQUERY && p_in->length() < sizeof(click_ether) + pk->hlen_with_data()) {
+    /* checked before the seen entry, so an intact copy still gets through */
+    click_chatter("%{element} :: %s :: truncated aggregate query from %s",
+		  this,
+		  __func__,
+		  src.unparse().c_str());
+    p_in->kill();
+    return;
+  }
+
+  Seen *s = _seen.find(src, seq);
+  if (s) {
+    s->_count++;
+    p_in->kill();
+    return;
   }
   
-  if (_seen.size() >= 100) {
-    _seen.pop_front();
+  s = _seen.insert(src, seq, Seen(src, dst, seq, 0, 0));
+  s->_count++;
+  s->_when = Timestamp::now();
+
+  bool for_me = (dst == _ip);
+  if (pk->_type == SR2_PT_MQUERY) {
+    for (int x = 0; x < pk->num_qdsts(); x++) {
+      IPAddress qdst = pk->get_qdst(x);
+      if (qdst == _ip) {
+	for_me = true;
+      } else if (qdst) {
+	s->_dsts.push_back(qdst);
+      }
+    }
   }
-  _seen.push_back(Seen(src, dst, seq, 0, 0));
-  si = _seen.size() - 1;
-
-  _seen[si]._count++;
-  _seen[si]._when = Timestamp::now();
 
-  if (dst == _ip) {
+  if (for_me) {
     /* don't forward queries for me */
     /* just spit them out the output */
-    output(1).push(p_in);
-    return;
+    if (!s->_dsts.size()) {
+      output(1).push(p_in);
+      return;
+    }
+    if (Packet *p_me = p_in->clone()) {
+      output(1).push(p_me);
+    }
   }
   /* schedule timer */
   int delay = click_random(1, _jitter);
   
-  _seen[si]._to_send = _seen[si]._when + Timestamp::make_msec(delay);
-  _seen[si]._forwarded = false;
-  Timer *t = new Timer(static_forward_query_hook, (void *) this);
-  t->initialize(this);
-  t->schedule_after_msec(delay);
+  s->_to_send = s->_when + Timestamp::make_msec(delay);
+  s->_forwarded = false;
+  schedule_forward(s);
 
   p_in->kill();
   return;
 }
 
-enum {H_DEBUG, H_CLEAR, H_FLOODS};
+String
+SR2MetricFloodMulti::print_flood_stats()
+{
+  StringAccum sa;
+  sa << "queries " << _queries_forwarded;
+  sa << " aggregates " << _aggregates_forwarded;
+  sa << " aggregate_dsts " << _aggregate_dsts;
+  sa << " saved " << _aggregate_dsts - _aggregates_forwarded << "\n";
+  return sa.take_string();
+}
+
+enum {H_DEBUG, H_CLEAR, H_FLOODS, H_SEEN_STATS, H_FLOOD_STATS};
 
 String
 SR2MetricFloodMulti::read_handler(Element *e, void *thunk)
@@ -309,15 +367,20 @@ SR2MetricFloodMulti::read_handler(Element *e, void *thunk)
 	  StringAccum sa;
 	  int x;
 	  for (x = 0; x < td->_seen.size(); x++) {
-		  sa << "src " << td->_seen[x]._src;
-		  sa << " dst " << td->_seen[x]._dst;
-		  sa << " seq " << td->_seen[x]._seq;
-		  sa << " count " << td->_seen[x]._count;
-		  sa << " forwarded " << td->_seen[x]._forwarded;
+		  const Seen &s = td->_seen.at(x)._data;
+		  sa << "src " << s._src;
+		  sa << " dst " << s._dst;
+		  sa << " seq " << s._seq;
+		  sa << " count " << s._count;
+		  sa << " forwarded " << s._forwarded;
 		  sa << "\n";
 	  }
 	  return sa.take_string();
   }
+  case H_SEEN_STATS:
+    return td->_seen.stats();
+  case H_FLOOD_STATS:
+    return td->print_flood_stats();
   default:
     return String();
   }
@@ -339,6 +402,12 @@ SR2MetricFloodMulti::write_handler(const String &in_s, Element *e, void *vparam,
   }
   case H_CLEAR:
     f->_seen.clear();
+    f->_seen.reset_stats();
+    f->_queries_forwarded = 0;
+    f->_aggregates_forwarded = 0;
+    f->_aggregate_dsts = 0;
+    f->_pending.clear();
+    f->_forward_timer.unschedule();
     break;
   }
   return 0;
@@ -349,6 +418,8 @@ SR2MetricFloodMulti::add_handlers()
 {
   add_read_handler("debug", read_handler, (void *) H_DEBUG);
   add_read_handler("floods", read_handler, (void *) H_FLOODS);
+  add_read_handler("seen_stats", read_handler, (void *) H_SEEN_STATS);
+  add_read_handler("flood_stats", read_handler, (void *) H_FLOOD_STATS);
 
   add_write_handler("debug", write_handler, (void *) H_DEBUG);
   add_write_handler("clear", write_handler, (void *) H_CLEAR);
@@ -10,6 +10,8 @@
 #include <click/dequeue.hh>
 #include "sr2nodemulti.hh"
 #include "arptablemulti.hh"
+#include "sr2seencachemulti.hh"
+#include "sr2forwardqueuemulti.hh"
 CLICK_DECLS
 
 /*
@@ -18,6 +20,8 @@ CLICK_DECLS
  * =s Wifi, Wireless Routing
  * =d
  * Floods a packet with previous hops based on Link Metrics.
+ * Aggregate queries (SR2_PT_MQUERY) are flooded once for all the
+ * destinations they list, the ones for this node go out on output 1.
  */
 
 class SR2MetricFloodMulti : public Element {
@@ -51,7 +55,7 @@ class SR2MetricFloodMulti : public Element {
   // List of query sequence #s that we've already seen.
   class Seen {
   public:
-    Seen();
+    Seen() : _seq(0), _count(0), _forwarded(false) { }
     Seen(IPAddress src, IPAddress dst, uint32_t seq, int fwd, int rev) {
       _src = src; 
       _dst = dst; 
@@ -66,9 +70,12 @@ class SR2MetricFloodMulti : public Element {
     Timestamp _when; 
     Timestamp _to_send;
     bool _forwarded;
+    Vector<IPAddress> _dsts; // still to query, for aggregate queries
   };
 
-  DEQueue<Seen> _seen;
+  SR2SeenCacheMulti<Seen> _seen;
+  SR2ForwardQueueMulti _pending;
+  Timer _forward_timer;
 
   IPAddress _ip;     // My IP address.
   uint16_t _et;      // This protocol's ethertype
@@ -80,8 +87,15 @@ class SR2MetricFloodMulti : public Element {
   unsigned int _jitter; // msecs
   bool _debug;
 
+  uint32_t _queries_forwarded;
+  uint32_t _aggregates_forwarded;
+  uint32_t _aggregate_dsts;
+
   void forward_query(Seen *s, EtherAddress _eth);
   void forward_query_hook();
+  void schedule_forward(Seen *s);
+
+  String print_flood_stats();
 
   static int write_handler(const String &, Element *, void *, ErrorHandler *);
   static String read_handler(Element *, void *);
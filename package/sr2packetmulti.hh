@@ -15,6 +15,8 @@ enum sr2packetmulti_type {
 	SR2_PT_CHSCINFO = 0x33,
 	SR2_PT_CHASSIGN = 0x34,
 	SR2_PT_CHNGWARN = 0x35,
+	SR2_PT_CHACK = 0x36,	// per-hop ack of a CHASSIGN or CHNGWARN
+	SR2_PT_MQUERY = 0x11,	// query for the destinations listed as data
 };
 
 
@@ -26,9 +28,13 @@ enum sr2packetmulti_flags {
 enum link_probe_flags {
 	PROBE_AVAILABLE_RATES = (1<<0),
 	PROBE_LINK_ENTRIES = (1<<1),
+	PROBE_ADAPTIVE = (1<<2),	// probe spacing varies, period is nominal
+	PROBE_LINK_DELTA = (1<<3),	// only changed link entries, link_summary follows
+	PROBE_LINK_FULL = (1<<4),	// delta probe holding every entry its summary counts
+	PROBE_REFRESH_REQ = (1<<5),	// a summary did not match, delta senders refresh in full
 };
 
-static const uint8_t _sr2_version = 0x1c;
+static const uint8_t _sr2_version = 0x20;
 
 /* sr2cr packet format */
 CLICK_PACKED_STRUCTURE(
@@ -86,13 +92,41 @@ public:
 	 */
 	u_char *data() { return (((u_char *)this) + len_wo_data(num_links())); }
 
+	/* destinations of a SR2_PT_MQUERY, same rule as data() applies */
+	int       num_qdsts()       { return data_len() / sizeof(uint32_t); }
+	IPAddress get_qdst(int i)   { return ((uint32_t *) data())[i]; }
+	void      set_qdst(int i, IPAddress ip) { ((uint32_t *) data())[i] = ip.addr(); }
+
+	/* load of the advertised gateway, carried as data by SR2_PT_GATEWAY */
+	uint32_t  gw_load() { 
+		return (data_len() >= sizeof(uint32_t)) ? ntohl(*(uint32_t *) data()) : 0; 
+	}
+	void      set_gw_load(uint32_t load) {
+		set_data_len(sizeof(uint32_t));
+		*(uint32_t *) data() = htonl(load);
+	}
+
+	/* type of the acked packet, carried as data by SR2_PT_CHACK */
+	uint32_t  acked_type() { 
+		return (data_len() >= sizeof(uint32_t)) ? ntohl(*(uint32_t *) data()) : 0; 
+	}
+	void      set_acked_type(uint32_t type) {
+		set_data_len(sizeof(uint32_t));
+		*(uint32_t *) data() = htonl(type);
+	}
+
+	/* types whose data the checksum covers */
+	bool checksums_data() {
+		return (_type & SR2_PT_DATA) || _type == SR2_PT_MQUERY || _type == SR2_PT_GATEWAY;
+	}
+
 	void set_checksum() {
-		unsigned int tlen = (_type & SR2_PT_DATA) ? hlen_with_data() : hlen_wo_data();
+		unsigned int tlen = checksums_data() ? hlen_with_data() : hlen_wo_data();
 		_cksum = click_in_cksum((unsigned char *) this, tlen);
 	}
 
 	bool check_checksum() {
-		unsigned int tlen = (_type & SR2_PT_DATA) ? hlen_with_data() : hlen_wo_data();
+		unsigned int tlen = checksums_data() ? hlen_with_data() : hlen_wo_data();
 		return click_in_cksum((unsigned char *) this, tlen) == 0;
 	}
 
@@ -233,6 +267,17 @@ CLICK_PACKED_STRUCTURE(struct link_entry_multi {,
 	void set_num_rates(uint32_t num_rates)  { _num_rates = htonl(num_rates); }
 	void set_seq(uint32_t seq)              { _seq = htonl(seq); }
 	void set_age(uint32_t age)              { _age = htonl(age); }
+	/* digest of the node and the link_info records that follow, seq and age excluded */
+	uint32_t digest() {
+		uint32_t h = 2166136261U;
+		h = (h ^ _ipaddr) * 16777619U;
+		h = (h ^ _iface) * 16777619U;
+		uint8_t *p = (uint8_t *) (this + 1);
+		for (unsigned x = 0; x < num_rates() * sizeof(struct link_info); x++) {
+			h = (h ^ p[x]) * 16777619U;
+		}
+		return h;
+	}
   private:
 	uint32_t _ipaddr;
 	uint16_t _iface;
@@ -241,6 +286,20 @@ CLICK_PACKED_STRUCTURE(struct link_entry_multi {,
 	uint32_t _age;
 });
 
+/* trailer of delta probes, sums up every entry the sender has advertised */
+CLICK_PACKED_STRUCTURE(struct link_summary {,
+	uint32_t num_entries()  { return ntohl(_num_entries); }
+	uint32_t checksum()     { return ntohl(_checksum); }
+	uint32_t refresh()      { return ntohl(_refresh); }
+	void set_num_entries(uint32_t num_entries) { _num_entries = htonl(num_entries); }
+	void set_checksum(uint32_t checksum)       { _checksum = htonl(checksum); }
+	void set_refresh(uint32_t refresh)         { _refresh = htonl(refresh); }
+  private:
+	uint32_t _num_entries;
+	uint32_t _checksum;    // xor of the link_entry_multi digests
+	uint32_t _refresh;     // full refresh interval, in msecs
+});
+
 CLICK_PACKED_STRUCTURE(struct channel_warn {,
   uint8_t _version; /* see protocol version */
 	uint8_t _type;    /* see protocol type */
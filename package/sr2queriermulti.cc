@@ -34,7 +34,21 @@ SR2QuerierMulti::SR2QuerierMulti()
   :  _ip(),
      _et(0),
      _forwarder(0),
-     _link_table(0)
+     _link_table(0),
+     _aggregate(0),
+     _max_aggregate(64),
+     _timer(this),
+     _dsts_queried(0),
+     _query_packets(0),
+     _aggregate_packets(0),
+     _refresh(1000),
+     _hysteresis(10),
+     _refresh_timer(this),
+     _refresh_generation(0),
+     _refreshes(0),
+     _route_switches(0),
+     _switches_held(0),
+     _early_queries(0)
 {
 }
 
@@ -48,6 +62,7 @@ SR2QuerierMulti::configure (Vector<String> &conf, ErrorHandler *errh)
 
   _query_wait = Timestamp(5);
   _time_before_switch_sec = Timestamp(10);
+  _active = Timestamp(30);
   _debug = false;
 
   int res;
@@ -60,6 +75,11 @@ SR2QuerierMulti::configure (Vector<String> &conf, ErrorHandler *errh)
 		     "DEBUG", 0, cpBool, &_debug,
 		     "TIME_BEFORE_SWITCH", 0, cpTimestamp, &_time_before_switch_sec,
 		     "QUERY_WAIT", 0, cpTimestamp, &_query_wait,
+		     "AGGREGATE", 0, cpUnsigned, &_aggregate,
+		     "MAX_AGGREGATE", 0, cpInteger, &_max_aggregate,
+		     "REFRESH", 0, cpUnsigned, &_refresh,
+		     "HYSTERESIS", 0, cpUnsigned, &_hysteresis,
+		     "ACTIVE", 0, cpTimestamp, &_active,
 		     cpEnd);
 
   if (!_et) 
@@ -76,10 +96,138 @@ SR2QuerierMulti::configure (Vector<String> &conf, ErrorHandler *errh)
     return errh->error("AvailableInterfaces element is not an AvailableInterfaces");
   if (_link_table->cast("SR2LinkTableMulti") == 0) 
     return errh->error("LT element is not a SR2LinkTableMulti");
+  if (_max_aggregate < 1 || _max_aggregate > 128) 
+    return errh->error("MAX_AGGREGATE must be between 1 and 128");
+  if (_hysteresis >= 100) 
+    return errh->error("HYSTERESIS must be below 100");
 
   return res;
 }
 
+int
+SR2QuerierMulti::initialize (ErrorHandler *)
+{
+  _timer.initialize(this);
+  /* scheduled by push() once a destination is in use */
+  _refresh_timer.initialize(this);
+  return 0;
+}
+
+void
+SR2QuerierMulti::run_timer(Timer *t)
+{
+  if (t == &_refresh_timer) {
+    if (refresh_routes()) {
+      _refresh_timer.schedule_after_msec(_refresh);
+    }
+    return;
+  }
+  flush_queries();
+}
+
+/*
+ * Pick the route for q. With hysteresis, a working route is only given
+ * up for one that is clearly better and not before TIME_BEFORE_SWITCH.
+ */
+void
+SR2QuerierMulti::update_route(DstInfoMulti *q, bool hysteresis)
+{
+  Timestamp now = Timestamp::now();
+  q->_held = false;
+  SR2PathMulti best = _link_table->best_route(q->_ip, true);
+  if (!_link_table->valid_route(best)) {
+    q->_p = SR2PathMulti();
+    q->_best_metric = 0;
+    return;
+  }
+  int metric = _link_table->get_route_metric(best);
+  if (q->_p == best) {
+    q->_best_metric = metric;
+    return;
+  }
+
+  if (hysteresis && q->_best_metric && _link_table->valid_route(q->_p)) {
+    int current = _link_table->get_route_metric(q->_p);
+    if (now < q->_last_switch + _time_before_switch_sec ||
+	(int64_t) metric * 100 >= (int64_t) current * (100 - _hysteresis)) {
+      q->_best_metric = current;
+      /* held only by the clock: try again once TIME_BEFORE_SWITCH is up */
+      q->_held = (now < q->_last_switch + _time_before_switch_sec);
+      _switches_held++;
+      return;
+    }
+  }
+
+  q->_p = best;
+  q->_best_metric = metric;
+  q->_first_selected = now;
+  q->_last_switch = now;
+  _route_switches++;
+}
+
+/* true if some link on the path is 3/4 of the way to going stale */
+bool
+SR2QuerierMulti::route_aging(SR2PathMulti &p)
+{
+  uint32_t stale = _link_table->stale_timeout();
+  for (int i = 0; i < p.size() - 1; i++) {
+    NodeAddress from = p[i].get_dep();
+    NodeAddress to = p[i+1].get_arr();
+    if (_link_table->get_link_age(from, to) * 4 >= stale * 3) {
+      return true;
+    }
+  }
+  return false;
+}
+
+/*
+ * Refreshes the routes of the destinations used within ACTIVE and
+ * forgets those idle for longer. Returns false once none is active, the
+ * timer then waits for push() to start it again.
+ */
+bool
+SR2QuerierMulti::refresh_routes()
+{
+  Timestamp now = Timestamp::now();
+  uint32_t generation = _link_table->generation();
+  bool changed = (generation != _refresh_generation);
+  if (changed) {
+    _link_table->refresh_dijkstra(true);
+  }
+  _refreshes++;
+
+  Vector<IPAddress> idle;
+  int active = 0;
+  for (DstTableMulti::iterator iter = _queries.begin(); iter.live(); iter++) {
+    DstInfoMulti *q = &iter.value();
+    if (!q->_last_used || q->_last_used + _active < now) {
+      if (!q->_pending && q->_last_query + _active < now) {
+	idle.push_back(q->_ip);
+      }
+      continue;
+    }
+    active++;
+    _link_table->keep_host(q->_ip);
+    if (changed || (q->_held && q->_last_switch + _time_before_switch_sec <= now)) {
+      update_route(q, true);
+    }
+    if ((q->_last_query + _query_wait) >= now) {
+      continue;
+    }
+    if (!q->_best_metric) {
+      send_query(q->_ip);
+    } else if (route_aging(q->_p)) {
+      _early_queries++;
+      send_query(q->_ip);
+    }
+  }
+  for (int x = 0; x < idle.size(); x++) {
+    _queries.remove(idle[x]);
+  }
+  _refresh_generation = generation;
+  return active > 0;
+}
+
 void
 SR2QuerierMulti::send_query(IPAddress dst)
 {
@@ -91,7 +239,55 @@ SR2QuerierMulti::send_query(IPAddress dst)
   nfo->_last_query.set_now();
   nfo->_count++;
 
-  unsigned extra = sr2packetmulti::len_wo_data(0) + sizeof(click_ether);
+  if (!_aggregate) {
+    _dsts_queried++;
+    Vector<IPAddress> dsts;
+    dsts.push_back(dst);
+    send_queries(dsts);
+    return;
+  }
+
+  if (nfo->_pending) {
+    return;
+  }
+  nfo->_pending = true;
+  _dsts_queried++;
+  _pending_dsts.push_back(dst);
+
+  if (_pending_dsts.size() >= _max_aggregate) {
+    flush_queries();
+  } else if (!_timer.scheduled()) {
+    _timer.schedule_after_msec(_aggregate);
+  }
+}
+
+void
+SR2QuerierMulti::flush_queries()
+{
+  _timer.unschedule();
+  if (!_pending_dsts.size()) {
+    return;
+  }
+  for (int x = 0; x < _pending_dsts.size(); x++) {
+    DstInfoMulti *nfo = _queries.findp(_pending_dsts[x]);
+    if (nfo) {
+      nfo->_pending = false;
+    }
+  }
+  send_queries(_pending_dsts);
+  _pending_dsts.clear();
+}
+
+/*
+ * A single destination goes out as a plain SR2_PT_QUERY, several are 
+ * listed in the data of one SR2_PT_MQUERY.
+ */
+void
+SR2QuerierMulti::send_queries(const Vector<IPAddress> &dsts)
+{
+  int ndsts = (dsts.size() > 1) ? dsts.size() : 0;
+  int dlen = ndsts * sizeof(uint32_t);
+  unsigned extra = sr2packetmulti::len_wo_data(0) + dlen + sizeof(click_ether);
   WritablePacket *p = Packet::make(extra);
   if (!p) {
     return;
@@ -105,21 +301,29 @@ SR2QuerierMulti::send_query(IPAddress dst)
   memcpy(eh->ether_shost, my_eth.data(), 6);
   memset(eh->ether_dhost, 0xff, 6);
   struct sr2packetmulti *pk = (struct sr2packetmulti *) (eh+1);
-  memset(pk, '\0', sr2packetmulti::len_wo_data(0));
+  memset(pk, '\0', sr2packetmulti::len_wo_data(0) + dlen);
   pk->_version = _sr2_version;
-  pk->_type = SR2_PT_QUERY;
+  pk->_type = ndsts ? SR2_PT_MQUERY : SR2_PT_QUERY;
   pk->unset_flag(~0);
-  pk->set_qdst(dst);
+  pk->set_qdst(ndsts ? IPAddress() : dsts[0]);
   pk->set_seq(++_seq);
   pk->set_num_links(0);
   pk->set_link_node(0,_ip);
-  pk->set_data_len(0);
+  pk->set_data_len(dlen);
 	pk->set_link_if(0,my_iface);
+  for (int x = 0; x < ndsts; x++) {
+    pk->set_qdst(x, dsts[x]);
+  }
+  _query_packets++;
+  if (ndsts) {
+    _aggregate_packets++;
+  }
   //if (_debug) {
-    click_chatter("%{element} :: %s :: start query %s %d\n",
+    click_chatter("%{element} :: %s :: start query %s%s %d\n",
 		  this, 
 		  __func__,
-		  dst.unparse().c_str(), 
+		  dsts[0].unparse().c_str(), 
+		  ndsts ? " ..." : "",
 		  _seq);
   //}
 
@@ -144,12 +348,23 @@ SR2QuerierMulti::push(int, Packet *p_in)
 		_queries.insert(dst, DstInfoMulti(dst));
 		q = _queries.findp(dst);
 		q->_best_metric = 0;
+		if (_refresh) {
+			/* nothing precomputed yet */
+			_link_table->refresh_dijkstra(true);
+			update_route(q, false);
+		}
 	}
 	
 	Timestamp now = Timestamp::now();
 	Timestamp expire = q->_last_switch + _time_before_switch_sec;
+	q->_last_used = now;
+	if (_refresh && !_refresh_timer.scheduled()) {
+		_refresh_timer.schedule_after_msec(_refresh);
+	}
 	
-	if (!q->_best_metric || !q->_p.size() || expire < now) {
+	if (_refresh) {
+		/* the refresh timer keeps q->_p current */
+	} else if (!q->_best_metric || !q->_p.size() || expire < now) {
 		SR2PathMulti best = _link_table->best_route(dst, true);
 		bool valid = _link_table->valid_route(best);
 		q->_last_switch.set_now();
@@ -217,7 +432,25 @@ SR2QuerierMulti::print_queries()
   return sa.take_string();
 }
 
-enum {H_DEBUG, H_RESET, H_QUERIES, H_QUERY};
+String
+SR2QuerierMulti::print_query_stats()
+{
+  StringAccum sa;
+  sa << "aggregate " << _aggregate;
+  sa << " destinations " << _dsts_queried;
+  sa << " packets " << _query_packets;
+  sa << " aggregates " << _aggregate_packets;
+  sa << " pending " << _pending_dsts.size();
+  sa << " saved " << _dsts_queried - _query_packets;
+  sa << " refresh " << _refresh;
+  sa << " refreshes " << _refreshes;
+  sa << " switches " << _route_switches;
+  sa << " held " << _switches_held;
+  sa << " early_queries " << _early_queries << "\n";
+  return sa.take_string();
+}
+
+enum {H_DEBUG, H_RESET, H_QUERIES, H_QUERY, H_QUERY_STATS};
 
 String
 SR2QuerierMulti::read_handler(Element *e, void *thunk)
@@ -228,6 +461,8 @@ SR2QuerierMulti::read_handler(Element *e, void *thunk)
     return String(c->_debug) + "\n";
   case H_QUERIES:
     return c->print_queries();
+  case H_QUERY_STATS:
+    return c->print_query_stats();
   default:
     return "<error>\n";
   }
@@ -258,6 +493,9 @@ SR2QuerierMulti::write_handler(const String &in_s, Element *e, void *vparam,
     }
     case H_RESET: {
       td->_queries.clear();
+      td->_pending_dsts.clear();
+      td->_timer.unschedule();
+      td->_refresh_generation = 0;
       break;
     }
   }
@@ -269,6 +507,7 @@ SR2QuerierMulti::add_handlers()
 {
   add_read_handler("queries", read_handler, H_QUERIES);
   add_read_handler("debug", read_handler, H_DEBUG);
+  add_read_handler("query_stats", read_handler, H_QUERY_STATS);
 
   add_write_handler("debug", write_handler, H_DEBUG);
   add_write_handler("reset", write_handler, H_RESET);
@@ -15,6 +15,19 @@ CLICK_DECLS
  * SR2QuerierMulti(ETH, SR2Forwarder element, LinkTable element)
  * =s Wifi, Wireless Routing
  * Sends route queries if it can't find a valid source route.
+ * With AGGREGATE set, destinations queried within that many msecs of
+ * each other share one SR2_PT_MQUERY flood, at most MAX_AGGREGATE each.
+ *
+ * Every REFRESH msecs the routes to destinations used within the last
+ * ACTIVE are recomputed off the data path, when the link table changed
+ * or when TIME_BEFORE_SWITCH has run out on a switch it held back. A
+ * new route replaces the current one once TIME_BEFORE_SWITCH has passed
+ * and it is more than HYSTERESIS percent better; a broken route is
+ * replaced at once. The refresh only runs while some destination is
+ * active, and destinations idle for longer than ACTIVE are forgotten.
+ * Destinations without a route, or whose route has a link 3/4 of the
+ * way to the link table's stale timeout, are queried ahead of time.
+ * REFRESH 0 selects routes on the data path as before.
  */
 
 class SR2QuerierMulti : public Element {
@@ -28,16 +41,23 @@ public:
   const char *processing() const		{ return PUSH; }
   const char *flow_code() const			{ return "#/#"; }
   int configure(Vector<String> &conf, ErrorHandler *errh);
+  int initialize(ErrorHandler *);
+  void run_timer(Timer *);
 
   /* handler stuff */
   void add_handlers();
   String print_queries();
+  String print_query_stats();
 
   void push(int, Packet *);
   void send_query(IPAddress);
 
 private:
 
+  void send_queries(const Vector<IPAddress> &);
+  void flush_queries();
+  bool refresh_routes();
+
   class DstInfoMulti {
   public:
     DstInfoMulti() {memset(this, 0, sizeof(*this)); }
@@ -49,7 +69,13 @@ private:
     SR2PathMulti _p;
     Timestamp _last_switch;    // last time we picked a new best route
     Timestamp _first_selected; // when _p was first selected as best route
+    bool _pending;             // waiting in _pending_dsts
+    Timestamp _last_used;      // last data packet for this destination
+    bool _held;                // a better route waits for TIME_BEFORE_SWITCH
   };
+
+  void update_route(DstInfoMulti *, bool hysteresis);
+  bool route_aging(SR2PathMulti &);
   
   typedef HashMap<IPAddress, DstInfoMulti> DstTableMulti;
   DstTableMulti _queries;
@@ -65,6 +91,25 @@ private:
   class SR2LinkTableMulti *_link_table;
   class AvailableInterfaces *_if_table;
 
+  Vector<IPAddress> _pending_dsts;
+  unsigned _aggregate; // msecs
+  int _max_aggregate;
+  Timer _timer;
+
+  uint32_t _dsts_queried;
+  uint32_t _query_packets;
+  uint32_t _aggregate_packets;
+
+  unsigned _refresh; // msecs
+  unsigned _hysteresis; // percent
+  Timestamp _active;
+  Timer _refresh_timer;
+  uint32_t _refresh_generation;
+  uint32_t _refreshes;
+  uint32_t _route_switches;
+  uint32_t _switches_held;
+  uint32_t _early_queries;
+
   bool _debug;
 
   static int write_handler(const String &, Element *, void *, ErrorHandler *);
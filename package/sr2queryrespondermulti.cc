@@ -46,6 +46,8 @@ int
 SR2QueryResponderMulti::configure (Vector<String> &conf, ErrorHandler *errh)
 {
   int ret;
+  int seen_capacity = 100;
+  unsigned int seen_expire = 30000;
   _debug = false;
   ret = cp_va_kparse(conf, this, errh,
 		     "ETHTYPE", 0, cpUnsignedShort, &_et,
@@ -54,6 +56,8 @@ SR2QueryResponderMulti::configure (Vector<String> &conf, ErrorHandler *errh)
 		     "IT", 0, cpElement, &_if_table,
 		     "ARP", 0, cpElement, &_arp_table,
 		     "DEBUG", 0, cpBool, &_debug,
+		     "SEEN_CAPACITY", 0, cpInteger, &seen_capacity,
+		     "SEEN_EXPIRE", 0, cpUnsigned, &seen_expire,
 		     cpEnd);
 
   if (!_et) 
@@ -70,6 +74,10 @@ SR2QueryResponderMulti::configure (Vector<String> &conf, ErrorHandler *errh)
     return errh->error("AvailableInterfaces element is not an AvailableInterfaces");
   if (_arp_table->cast("ARPTableMulti") == 0) 
     return errh->error("ARPTableMulti element is not a ARPTableMulti");
+  if (seen_capacity < 1) 
+    return errh->error("SEEN_CAPACITY must be positive");
+
+  _seen.configure(seen_capacity, seen_expire);
 
   return ret;
 }
@@ -167,26 +175,14 @@ SR2QueryResponderMulti::forward_reply(struct sr2packetmulti *pk)
 void 
 SR2QueryResponderMulti::start_reply(IPAddress src, IPAddress qdst, uint32_t seq)
 {
-  _link_table->dijkstra(false);
-  SR2PathMulti best = _link_table->best_route(src, false);
-  bool best_valid = _link_table->valid_route(best);
-  int si = 0;
-  
-  for(si = 0; si < _seen.size(); si++){
-    if(src == _seen[si]._src && seq == _seen[si]._seq) {
-      break;
-    }
-  }
-
-  if (si == _seen.size()) {
-    if (_seen.size() >= 100) {
-      _seen.pop_front();
-    }
-    _seen.push_back(Seen(src, qdst, seq));
-    si = _seen.size() - 1;
+  SR2RouteHeaderMulti hdr = _link_table->route_header(src);
+  const SR2PathMulti &best = hdr._path;
+  Seen *s = _seen.find(src, seq);
+  if (!s) {
+    s = _seen.insert(src, seq, Seen(src, qdst, seq));
   }
 
-  if (best == _seen[si].last_path_response) {
+  if (best == s->last_path_response) {
     /*
      * only send replies if the "best" path is different
      * from the last reply
@@ -194,12 +190,10 @@ SR2QueryResponderMulti::start_reply(IPAddress src, IPAddress qdst, uint32_t seq)
     return;
   }
 
-  _seen[si]._src = src;
-  _seen[si]._dst = qdst;
-  _seen[si]._seq = seq;
-  _seen[si].last_path_response = best;
+  s->_dst = qdst;
+  s->last_path_response = best;
   
-  if (!best_valid) {
+  if (!hdr._valid) {
     click_chatter("%{element} :: %s :: invalid route for src %s: %s",
 		  this,
 		  __func__,
@@ -207,7 +201,7 @@ SR2QueryResponderMulti::start_reply(IPAddress src, IPAddress qdst, uint32_t seq)
 		  path_to_string(best).c_str());
     return;
   }
-  int links = best.size() - 1;
+  int links = hdr.num_links();
   int len = sr2packetmulti::len_wo_data(links);
   if (_debug) {
     click_chatter("%{element} :: %s :: start reply %s <- %s",
@@ -231,14 +225,7 @@ SR2QueryResponderMulti::start_reply(IPAddress src, IPAddress qdst, uint32_t seq)
   pk_out->set_next(links-1);
   pk_out->set_qdst(qdst);
   
-  for (int i = 0; i < links; i++) {
-    pk_out->set_link(i,
-		     best[i].get_dep(), best[i+1].get_arr(),
-		     _link_table->get_link_metric(best[i].get_dep(), best[i+1].get_arr()),
-		     _link_table->get_link_metric(best[i+1].get_dep(), best[i].get_arr()),
-		     _link_table->get_link_seq(best[i].get_dep(), best[i+1].get_arr()),
-		     _link_table->get_link_age(best[i].get_dep(), best[i+1].get_arr()));
-  }
+  hdr.write_links(pk_out);
   
   send(p);
 }
@@ -264,6 +251,17 @@ SR2QueryResponderMulti::push(int, Packet *p_in)
     return;
   }
 
+  if (pk->_type == SR2_PT_MQUERY) {
+    for (int x = 0; x < pk->num_qdsts(); x++) {
+      if (pk->get_qdst(x) == _ip) {
+	start_reply(pk->get_link_node(0), _ip, pk->seq());
+	break;
+      }
+    }
+    p_in->kill();
+    return;
+  }
+
   if (eh->ether_type != htons(_et)) {
     click_chatter("%{element} :: %s :: bad ether_type %04x",
 					this,
@@ -357,7 +355,7 @@ SR2QueryResponderMulti::push(int, Packet *p_in)
     
 }
 
-enum {H_DEBUG, H_IP};
+enum {H_DEBUG, H_IP, H_SEEN_STATS};
 
 String
 SR2QueryResponderMulti::read_handler(Element *e, void *thunk)
@@ -368,6 +366,8 @@ SR2QueryResponderMulti::read_handler(Element *e, void *thunk)
     return String(td->_debug) + "\n";
   case H_IP:
     return td->_ip.unparse() + "\n";
+  case H_SEEN_STATS:
+    return td->_seen.stats();
   default:
     return String();
   }
@@ -396,6 +396,7 @@ SR2QueryResponderMulti::add_handlers()
 {
   add_read_handler("debug", read_handler, H_DEBUG);
   add_read_handler("ip", read_handler, H_IP);
+  add_read_handler("seen_stats", read_handler, H_SEEN_STATS);
 
   add_write_handler("debug", write_handler, H_DEBUG);
 }
@@ -11,6 +11,7 @@
 #include "availableinterfaces.hh"
 #include "sr2pathmulti.hh"
 #include "sr2nodemulti.hh"
+#include "sr2seencachemulti.hh"
 CLICK_DECLS
 
 /*
@@ -45,7 +46,7 @@ class SR2QueryResponderMulti : public Element {
 
   class Seen {
   public:
-    Seen();
+    Seen() : _seq(0) { }
     Seen(IPAddress src, IPAddress dst, uint32_t seq) {
       _src = src;
       _dst = dst;
@@ -57,7 +58,7 @@ class SR2QueryResponderMulti : public Element {
     SR2PathMulti last_path_response;
   };
 
-  DEQueue<Seen> _seen;
+  SR2SeenCacheMulti<Seen> _seen;
 
   class SR2LinkTableMulti *_link_table;
   class ARPTableMulti *_arp_table;
@@ -0,0 +1,226 @@
+#ifndef CLICK_SR2SEENCACHEMULTI_HH
+#define CLICK_SR2SEENCACHEMULTI_HH
+#include <click/glue.hh>
+#include <click/ipaddress.hh>
+#include <click/timestamp.hh>
+#include <click/vector.hh>
+#include <click/straccum.hh>
+CLICK_DECLS
+
+/*
+ * Duplicate suppression for flooded packets, keyed on (src, seq).
+ *
+ * Entries live in a ring of CAPACITY slots in arrival order. Since all
+ * entries share the same lifetime, the oldest one is also the first to
+ * expire, so expiry and eviction only ever remove the head of the ring.
+ * Lookups go through an open-addressing index (linear probing, backward
+ * shift on removal) of at least twice the capacity.
+ *
+ * An entry pushed out by capacity before its lifetime was over is
+ * remembered in a direct-mapped ghost table; seeing the same (src, seq)
+ * again afterwards is counted as a false re-flood.
+ */
+template <typename T>
+class SR2SeenCacheMulti {
+  public:
+
+    class Entry {
+      public:
+	Entry() : _seq(0) { }
+	IPAddress _src;
+	uint32_t _seq;
+	Timestamp _expire;
+	T _data;
+    };
+
+    SR2SeenCacheMulti() : _hits(0), _misses(0), _inserts(0),
+			  _evictions(0), _expired(0), _refloods(0) {
+      configure(100, 30000);
+    }
+
+    void configure(int capacity, unsigned expire) {
+      if (capacity < 1)
+	capacity = 1;
+      _capacity = capacity;
+      _lifetime = Timestamp::make_msec(expire);
+      _expire_msec = expire;
+      int size = 4;
+      while (size < 2 * capacity)
+	size <<= 1;
+      _mask = size - 1;
+      _slots.clear();
+      _slots.resize(capacity);
+      _index.clear();
+      _index.resize(size, -1);
+      _ghost.clear();
+      _ghost.resize(size);
+      _head = 0;
+      _count = 0;
+    }
+
+    int size() const { return _count; }
+    int capacity() const { return _capacity; }
+
+    /* n-th live entry, oldest first */
+    Entry &at(int n) { return _slots[ring(n)]; }
+    const Entry &at(int n) const { return _slots[ring(n)]; }
+
+    T *find(IPAddress src, uint32_t seq) {
+      expire(Timestamp::now());
+      int pos = lookup(src, seq);
+      if (pos < 0) {
+	_misses++;
+	return 0;
+      }
+      _hits++;
+      return &_slots[_index[pos]]._data;
+    }
+
+    /* like find(), but does not count as a hit or a miss */
+    T *peek(IPAddress src, uint32_t seq) {
+      expire(Timestamp::now());
+      int pos = lookup(src, seq);
+      return (pos < 0) ? 0 : &_slots[_index[pos]]._data;
+    }
+
+    /* caller must have checked that (src, seq) is not in the cache */
+    T *insert(IPAddress src, uint32_t seq, const T &data) {
+      Timestamp now = Timestamp::now();
+      expire(now);
+      if (_count == _capacity) {
+	Entry &old = _slots[_head];
+	Entry &ghost = _ghost[bucket(old._src, old._seq)];
+	ghost._src = old._src;
+	ghost._seq = old._seq;
+	ghost._expire = old._expire;
+	_evictions++;
+	pop();
+      }
+      Entry &ghost = _ghost[bucket(src, seq)];
+      if (ghost._src == src && ghost._seq == seq) {
+	if (now < ghost._expire)
+	  _refloods++;
+	ghost._src = IPAddress();
+      }
+
+      int slot = ring(_count);
+      Entry &e = _slots[slot];
+      e._src = src;
+      e._seq = seq;
+      e._expire = now + _lifetime;
+      e._data = data;
+      _count++;
+      _inserts++;
+
+      int pos = bucket(src, seq);
+      while (_index[pos] >= 0)
+	pos = (pos + 1) & _mask;
+      _index[pos] = slot;
+      return &e._data;
+    }
+
+    void clear() {
+      for (int x = 0; x < _index.size(); x++)
+	_index[x] = -1;
+      _head = 0;
+      _count = 0;
+    }
+
+    void reset_stats() {
+      _hits = _misses = _inserts = _evictions = _expired = _refloods = 0;
+    }
+
+    String stats() const {
+      StringAccum sa;
+      sa << "entries " << _count;
+      sa << " capacity " << _capacity;
+      sa << " expire " << _expire_msec;
+      sa << " hits " << _hits;
+      sa << " misses " << _misses;
+      sa << " inserts " << _inserts;
+      sa << " evictions " << _evictions;
+      sa << " expired " << _expired;
+      sa << " refloods " << _refloods << "\n";
+      return sa.take_string();
+    }
+
+  private:
+
+    Vector<Entry> _slots;
+    Vector<int> _index;
+    Vector<Entry> _ghost;
+    int _capacity;
+    int _mask;
+    int _head;
+    int _count;
+    Timestamp _lifetime;
+    unsigned _expire_msec;
+
+    uint32_t _hits;
+    uint32_t _misses;
+    uint32_t _inserts;
+    uint32_t _evictions;
+    uint32_t _expired;
+    uint32_t _refloods;
+
+    int ring(int n) const {
+      n += _head;
+      return (n >= _capacity) ? n - _capacity : n;
+    }
+
+    int bucket(IPAddress src, uint32_t seq) const {
+      uint32_t h = src.addr() ^ (seq * 0x9E3779B1U);
+      h ^= h >> 16;
+      h *= 0x85EBCA6BU;
+      h ^= h >> 13;
+      return h & _mask;
+    }
+
+    int lookup(IPAddress src, uint32_t seq) const {
+      int pos = bucket(src, seq);
+      while (_index[pos] >= 0) {
+	const Entry &e = _slots[_index[pos]];
+	if (e._src == src && e._seq == seq)
+	  return pos;
+	pos = (pos + 1) & _mask;
+      }
+      return -1;
+    }
+
+    void expire(const Timestamp &now) {
+      while (_count && !(now < _slots[_head]._expire)) {
+	_expired++;
+	pop();
+      }
+    }
+
+    /* drop the oldest entry and close the gap it leaves in the index */
+    void pop() {
+      const Entry &e = _slots[_head];
+      int i = lookup(e._src, e._seq);
+      _head = ring(1);
+      _count--;
+      if (i < 0)
+	return;
+      for (;;) {
+	_index[i] = -1;
+	int j = i;
+	for (;;) {
+	  j = (j + 1) & _mask;
+	  if (_index[j] < 0)
+	    return;
+	  const Entry &m = _slots[_index[j]];
+	  int k = bucket(m._src, m._seq);
+	  if ((i <= j) ? (i < k && k <= j) : (i < k || k <= j))
+	    continue;
+	  break;
+	}
+	_index[i] = _index[j];
+	i = j;
+      }
+    }
+
+};
+
+CLICK_ENDDECLS
+#endif
@@ -47,7 +47,7 @@ SR2SetChecksumMulti::simple_action(Packet *p_in)
   unsigned int tlen = 0;
   if (!pk)
     goto bad;
-  if ((pk->_type & SR2_PT_DATA) || (pk->_type & SR2_PT_CHSCINFO) || (pk->_type & SR2_PT_CHASSIGN) || (pk->_type & SR2_PT_CHNGWARN)) {
+  if ((pk->_type & SR2_PT_DATA) || (pk->_type & SR2_PT_CHSCINFO) || (pk->_type & SR2_PT_CHASSIGN) || (pk->_type & SR2_PT_CHNGWARN) || (pk->_type == SR2_PT_GATEWAY) || (pk->_type == SR2_PT_MQUERY)) {
     tlen = pk->hlen_with_data();
   } else {
     tlen = pk->hlen_wo_data();
@@ -29,6 +29,9 @@ CLICK_DECLS
 
 SR2SetGatewayMulti::SR2SetGatewayMulti()
   :  _gw_sel(0),
+     _ring_version(0),
+     _ring_valid(false),
+     _margin(0),
      _timer(this)
 {
 
@@ -43,18 +46,35 @@ SR2SetGatewayMulti::configure (Vector<String> &conf, ErrorHandler *errh)
 {
   _gw = IPAddress();
   _period = 60000;
+  _closed_timeout = 2000;
+  _udp_timeout = 30000;
+  _icmp_timeout = 10000;
+  _ip_timeout = 60000;
+  int capacity = 16384;
   int ret;
   ret = cp_va_kparse(conf, this, errh,
 		     "GW", 0, cpIPAddress, &_gw,
 		     "SEL", 0, cpElement, &_gw_sel,
 		     "PERIOD", 0, cpUnsigned, &_period,
+		     "MARGIN", 0, cpUnsigned, &_margin,
+		     "CLOSED_TIMEOUT", 0, cpUnsigned, &_closed_timeout,
+		     "CAPACITY", 0, cpInteger, &capacity,
+		     "UDP_TIMEOUT", 0, cpUnsigned, &_udp_timeout,
+		     "ICMP_TIMEOUT", 0, cpUnsigned, &_icmp_timeout,
+		     "IP_TIMEOUT", 0, cpUnsigned, &_ip_timeout,
 		     cpEnd);
+  if (ret < 0)
+    return ret;
 
   if (_gw_sel && _gw_sel->cast("SR2GatewaySelectorMulti") == 0) 
     return errh->error("SR2GatewaySelectorMulti element is not a SR2GatewaySelectorMulti");
   if (!_gw_sel && !_gw) {
     return errh->error("Either GW or SEL must be specified!\n");
   }
+  if (capacity < 1)
+    return errh->error("CAPACITY must be at least 1");
+  _flow_table.configure(capacity);
+  _pin_table.configure(capacity);
 
   return ret;
 }
@@ -63,7 +83,6 @@ int
 SR2SetGatewayMulti::initialize (ErrorHandler *)
 {
   _timer.initialize (this);
-  _timer.schedule_now ();
 
   return 0;
 }
@@ -71,20 +90,155 @@ SR2SetGatewayMulti::initialize (ErrorHandler *)
 void
 SR2SetGatewayMulti::run_timer (Timer *)
 {
-  cleanup();
-  _timer.schedule_after_msec(_period);
+  Timestamp now = Timestamp::now();
+  _flow_table.expire(now);
+  _pin_table.expire(now);
+  if (_flow_table.size() || _pin_table.size())
+    _timer.schedule_after_msec(FlowTable::TICK);
+}
+
+/* the wheels only tick while there are flows, the first one starts them */
+SR2SetGatewayMulti::FlowTable::Entry *
+SR2SetGatewayMulti::add_flow(FlowTable &table, const IPFlowID &flowid, unsigned timeout)
+{
+  FlowTable::Entry *fe = table.insert(flowid, FlowTableEntry(), timeout);
+  if (!_timer.scheduled())
+    _timer.schedule_after_msec(FlowTable::TICK);
+  return fe;
+}
+
+static inline uint32_t
+ring_mix(uint32_t h)
+{
+  h ^= h >> 16;
+  h *= 0x85EBCA6BU;
+  h ^= h >> 13;
+  h *= 0xC2B2AE35U;
+  h ^= h >> 16;
+  return h;
+}
+
+static int ringpoint_sorter(const void *va, const void *vb, void *) {
+  const uint32_t a = *(const uint32_t *)va, b = *(const uint32_t *)vb;
+  if (a == b)
+    return 0;
+  return (a < b) ? -1 : 1;
+}
+
+void
+SR2SetGatewayMulti::build_ring()
+{
+  /* gateways() may recompute the candidates, so read the version after it */
+  const Vector<SR2GatewaySelectorMulti::GWCandidate> &c = _gw_sel->gateways();
+  _ring.clear();
+  _ring_version = _gw_sel->gateway_updates();
+  _ring_valid = true;
+  if (!c.size())
+    return;
+
+  int best_metric = 0;
+  uint32_t min_load = 0;
+  for (int x = 0; x < c.size(); x++) {
+    if (!best_metric || c[x]._metric < best_metric)
+      best_metric = c[x]._metric;
+  }
+  bool first = true;
+  for (int x = 0; x < c.size(); x++) {
+    if ((uint64_t) c[x]._metric * 100 > (uint64_t) best_metric * (100 + _margin))
+      continue;
+    if (first || c[x]._load < min_load)
+      min_load = c[x]._load;
+    first = false;
+  }
+
+  /*
+   * every gateway gets the same points, the least loaded one takes every
+   * flow reaching its points, the others proportionally fewer
+   */
+  for (int x = 0; x < c.size(); x++) {
+    if ((uint64_t) c[x]._metric * 100 > (uint64_t) best_metric * (100 + _margin))
+      continue;
+    uint32_t weight = (uint32_t) (RING_WEIGHT * ((uint64_t) min_load + 1) / ((uint64_t) c[x]._load + 1));
+    if (weight < 1)
+      weight = 1;
+    for (uint32_t y = 0; y < RING_POINTS; y++)
+      _ring.push_back(RingPoint(ring_mix(c[x]._ip.addr() ^ ring_mix(y + 1)), c[x]._ip, weight));
+  }
+  click_qsort(_ring.begin(), _ring.size(), sizeof(RingPoint), ringpoint_sorter);
+}
+
+IPAddress
+SR2SetGatewayMulti::pick_gateway(const IPFlowID &flowid)
+{
+  if (!_margin)
+    return _gw_sel->best_gateway();
+  if (!_ring_valid || _ring_version != _gw_sel->gateway_updates()) 
+    build_ring();
+  if (!_ring.size())
+    return _gw_sel->best_gateway();
+
+  uint32_t h = ring_mix(flowid.hashcode());
+  int lo = 0, hi = _ring.size();
+  while (lo < hi) {
+    int mid = (lo + hi) / 2;
+    if (_ring[mid]._point < h)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  /* the least loaded gateway accepts every flow, so this ends within one turn */
+  for (int n = 0; n < _ring.size(); n++, lo++) {
+    if (lo == _ring.size())
+      lo = 0;
+    if (ring_mix(h ^ _ring[lo]._point) % RING_WEIGHT < _ring[lo]._weight)
+      return _ring[lo]._gw;
+  }
+  return _gw_sel->best_gateway();
+}
+
+SR2SetGatewayMulti::GWStats *
+SR2SetGatewayMulti::gw_stats(IPAddress gw)
+{
+  GWStats *s = _gw_stats.findp(gw);
+  if (!s) {
+    _gw_stats.insert(gw, GWStats());
+    s = _gw_stats.findp(gw);
+    s->_window_start = Timestamp::now();
+  }
+  return s;
+}
+
+/* per packet, so only done when MARGIN spreads flows by load */
+void
+SR2SetGatewayMulti::account(IPAddress gw, Packet *p)
+{
+  if (!_margin || !gw)
+    return;
+  GWStats *s = gw_stats(gw);
+  s->_bytes += p->length();
+  s->_window_bytes += p->length();
+  Timestamp now = Timestamp::now();
+  Timestamp elapsed = now - s->_window_start;
+  if (elapsed.sec() >= 1) {
+    s->_rate = (uint32_t) ((uint64_t) s->_window_bytes * 1000 / elapsed.msecval());
+    s->_window_bytes = 0;
+    s->_window_start = now;
+  }
 }
 
 void 
-SR2SetGatewayMulti::push_fwd(Packet *p_in, IPAddress best_gw) 
+SR2SetGatewayMulti::push_fwd(Packet *p_in) 
 {
 	const click_tcp *tcph = p_in->tcp_header();
 	IPFlowID flowid = IPFlowID(p_in);
-	FlowTableEntry *match = _flow_table.findp(flowid);
+	FlowTable::Entry *fe = _flow_table.find(flowid);
+	FlowTableEntry *match = fe ? &fe->_data : 0;
 	
 	if ((tcph->th_flags & TH_SYN) && match && match->is_pending()) {
 		match->_outstanding_syns++;
+		refresh(fe);
 		p_in->set_dst_ip_anno(match->_gw);
+		account(match->_gw, p_in);
 		output(0).push(p_in);
 		return;
 	}  else if (!(tcph->th_flags & TH_SYN)) {
@@ -96,7 +250,9 @@ SR2SetGatewayMulti::push_fwd(Packet *p_in, IPAddress best_gw)
 			if (tcph->th_flags & TH_RST) {
 				match->_rev_alive = false; // rev flow is over
 			}
+			refresh(fe);
 			p_in->set_dst_ip_anno(match->_gw);
+			account(match->_gw, p_in);
 			output(0).push(p_in);
 			return;
 		}
@@ -107,19 +263,24 @@ SR2SetGatewayMulti::push_fwd(Packet *p_in, IPAddress best_gw)
 			      flowid.unparse().c_str());
 	}
 	
+	IPAddress best_gw = pick_gateway(flowid);
 	if (!best_gw) {
 		p_in->kill();
 		return;
 	}
 
-	/* no match */
-	_flow_table.insert(flowid, FlowTableEntry());
-	match = _flow_table.findp(flowid);
+	/* no match, or a new SYN for a finished flow */
+	if (fe)
+		_flow_table.remove(fe);
+	fe = add_flow(_flow_table, flowid, _period);
+	match = &fe->_data;
 	match->_id = flowid;
 	match->_gw = best_gw;
 	match->saw_forward_packet();
 	match->_outstanding_syns++;
 	p_in->set_dst_ip_anno(best_gw);
+	account(best_gw, p_in);
+	gw_stats(best_gw)->_new_flows++;
 	output(0).push(p_in);
 }
 
@@ -129,7 +290,8 @@ SR2SetGatewayMulti::push_rev(Packet *p_in)
 {
 	const click_tcp *tcph = p_in->tcp_header();
 	IPFlowID flowid = IPFlowID(p_in).reverse();
-	FlowTableEntry *match = _flow_table.findp(flowid);
+	FlowTable::Entry *fe = _flow_table.find(flowid);
+	FlowTableEntry *match = fe ? &fe->_data : 0;
 	
 	if ((tcph->th_flags & TH_SYN) && (tcph->th_flags & TH_ACK)) {
 		if (match) {
@@ -145,6 +307,8 @@ SR2SetGatewayMulti::push_rev(Packet *p_in)
 			}
 			match->saw_reply_packet();
 			match->_outstanding_syns = 0;
+			refresh(fe);
+			account(match->_gw, p_in);
 			output(1).push(p_in);
 			return;
 		}
@@ -163,6 +327,8 @@ SR2SetGatewayMulti::push_rev(Packet *p_in)
 		if (tcph->th_flags & TH_RST) {
 			match->_fwd_alive = false;
 		}
+		refresh(fe);
+		account(match->_gw, p_in);
 		output(1).push(p_in);
 		return;
 	}
@@ -172,12 +338,13 @@ SR2SetGatewayMulti::push_rev(Packet *p_in)
 		      __func__, 
 		      flowid.unparse().c_str());
 	
-	_flow_table.insert(flowid, FlowTableEntry());
-	match = _flow_table.findp(flowid);
+	fe = add_flow(_flow_table, flowid, _period);
+	match = &fe->_data;
 	match->_id = flowid;
 	match->_gw = MISC_IP_ANNO(p_in);
 	match->saw_reply_packet();
 	
+	account(match->_gw, p_in);
 	output(1).push(p_in);
 	return;
 }
@@ -201,56 +368,178 @@ SR2SetGatewayMulti::push(int port, Packet *p_in)
   }
 
   if (p_in->ip_header()->ip_p != IP_PROTO_TCP) {
-    if (port == 0 && _gw_sel) {
-      /* non tcp packets go to best gw */
-      IPAddress gateway = _gw_sel->best_gateway();
-      p_in->set_dst_ip_anno(gateway);
-    } else {
-      p_in->set_dst_ip_anno(IPAddress());
-    }
-    output(port).push(p_in);
+    push_pinned(port, p_in);
     return;
   }
 
   if (port == 0) {
-    IPAddress gateway = _gw_sel->best_gateway();
-    push_fwd(p_in, gateway);
+    push_fwd(p_in);
   } else {
     /* incoming packet */
     push_rev(p_in);
   }
 }
 
+uint32_t
+SR2SetGatewayMulti::pin_timeout(uint8_t proto) const
+{
+  switch (proto) {
+  case IP_PROTO_UDP:
+    return _udp_timeout;
+  case IP_PROTO_ICMP:
+    return _icmp_timeout;
+  default:
+    return _ip_timeout;
+  }
+}
+
+bool
+SR2SetGatewayMulti::usable(IPAddress gw)
+{
+  const Vector<SR2GatewaySelectorMulti::GWCandidate> &c = _gw_sel->gateways();
+  for (int x = 0; x < c.size(); x++)
+    if (c[x]._ip == gw)
+      return true;
+  return false;
+}
+
+/* 
+ * non tcp packets: udp is pinned by its ports, everything else by the
+ * address pair with the protocol in both port fields, so the key
+ * reverses for replies. Replies only keep the pin alive.
+ */
+void
+SR2SetGatewayMulti::push_pinned(int port, Packet *p_in)
+{
+  const click_ip *iph = p_in->ip_header();
+  uint8_t proto = iph->ip_p;
+  IPFlowID flowid = (proto == IP_PROTO_UDP) ? IPFlowID(p_in) :
+    IPFlowID(iph->ip_src, htons(proto), iph->ip_dst, htons(proto));
+
+  if (port == 1) {
+    FlowTable::Entry *fe = _pin_table.find(flowid.reverse());
+    if (fe && fe->_data._proto == proto)
+      _pin_table.touch(fe, pin_timeout(proto));
+    account(MISC_IP_ANNO(p_in), p_in);
+    p_in->set_dst_ip_anno(IPAddress());
+    output(1).push(p_in);
+    return;
+  }
+
+  FlowTable::Entry *fe = _pin_table.find(flowid);
+  if (fe && fe->_data._proto != proto) {
+    /* a udp flow between ports numbered like the protocol, leave it be */
+    IPAddress gateway = pick_gateway(flowid);
+    p_in->set_dst_ip_anno(gateway);
+    account(gateway, p_in);
+    output(0).push(p_in);
+    return;
+  }
+  if (fe) {
+    FlowTableEntry *match = &fe->_data;
+    uint32_t version = _gw_sel->gateway_updates();
+    if (match->_version != version) {
+      /* the gateway set changed since we last looked */
+      if (!usable(match->_gw)) {
+	_pin_table.remove(fe);
+	fe = 0;
+      } else
+	match->_version = version;
+    }
+  }
+  if (fe) {
+    _pin_table.touch(fe, pin_timeout(proto));
+    p_in->set_dst_ip_anno(fe->_data._gw);
+    account(fe->_data._gw, p_in);
+    output(0).push(p_in);
+    return;
+  }
+
+  IPAddress gateway = pick_gateway(flowid);
+  if (!gateway) {
+    /* nothing to pin to yet */
+    p_in->set_dst_ip_anno(IPAddress());
+    output(0).push(p_in);
+    return;
+  }
+  fe = add_flow(_pin_table, flowid, pin_timeout(proto));
+  FlowTableEntry *match = &fe->_data;
+  match->_id = flowid;
+  match->_gw = gateway;
+  match->_proto = proto;
+  match->_version = _gw_sel->gateway_updates();
+  p_in->set_dst_ip_anno(gateway);
+  account(gateway, p_in);
+  gw_stats(gateway)->_new_flows++;
+  output(0).push(p_in);
+}
+
 void 
-SR2SetGatewayMulti::cleanup() {
-	FlowTable new_table;
-	Timestamp timeout = Timestamp::make_msec(_period);
-	for(FTIter i = _flow_table.begin(); i.live(); i++) {
-		FlowTableEntry f = i.value();
-		if ((f.age() < timeout && f._fwd_alive) || f._rev_alive) {
-			new_table.insert(f._id, f);
-		}
-	}
-	_flow_table.clear();
-	for(FTIter i = new_table.begin(); i.live(); i++) {
-		FlowTableEntry f = i.value();
-		_flow_table.insert(f._id, f);
-	}
+SR2SetGatewayMulti::refresh(FlowTable::Entry *fe) {
+	const FlowTableEntry &f = fe->_data;
+	if (!f._fwd_alive && !f._rev_alive)
+		_flow_table.touch(fe, _closed_timeout);
+	else
+		_flow_table.touch(fe, _period);
 }
 
 String
 SR2SetGatewayMulti::print_flows()
 {
   StringAccum sa;
-  for(FTIter iter = _flow_table.begin(); iter.live(); iter++) {
-    FlowTableEntry f = iter.value();
-    sa << f._id << " gw " << f._gw << " age " << f.age() << "\n";
+  const FlowTable *tables[] = { &_flow_table, &_pin_table };
+  for (int t = 0; t < 2; t++) {
+    for (int x = 0; x < tables[t]->slots(); x++) {
+      if (!tables[t]->slot(x)._live)
+	continue;
+      FlowTableEntry f = tables[t]->slot(x)._data;
+      sa << f._id << " proto " << (int) f._proto << " gw " << f._gw << " age " << f.age() << "\n";
+    }
   }
 
   return sa.take_string();
 }
 
-enum { H_FLOWS, H_GATEWAY };
+String
+SR2SetGatewayMulti::print_gateways()
+{
+  StringAccum sa;
+  HashMap<IPAddress, int> flows;
+  const FlowTable *tables[] = { &_flow_table, &_pin_table };
+  for (int t = 0; t < 2; t++) {
+    for (int x = 0; x < tables[t]->slots(); x++) {
+      if (!tables[t]->slot(x)._live)
+	continue;
+      IPAddress gw = tables[t]->slot(x)._data._gw;
+      int *n = flows.findp(gw);
+      if (n)
+	(*n)++;
+      else
+	flows.insert(gw, 1);
+    }
+  }
+  HashMap<IPAddress, SR2GatewaySelectorMulti::GWCandidate> cands;
+  if (_gw_sel) {
+    const Vector<SR2GatewaySelectorMulti::GWCandidate> &c = _gw_sel->gateways();
+    for (int x = 0; x < c.size(); x++)
+      cands.insert(c[x]._ip, c[x]);
+  }
+  for(GWSIter iter = _gw_stats.begin(); iter.live(); iter++) {
+    const GWStats &s = iter.value();
+    int *n = flows.findp(iter.key());
+    SR2GatewaySelectorMulti::GWCandidate *c = cands.findp(iter.key());
+    sa << iter.key();
+    sa << " flows " << (n ? *n : 0);
+    sa << " new_flows " << s._new_flows;
+    sa << " bytes " << s._bytes;
+    sa << " rate " << s._rate;
+    sa << " load " << (c ? c->_load : 0);
+    sa << " metric " << (c ? c->_metric : 0) << "\n";
+  }
+  return sa.take_string();
+}
+
+enum { H_FLOWS, H_GATEWAY, H_GATEWAYS, H_MARGIN, H_FLOW_STATS, H_FLOWS_CLEAR };
 
 String
 SR2SetGatewayMulti::read_handler(Element *e, void *thunk)
@@ -261,6 +550,12 @@ SR2SetGatewayMulti::read_handler(Element *e, void *thunk)
     return c->print_flows();
   case H_GATEWAY:
     return (c->_gw) ? c->_gw.unparse() + "\n" : c->_gw_sel->best_gateway().unparse() + "\n";
+  case H_GATEWAYS:
+    return c->print_gateways();
+  case H_MARGIN:
+    return String(c->_margin) + "\n";
+  case H_FLOW_STATS:
+    return String("tcp ") + c->_flow_table.stats() + "pinned " + c->_pin_table.stats();
   default:
     return "<error>\n";
   }
@@ -284,6 +579,20 @@ SR2SetGatewayMulti::write_handler(const String &in_s, Element *e, void *vparam,
       d->_gw = ip;
       break;
     }
+    case H_MARGIN: {
+      unsigned m;
+      if (!cp_unsigned(s, &m)) 
+	return errh->error("margin parameter must be unsigned");
+      d->_margin = m;
+      d->_ring_valid = false;
+      break;
+    }
+    case H_FLOWS_CLEAR:
+      d->_flow_table.clear();
+      d->_flow_table.reset_stats();
+      d->_pin_table.clear();
+      d->_pin_table.reset_stats();
+      break;
   }
   return 0;
 }
@@ -293,8 +602,13 @@ SR2SetGatewayMulti::add_handlers()
 {
   add_read_handler("flows", read_handler, H_FLOWS);
   add_read_handler("gateway", read_handler, H_GATEWAY);
+  add_read_handler("gateways", read_handler, H_GATEWAYS);
+  add_read_handler("margin", read_handler, H_MARGIN);
+  add_read_handler("flow_stats", read_handler, H_FLOW_STATS);
 
   add_write_handler("gateway", write_handler, H_GATEWAY);
+  add_write_handler("margin", write_handler, H_MARGIN);
+  add_write_handler("flows_clear", write_handler, H_FLOWS_CLEAR);
 }
 
 
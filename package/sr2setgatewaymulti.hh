@@ -14,15 +14,38 @@
 #include <clicknet/tcp.h>
 #include "sr2packetmulti.hh"
 #include "sr2gatewayselectormulti.hh"
+#include "sr2flowtablemulti.hh"
 CLICK_DECLS
 
 /*
  * =c
- * SR2SetGateway([GW ipaddress], [SEL GatewaySelector element])
+ * SR2SetGateway([GW ipaddress], [SEL GatewaySelector element], [MARGIN percent],
+ *               [PERIOD msecs], [CLOSED_TIMEOUT msecs], [CAPACITY flows],
+ *               [UDP_TIMEOUT msecs], [ICMP_TIMEOUT msecs], [IP_TIMEOUT msecs])
  * =d
  * This element marks the gateway for a packet to be sent to.
  * Either manually specifiy an gw using the GW keyword
  * or automatically select it using a GatewaySelector element.
+ *
+ * With MARGIN, new flows are spread over all gateways whose path
+ * metric is within MARGIN percent of the best one, weighted by the
+ * load they advertise. Flows are placed with consistent hashing on
+ * the flow id. Every gateway has the same fixed points on the ring and
+ * a flow takes the first point after its hash that accepts it, with
+ * odds of the point's weight, so a change in the gateway set or in a
+ * load only moves the flows whose walk crosses the points concerned.
+ * The per gateway byte and rate counts are only kept with MARGIN.
+ *
+ * TCP flows are kept in a table of CAPACITY entries. A flow is dropped
+ * PERIOD msecs after its last packet, or CLOSED_TIMEOUT msecs after
+ * both directions saw a FIN or RST. When the table is full, the flow
+ * closest to its timeout makes room for the new one.
+ *
+ * Other traffic is pinned in a second table of CAPACITY entries: UDP by
+ * its 5-tuple, all other protocols by address pair and protocol. A
+ * pinned flow keeps its gateway until it has been idle for UDP_TIMEOUT,
+ * ICMP_TIMEOUT or IP_TIMEOUT msecs, or until the gateway is no longer
+ * usable.
  */
 
 class SR2SetGatewayMulti : public Element {
@@ -41,6 +64,7 @@ class SR2SetGatewayMulti : public Element {
   /* handler stuff */
   void add_handlers();
   String print_flows();
+  String print_gateways();
 
   void push(int, Packet *);
   void run_timer(Timer *);
@@ -51,6 +75,8 @@ private:
   public:
     class IPFlowID _id;
     IPAddress _gw;
+    uint8_t _proto;
+    uint32_t _version; /* gateway_updates() when _gw was last checked */
     Timestamp _oldest_unanswered;
     Timestamp _last_reply;
     int _outstanding_syns;
@@ -58,6 +84,9 @@ private:
     bool _rev_alive;
     bool _all_answered;
     FlowTableEntry() {
+      _proto = IP_PROTO_TCP;
+      _version = 0;
+      _outstanding_syns = 0;
       _all_answered = true;
       _fwd_alive = true;
       _rev_alive = true;
@@ -65,6 +94,8 @@ private:
     FlowTableEntry(const FlowTableEntry &e) : 
       _id(e._id),
       _gw(e._gw),
+      _proto(e._proto),
+      _version(e._version),
       _oldest_unanswered(e._oldest_unanswered),
       _last_reply(e._last_reply),
       _outstanding_syns(e._outstanding_syns),
@@ -87,19 +118,61 @@ private:
     Timestamp age() { return Timestamp::now() - _last_reply; }
   };
 
-  typedef HashMap<IPFlowID, FlowTableEntry> FlowTable;
-  typedef FlowTable::const_iterator FTIter;
-  FlowTable _flow_table;
+  typedef SR2FlowTableMulti<FlowTableEntry> FlowTable;
+  FlowTable _flow_table; // tcp
+  FlowTable _pin_table;  // everything else
 
   class SR2GatewaySelectorMulti *_gw_sel;
   IPAddress _gw;
 
+  /* weighted consistent hash ring over the usable gateways */
+  class RingPoint {
+  public:
+    RingPoint() : _point(0), _weight(0) { }
+    RingPoint(uint32_t point, IPAddress gw, uint32_t weight) : _point(point), _gw(gw), _weight(weight) { }
+    uint32_t _point;
+    IPAddress _gw;
+    uint32_t _weight; // out of RING_WEIGHT, odds a flow stops here
+  };
+  enum { RING_POINTS = 32, RING_WEIGHT = 1024 };
+
+  Vector<RingPoint> _ring;
+  uint32_t _ring_version;
+  bool _ring_valid;
+  uint32_t _margin;
+
+  class GWStats {
+  public:
+    GWStats() : _new_flows(0), _bytes(0), _window_bytes(0), _rate(0) { }
+    uint32_t _new_flows;
+    uint64_t _bytes;
+    uint32_t _window_bytes;
+    uint32_t _rate; /* bytes per second over the last full window */
+    Timestamp _window_start;
+  };
+
+  typedef HashMap<IPAddress, GWStats> GWStatsTable;
+  typedef GWStatsTable::const_iterator GWSIter;
+  GWStatsTable _gw_stats;
+
   Timer _timer;
   uint32_t _period;
+  uint32_t _closed_timeout;
+  uint32_t _udp_timeout;
+  uint32_t _icmp_timeout;
+  uint32_t _ip_timeout;
 
-  void push_fwd(Packet *, IPAddress);
+  void push_fwd(Packet *);
+  IPAddress pick_gateway(const IPFlowID &);
+  void build_ring();
+  void account(IPAddress, Packet *);
+  GWStats *gw_stats(IPAddress);
+  FlowTable::Entry *add_flow(FlowTable &, const IPFlowID &, unsigned timeout);
   void push_rev(Packet *);
-  void cleanup();
+  void refresh(FlowTable::Entry *);
+  void push_pinned(int, Packet *);
+  uint32_t pin_timeout(uint8_t) const;
+  bool usable(IPAddress);
 
   static int write_handler(const String &, Element *, void *, ErrorHandler *);
   static String read_handler(Element *, void *);
@@ -0,0 +1,219 @@
+#ifndef CLICK_SR2SWITCHTRACEMULTI_HH
+#define CLICK_SR2SWITCHTRACEMULTI_HH
+#include <click/glue.hh>
+#include <click/timestamp.hh>
+#include <click/vector.hh>
+#include <click/straccum.hh>
+#include "sr2nodemulti.hh"
+CLICK_DECLS
+
+/*
+ * Event timelines of the last channel switches and scans of a node.
+ *
+ * begin() opens a timeline for a radio, mark() stamps each event the
+ * first time it happens. A timeline stays open from UP until the radio
+ * has been heard on again and carries a route, or until the owner gives
+ * up on it. The newest CAPACITY timelines are kept, oldest dropped first.
+ *
+ * unparse() prints one line per timeline, each event as msec since the
+ * timeline began, '-' if it never happened, after a summary line with
+ * the mean and worst time the radio was down, and from UP until the
+ * first probe and the first route.
+ */
+class SR2SwitchTraceMulti {
+  public:
+
+    enum { WARNED, DOWN, RENUMBERED, CMD_DONE, UP, FIRST_PROBE, FIRST_ROUTE, NEVENTS };
+    enum { POLL = 100 };
+
+    static const char *event_name(int event) {
+      switch (event) {
+      case WARNED: return "warn";
+      case DOWN: return "down";
+      case RENUMBERED: return "renum";
+      case CMD_DONE: return "cmd";
+      case UP: return "up";
+      case FIRST_PROBE: return "probe";
+      case FIRST_ROUTE: return "route";
+      default: return "unknown";
+      }
+    }
+
+    class Timeline {
+      public:
+	Timeline() : _id(0), _new_iface(0), _scan(false), _failed(false), _open(true) { }
+	uint32_t _id;
+	NodeAddress _radio;  /* as it was before the switch */
+	uint16_t _new_iface; /* 0 for a scan */
+	bool _scan;
+	bool _failed;        /* the switch command failed */
+	bool _open;
+	Timestamp _start;
+	Timestamp _at[NEVENTS];
+
+	/* the radio that should come back */
+	NodeAddress radio_after() const {
+	  return _scan ? _radio : NodeAddress(_radio._ipaddr, _new_iface);
+	}
+	/* msec from the start to event, -1 if not seen */
+	int64_t offset(int event) const {
+	  return _at[event] ? (_at[event] - _start).msecval() : -1;
+	}
+	int64_t span(int from, int to) const {
+	  return (_at[from] && _at[to]) ? (_at[to] - _at[from]).msecval() : -1;
+	}
+    };
+
+    SR2SwitchTraceMulti() : _capacity(32), _next_id(1) { }
+
+    void set_capacity(int capacity) {
+      _capacity = capacity < 1 ? 1 : capacity;
+      trim();
+    }
+    int capacity() const { return _capacity; }
+    int size() const { return _timelines.size(); }
+    Timeline &at(int n) { return _timelines[n]; }
+    void clear() { _timelines.clear(); }
+
+    uint32_t begin(NodeAddress radio, uint16_t new_iface, bool scan) {
+      Timeline t;
+      t._id = _next_id++;
+      t._radio = radio;
+      t._new_iface = new_iface;
+      t._scan = scan;
+      t._start = Timestamp::now();
+      _timelines.push_back(t);
+      trim();
+      return t._id;
+    }
+
+    Timeline *find(uint32_t id) {
+      for (int x = _timelines.size() - 1; x >= 0; x--) {
+	if (_timelines[x]._id == id) {
+	  return &_timelines[x];
+	}
+      }
+      return 0;
+    }
+
+    /* the newest open switch of radio to new_iface, 0 if none */
+    uint32_t find(NodeAddress radio, uint16_t new_iface) const {
+      for (int x = _timelines.size() - 1; x >= 0; x--) {
+	const Timeline &t = _timelines[x];
+	if (t._open && !t._scan && t._radio == radio && t._new_iface == new_iface) {
+	  return t._id;
+	}
+      }
+      return 0;
+    }
+
+    void mark(uint32_t id, int event) {
+      Timeline *t = find(id);
+      if (t && !t->_at[event]) {
+	t->_at[event] = Timestamp::now();
+      }
+    }
+
+    void fail(uint32_t id) {
+      if (Timeline *t = find(id)) {
+	t->_failed = true;
+      }
+    }
+
+    /* open timelines that are up and still wait for a probe or a route */
+    bool waiting() const {
+      for (int x = 0; x < _timelines.size(); x++) {
+	if (_timelines[x]._open && _timelines[x]._at[UP]) {
+	  return true;
+	}
+      }
+      return false;
+    }
+
+    String unparse() const {
+      StringAccum sa;
+      int switches = 0, scans = 0;
+      Stat down, probe, route;
+      for (int x = 0; x < _timelines.size(); x++) {
+	const Timeline &t = _timelines[x];
+	if (t._scan) {
+	  scans++;
+	} else {
+	  switches++;
+	}
+	down.add(t.span(DOWN, UP));
+	probe.add(t.span(UP, FIRST_PROBE));
+	route.add(t.span(UP, FIRST_ROUTE));
+      }
+      sa << "switches " << switches << " scans " << scans;
+      sa << " down_msec " << down.avg() << "/" << down._max;
+      sa << " probe_msec " << probe.avg() << "/" << probe._max;
+      sa << " route_msec " << route.avg() << "/" << route._max << "\n";
+      for (int x = 0; x < _timelines.size(); x++) {
+	const Timeline &t = _timelines[x];
+	sa << t._id << " " << t._radio._ipaddr << "-" << t._radio._iface;
+	if (t._scan) {
+	  sa << " scan";
+	} else {
+	  sa << " > " << t._new_iface;
+	}
+	sa << " at " << t._start;
+	for (int e = 0; e < NEVENTS; e++) {
+	  sa << " " << event_name(e) << " ";
+	  if (t._at[e]) {
+	    sa << t.offset(e);
+	  } else {
+	    sa << "-";
+	  }
+	}
+	if (t._failed) {
+	  sa << " failed";
+	}
+	if (t._open) {
+	  sa << " open";
+	}
+	sa << "\n";
+      }
+      return sa.take_string();
+    }
+
+  private:
+
+    Vector<Timeline> _timelines;
+    int _capacity;
+    uint32_t _next_id;
+
+    class Stat {
+      public:
+	Stat() : _n(0), _total(0), _max(0) { }
+	int _n;
+	int64_t _total;
+	int64_t _max;
+	void add(int64_t v) {
+	  if (v < 0) {
+	    return;
+	  }
+	  _n++;
+	  _total += v;
+	  if (v > _max) {
+	    _max = v;
+	  }
+	}
+	int64_t avg() const { return _n ? _total / _n : 0; }
+    };
+
+    void trim() {
+      if (_timelines.size() <= _capacity) {
+	return;
+      }
+      int drop = _timelines.size() - _capacity;
+      for (int x = 0; x + drop < _timelines.size(); x++) {
+	_timelines[x] = _timelines[x + drop];
+      }
+      _timelines.resize(_capacity);
+    }
+
+};
+
+CLICK_ENDDECLS
+#endif
@@ -43,115 +43,110 @@ SR2TXCountMetricMulti::cast(const char *n)
 }
 
 void
-SR2TXCountMetricMulti::update_link(NodeAddress from, NodeAddress to, 
-		       Vector<SR2RateSize> rs, 
-		       Vector<int> fwd, Vector<int> rev, 
-		       uint32_t seq)
+SR2TXCountMetricMulti::update_links(const SR2LinkBatchMulti &batch)
 {
-
-  if (!from || !to) {
-    click_chatter("%{element} :: %s :: called with %s %s\n",
-		  this,
-		  __func__,
-		  from._ipaddr.unparse().c_str(),
-		  from._iface,
-		  to._ipaddr.unparse().c_str(),
-		  to._iface);
-    return;
-  }
-
-  int one_ack_fwd = 0;
-  int one_ack_rev = 0;
-  int six_ack_fwd = 0;
-  int six_ack_rev = 0;
-
-  /* 
-   * if we don't have a few probes going out, just pick
-   * the smallest size for fwd rate
-   */
-  int one_ack_size = 0;
-  int six_ack_size = 0;
-
-
-  for (int x = 0; x < rs.size(); x++) {
-    if (rs[x]._rate == 2 && 
-	(!one_ack_size ||
-	 one_ack_size > rs[x]._size)) {
-      one_ack_size = rs[x]._size;
-      one_ack_fwd = fwd[x];
-      one_ack_rev = rev[x];
-    } else if (rs[x]._rate == 12 && 
-	       (!six_ack_size ||
-		six_ack_size > rs[x]._size)) {
-      six_ack_size = rs[x]._size;
-      six_ack_fwd = fwd[x];
-      six_ack_rev = rev[x];
+  Vector<SR2LinkUpdateMulti> updates;
+
+  for (int i = 0; i < batch.size(); i++) {
+    const SR2LinkBatchMulti::Link &l = batch._links[i];
+    NodeAddress from = l._from;
+    NodeAddress to = l._to;
+    const SR2RateSize *rs = batch._rs.begin() + l._first;
+    const int *fwd = batch._fwd.begin() + l._first;
+    const int *rev = batch._rev.begin() + l._first;
+
+    if (!from || !to) {
+      click_chatter("%{element} :: %s :: called with %s %s\n",
+		    this,
+		    __func__,
+		    from._ipaddr.unparse().c_str(),
+		    to._ipaddr.unparse().c_str());
+      continue;
     }
-  }
-  
-  if (!one_ack_fwd && !six_ack_fwd &&
-      !one_ack_rev && !six_ack_rev) {
-    return;
-  }
 
-  int rev_metric = 0;
-  int fwd_metric = 0;
-
-  int rev_rate = 0;
-  int fwd_rate = 0;
-  
-  int rev_probe = 0;
-  int fwd_probe = 0;
-
-  for (int x = 0; x < rs.size(); x++) {
-    if (rs[x]._size >= 100) {
-      int ack_fwd = 0;
-      int ack_rev = 0;
-      if ((rs[x]._rate == 2) ||
-	  (rs[x]._rate == 4) ||
-	  (rs[x]._rate == 11) ||
-	  (rs[x]._rate == 22)) {
-	ack_fwd = one_ack_fwd;
-	ack_rev = one_ack_rev;
-      } else {
-	ack_fwd = six_ack_fwd;
-	ack_rev = six_ack_rev;
+    int one_ack_fwd = 0;
+    int one_ack_rev = 0;
+    int six_ack_fwd = 0;
+    int six_ack_rev = 0;
+
+    /* 
+     * if we don't have a few probes going out, just pick
+     * the smallest size for fwd rate
+     */
+    int one_ack_size = 0;
+    int six_ack_size = 0;
+
+    for (int x = 0; x < l._count; x++) {
+      if (rs[x]._rate == 2 && 
+	  (!one_ack_size ||
+	   one_ack_size > rs[x]._size)) {
+	one_ack_size = rs[x]._size;
+	one_ack_fwd = fwd[x];
+	one_ack_rev = rev[x];
+      } else if (rs[x]._rate == 12 && 
+		 (!six_ack_size ||
+		  six_ack_size > rs[x]._size)) {
+	six_ack_size = rs[x]._size;
+	six_ack_fwd = fwd[x];
+	six_ack_rev = rev[x];
       }
+    }
+    
+    if (!one_ack_fwd && !six_ack_fwd &&
+	!one_ack_rev && !six_ack_rev) {
+      continue;
+    }
 
-      int metric = sr2_etx_metric(ack_rev, fwd[x]);
+    int rev_metric = 0;
+    int fwd_metric = 0;
 
-      if (!fwd_metric|| (metric && metric < fwd_metric)) {
-	fwd_probe = rs[x]._size;
-	fwd_rate = rs[x]._rate;
-	fwd_metric = metric;
-      }
+    int rev_rate = 0;
+    int fwd_rate = 0;
+
+    int rev_probe = 0;
+    int fwd_probe = 0;
+  
+    for (int x = 0; x < l._count; x++) {
+      if (rs[x]._size >= 100) {
+	int ack_fwd = 0;
+	int ack_rev = 0;
+	if (_etx_table.ack_rate(rs[x]._rate) == 2) {
+	  ack_fwd = one_ack_fwd;
+	  ack_rev = one_ack_rev;
+	} else {
+	  ack_fwd = six_ack_fwd;
+	  ack_rev = six_ack_rev;
+	}
+
+	int metric = _etx_table.metric(ack_rev, fwd[x]);
+
+	if (!fwd_metric|| (metric && metric < fwd_metric)) {
+	  fwd_probe = rs[x]._size;
+	  fwd_rate = rs[x]._rate;
+	  fwd_metric = metric;
+	}
       
-      metric = sr2_etx_metric(ack_rev, fwd[x]);
+	metric = _etx_table.metric(ack_rev, fwd[x]);
 
-      if (!rev_metric || (metric && metric < rev_metric)) {
-	rev_probe = rs[x]._size;
-	rev_rate= rs[x]._rate;
-	rev_metric = metric;
+	if (!rev_metric || (metric && metric < rev_metric)) {
+	  rev_probe = rs[x]._size;
+	  rev_rate= rs[x]._rate;
+	  rev_metric = metric;
+	}
       }
     }
-  }
-
-  /* update linktable */
-  if (fwd_metric && 
-      _link_table && 
-      !_link_table->update_link(from, to, seq, 0, fwd_metric)) {
-
-    _link_table->set_link_rate(from, to, fwd_rate);
-    _link_table->set_link_probe(from, to, fwd_probe);
 
+    if (fwd_metric) {
+      updates.push_back(SR2LinkUpdateMulti(from, to, l._seq, 0, fwd_metric, fwd_rate, fwd_probe, 0));
+    }
+    if (rev_metric) {
+      updates.push_back(SR2LinkUpdateMulti(to, from, l._seq, 0, rev_metric, rev_rate, rev_probe, 0));
+    }
   }
-  if (rev_metric && 
-      _link_table && 
-      !_link_table->update_link(to, from, seq, 0, rev_metric)){
-
-    _link_table->set_link_rate(from, to, fwd_rate);
-    _link_table->set_link_probe(from, to, fwd_probe);
 
+  /* update linktable */
+  if (_link_table && updates.size()) {
+    _link_table->update_links(updates);
   }
 }
 
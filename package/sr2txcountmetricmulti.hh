@@ -31,6 +31,42 @@ inline unsigned sr2_etx_metric(int ack_prob, int data_prob)
 
 }
 
+/*
+ * sr2_etx_metric() for every pair of delivery ratios, filled in once so
+ * that evaluating the metric is a single load. Ratios outside 0-100 fall 
+ * back to the formula. Also knows which probe rate the ack of a data 
+ * rate is sent at: 1 Mbps (2) for 802.11b rates, 6 Mbps (12) otherwise.
+ */
+class SR2ETXTableMulti {
+  public:
+    SR2ETXTableMulti() {
+      for (int ack = 0; ack <= 100; ack++) {
+	for (int data = 0; data <= 100; data++) {
+	  _etx[ack][data] = sr2_etx_metric(ack, data);
+	}
+      }
+      for (int rate = 0; rate < 256; rate++) {
+	_ack_rate[rate] = 12;
+      }
+      _ack_rate[2] = _ack_rate[4] = _ack_rate[11] = _ack_rate[22] = 2;
+    }
+
+    int ack_rate(int rate) const {
+      return ((unsigned) rate < 256) ? _ack_rate[rate] : 12;
+    }
+
+    unsigned metric(int ack_prob, int data_prob) const {
+      if ((unsigned) ack_prob > 100 || (unsigned) data_prob > 100) {
+	return sr2_etx_metric(ack_prob, data_prob);
+      }
+      return _etx[ack_prob][data_prob];
+    }
+
+  private:
+    uint16_t _etx[101][101];
+    uint8_t _ack_rate[256];
+};
+
 class SR2TXCountMetricMulti : public SR2LinkMetricMulti {
   
 public:
@@ -41,10 +77,11 @@ public:
   void *cast(const char *);
   const char *processing() const { return AGNOSTIC; }
 
-  void update_link(NodeAddress from, NodeAddress to, 
-		   Vector<SR2RateSize> rs, 
-		   Vector<int> fwd, Vector<int> rev, 
-		   uint32_t seq);
+  void update_links(const SR2LinkBatchMulti &batch);
+
+private:
+
+  SR2ETXTableMulti _etx_table;
 
 };
 